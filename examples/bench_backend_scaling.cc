@@ -0,0 +1,155 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include <glog/logging.h>
+
+#include "Frame.h"
+#include "Feature.h"
+#include "Point.h"
+#include "internal/OptimizationBackend/EnergyFunctional.h"
+#include "internal/Residuals.h"
+
+/*********************************************************************************
+ * This program measures how the backend scales with the size of the window.
+ * For windows of 7 to 30 keyframes it builds a synthetic energy functional: every
+ * frame hosts the same number of points, each point is observed by the frames
+ * close to its host, like in a real sliding window. It then times one
+ * accumulate-and-solve step (EnergyFunctional::solveSystemF).
+ *
+ * usage: bench_backend_scaling [points=300] [covis=4] [reps=20] [mt=1]
+ *********************************************************************************/
+
+using namespace std;
+using namespace ldso;
+using namespace ldso::internal;
+
+int pointsPerFrame = 300;   // points hosted by each frame
+int covisibility = 4;       // a point is observed by the frames up to this far away from its host
+int reps = 20;              // solve steps per window size
+
+void parseArgument(char *arg) {
+    int option;
+    if (1 == sscanf(arg, "points=%d", &option)) {
+        pointsPerFrame = option;
+        return;
+    }
+    if (1 == sscanf(arg, "covis=%d", &option)) {
+        covisibility = option;
+        return;
+    }
+    if (1 == sscanf(arg, "reps=%d", &option)) {
+        reps = option;
+        return;
+    }
+    if (1 == sscanf(arg, "mt=%d", &option)) {
+        multiThreading = option == 1;
+        return;
+    }
+    printf("could not parse argument \"%s\"!!!!\n", arg);
+}
+
+/**
+ * random but consistent jacobians for slot i of a block, the inner products are computed from the columns
+ */
+void fillSlot(ResidualBlock *blk, int i, std::mt19937 &rng) {
+    std::normal_distribution<float> n01(0, 1);
+    for (int k = 0; k < 2; k++) {
+        for (int j = 0; j < 6; j++) blk->Jpdxi[k][i][j] = 100 * n01(rng);
+        for (int j = 0; j < CPARS; j++) blk->Jpdc[k][i][j] = 10 * n01(rng);
+        blk->Jpdd[i][k] = 10 * n01(rng);
+        for (int j = 0; j < patternNum; j++) {
+            blk->JIdx[k][i][j] = 10 * n01(rng);
+            blk->JabF[k][i][j] = n01(rng);
+        }
+    }
+    for (int j = 0; j < patternNum; j++) blk->resF[i][j] = n01(rng);
+
+    for (int r = 0; r < 2; r++)
+        for (int c = 0; c < 2; c++) {
+            blk->JIdx2[i](r, c) = blk->JIdx[r][i].dot(blk->JIdx[c][i]);
+            blk->JabJIdx[i](r, c) = blk->JabF[r][i].dot(blk->JIdx[c][i]);
+            blk->Jab2[i](r, c) = blk->JabF[r][i].dot(blk->JabF[c][i]);
+        }
+    blk->active[i] = 1;
+    blk->takeData(i);
+}
+
+int main(int argc, char **argv) {
+
+    FLAGS_colorlogtostderr = true;
+    for (int i = 1; i < argc; i++)
+        parseArgument(argv[i]);
+
+    shared_ptr<Camera> cam(new Camera(500, 500, 320, 240));
+    shared_ptr<CalibHessian> Hcalib(new CalibHessian(cam));
+    IndexThreadReduce<Vec10> threadReduce;
+
+    printf("%d points per frame, covisibility %d, %d steps, %s\n", pointsPerFrame, covisibility, reps,
+           multiThreading ? "multi-threaded" : "single-threaded");
+    printf("frames   pairs with residuals   residuals   ms per step\n");
+
+    const int windowSizes[] = {7, 10, 15, 20, 25, 30};
+    for (int nFrames : windowSizes) {
+        std::mt19937 rng(nFrames);
+        shared_ptr<EnergyFunctional> ef(new EnergyFunctional());
+        ef->red = &threadReduce;
+
+        vector<shared_ptr<Frame>> frames;
+        for (int i = 0; i < nFrames; i++) {
+            shared_ptr<Frame> frame(new Frame(i));
+            frame->CreateFH(frame);
+            frame->frameHessian->frameID = i;
+            frame->frameHessian->ab_exposure = 1;
+            frame->frameHessian->setEvalPT_scaled(SE3(), AffLight(0, 0));
+            frames.push_back(frame);
+            ef->insertFrame(frame->frameHessian, Hcalib);
+        }
+
+        for (int h = 0; h < nFrames; h++) {
+            for (int k = 0; k < pointsPerFrame; k++) {
+                shared_ptr<Feature> feat = Feature::Create(k % 640, k / 640, frames[h]);
+                feat->status = Feature::FeatureStatus::VALID;
+                feat->point = shared_ptr<Point>(new Point());
+                feat->point->status = Point::PointStatus::ACTIVE;
+                shared_ptr<PointHessian> ph = PointHessian::Create();
+                ph->point = feat->point;
+                ph->priorF = 1;
+                feat->point->mpPH = ph;
+                frames[h]->features.push_back(feat);
+
+                for (int t = std::max(0, h - covisibility); t <= std::min(nFrames - 1, h + covisibility); t++) {
+                    if (t == h || rng() % 5 == 0)
+                        continue;
+                    shared_ptr<PointFrameResidual> r = PointFrameResidual::Create(
+                            ph, frames[h]->frameHessian, frames[t]->frameHessian);
+                    ph->residuals.push_back(r);
+                    ef->insertResidual(r);
+                    fillSlot(r->block, r->blockIdx, rng);
+                }
+            }
+        }
+
+        ef->makeIDX();
+        ef->setDeltaF(Hcalib);
+
+        int pairs = 0;
+        for (auto &blk : ef->residualBlocks)
+            if (blk && !blk->empty())
+                pairs++;
+
+        ef->solveSystemF(0, 1e-5, Hcalib);   // warm up, allocates the accumulators
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++)
+            ef->solveSystemF(0, 1e-5, Hcalib);
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / reps;
+
+        printf("%6d   %9d / %-9d   %9d   %11.3f\n", nFrames, pairs, nFrames * nFrames, ef->nResiduals, ms);
+
+        for (auto &frame : frames)
+            frame->ReleaseAll();
+    }
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * Convert a DBoW3 vocabulary into the flat vocabulary format, which is memory mapped at start up.
+ * Usage: convert_vocabulary ./vocab/orbvoc.dbow3 ./vocab/orbvoc.dbow3.flat
+ */
+
+#include "FlatVocabulary.h"
+
+#include <glog/logging.h>
+
+using namespace std;
+using namespace ldso;
+
+int main(int argc, char **argv) {
+    FLAGS_colorlogtostderr = true;
+    if (argc != 3) {
+        LOG(ERROR) << "usage: " << argv[0] << " <dbow3 vocabulary> <flat vocabulary>" << endl;
+        return 1;
+    }
+
+    if (!FlatVocabulary::Convert(argv[1], argv[2])) {
+        LOG(ERROR) << "conversion failed" << endl;
+        return 1;
+    }
+    LOG(INFO) << "saved flat vocabulary to " << argv[2] << endl;
+    return 0;
+}
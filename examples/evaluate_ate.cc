@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+/*********************************************************************************
+ * This program computes the absolute trajectory error (ATE) of trajectories saved
+ * by FullSystem::printResult against a ground truth, after aligning them with a
+ * similarity transform (monocular, the scale is unknown). Used to compare runs,
+ * e.g. with backend=0 and backend=1:
+ *
+ *   evaluate_ate <groundtruth> <trajectory> [<trajectory> ...]
+ *
+ * Lines are "timestamp tx ty tz qx qy qz qw" (TUM format, timestamps in seconds),
+ * or the EuRoC ground truth csv "timestamp[ns],px,py,pz,...". Lines starting with
+ * '#' are skipped. A pose is matched to the ground truth pose closest in time, if
+ * it is at most 20 ms away.
+ *********************************************************************************/
+
+using namespace std;
+
+const double maxTimeDiff = 0.02;
+
+struct StampedPosition {
+    double timestamp;
+    Eigen::Vector3d t;
+
+    bool operator<(const StampedPosition &other) const { return timestamp < other.timestamp; }
+};
+
+bool loadTrajectory(const string &filename, vector<StampedPosition> &traj) {
+    ifstream fin(filename);
+    if (!fin) {
+        printf("cannot open %s!\n", filename.c_str());
+        return false;
+    }
+
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        bool csv = line.find(',') != string::npos;
+        if (csv)
+            replace(line.begin(), line.end(), ',', ' ');
+
+        istringstream ss(line);
+        StampedPosition p;
+        if (!(ss >> p.timestamp >> p.t[0] >> p.t[1] >> p.t[2]))
+            continue;
+        if (csv)
+            p.timestamp *= 1e-9;    // EuRoC stores nanoseconds
+        traj.push_back(p);
+    }
+    sort(traj.begin(), traj.end());
+    return !traj.empty();
+}
+
+/**
+ * align the trajectory to the ground truth with a sim3 and return the RMSE of the positions
+ * @param matched the number of poses matched to the ground truth
+ * @param scale the scale of the alignment
+ */
+double computeATE(const vector<StampedPosition> &gt, const vector<StampedPosition> &traj, int &matched,
+                  double &scale) {
+    vector<Eigen::Vector3d> src, dst;
+    for (auto &p : traj) {
+        auto it = lower_bound(gt.begin(), gt.end(), p);
+        double best = maxTimeDiff;
+        const StampedPosition *match = nullptr;
+        if (it != gt.end() && fabs(it->timestamp - p.timestamp) <= best) {
+            best = fabs(it->timestamp - p.timestamp);
+            match = &(*it);
+        }
+        if (it != gt.begin() && fabs((it - 1)->timestamp - p.timestamp) <= best)
+            match = &(*(it - 1));
+        if (match) {
+            src.push_back(p.t);
+            dst.push_back(match->t);
+        }
+    }
+
+    matched = src.size();
+    if (matched < 3)
+        return NAN;
+
+    Eigen::Matrix3Xd S(3, matched), D(3, matched);
+    for (int i = 0; i < matched; i++) {
+        S.col(i) = src[i];
+        D.col(i) = dst[i];
+    }
+    Eigen::Matrix4d T = Eigen::umeyama(S, D, true);
+    scale = T.block<3, 3>(0, 0).col(0).norm();
+
+    Eigen::Matrix3Xd aligned = (T.block<3, 3>(0, 0) * S).colwise() + T.block<3, 1>(0, 3);
+    return sqrt((aligned - D).colwise().squaredNorm().mean());
+}
+
+int main(int argc, char **argv) {
+
+    if (argc < 3) {
+        printf("usage: evaluate_ate <groundtruth> <trajectory> [<trajectory> ...]\n");
+        return 1;
+    }
+
+    vector<StampedPosition> gt;
+    if (!loadTrajectory(argv[1], gt))
+        return 1;
+
+    int ret = 0;
+    for (int i = 2; i < argc; i++) {
+        vector<StampedPosition> traj;
+        if (!loadTrajectory(argv[i], traj)) {
+            ret = 1;
+            continue;
+        }
+        int matched = 0;
+        double scale = 0;
+        double ate = computeATE(gt, traj, matched, scale);
+        if (matched < 3) {
+            printf("%s: only %d of %d poses match the ground truth!\n", argv[i], matched, (int) traj.size());
+            ret = 1;
+            continue;
+        }
+        printf("%s: ATE rmse %f, %d of %d poses matched, scale %f\n", argv[i], ate, matched,
+               (int) traj.size(), scale);
+    }
+    return ret;
+}
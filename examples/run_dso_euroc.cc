@@ -167,6 +167,11 @@ void parseArgument(char *arg) {
         }
         return;
     }
+    if (1 == sscanf(arg, "backend=%d", &option)) {
+        setting_backendPrecision = option;
+        printf("BACKEND PRECISION %d!\n", setting_backendPrecision);
+        return;
+    }
     if (1 == sscanf(arg, "prefetch=%d", &option)) {
         if (option == 1) {
             prefetch = true;
@@ -286,7 +291,10 @@ int main(int argc, char **argv) {
     }
 
     shared_ptr<ORBVocabulary> voc(new ORBVocabulary());
-    voc->load(vocPath);
+    if (!voc->Load(vocPath)) {
+        LOG(ERROR) << "cannot load vocabulary " << vocPath << "! please check the vocab directory or the path!" << endl;
+        exit(-1);
+    }
 
     shared_ptr<FullSystem> fullSystem(new FullSystem(voc));
     fullSystem->setGammaFunction(reader->getPhotometricGamma());
@@ -45,6 +45,13 @@ namespace ldso {
 
         ~Feature() {}
 
+        /**
+         * create a feature. Features are not pooled, since they live as long as their keyframe in the map
+         */
+        static inline shared_ptr<Feature> Create(float u, float v, shared_ptr<Frame> host) {
+            return shared_ptr<Feature>(new Feature(u, v, host));
+        }
+
         /**
          * Create a map point from the immature structure
          */
@@ -0,0 +1,129 @@
+#pragma once
+#ifndef LDSO_FLAT_VOCABULARY_H_
+#define LDSO_FLAT_VOCABULARY_H_
+
+#include "NumTypes.h"
+#include "internal/IndexThreadReduce.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace ldso {
+
+    /**
+     * ORB vocabulary tree in a flat binary layout, which can be memory mapped.
+     *
+     * The file is a header, the node array and the packed 32 byte descriptors of the nodes. The nodes are stored in
+     * breadth first order, so the children of a node are a contiguous range of nodes and descriptors, and a level of
+     * the tree is traversed with one batched descriptor distance. Node ids, word ids and weights are those of the
+     * DBoW3 vocabulary it was converted from, so bow vectors are the same as the ones of DBoW3 and can be used
+     * with DBoW3::Database.
+     */
+    class FlatVocabulary {
+    public:
+        FlatVocabulary() {}
+
+        ~FlatVocabulary();
+
+        FlatVocabulary(const FlatVocabulary &) = delete;
+
+        FlatVocabulary &operator=(const FlatVocabulary &) = delete;
+
+        /**
+         * load a vocabulary
+         * If path is a flat vocabulary it is memory mapped. Otherwise path + ".flat" is tried, and if it doesn't
+         * exist either, path is loaded as a DBoW3 vocabulary, converted, and saved to path + ".flat" for the next run.
+         * @return true if the vocabulary is loaded
+         */
+        bool Load(const string &path);
+
+        /**
+         * convert a DBoW3 vocabulary file into a flat vocabulary file
+         * @return true if success
+         */
+        static bool Convert(const string &dbow3Path, const string &flatPath);
+
+        /**
+         * bow vector and feature vector of descriptors, same as DBoW3::Vocabulary::transform
+         * @param descs n descriptors stored contiguously (32 * n bytes)
+         * @param n number of descriptors
+         * @param levelsup levels to go up from the words for the node ids of the feature vector. Words above that
+         * level (branches of the tree that end early) use their own node id, where DBoW3 leaves the node id unset
+         * @param threadReduce if not null, the descriptors are distributed over its threads
+         */
+        void Transform(const unsigned char *descs, int n, DBoW3::BowVector &bowVec, DBoW3::FeatureVector &featVec,
+                       int levelsup, internal::IndexThreadReduce<Vec10> *threadReduce = nullptr) const;
+
+        /**
+         * create an empty keyframe database for this vocabulary
+         */
+        shared_ptr<DBoW3::Database> CreateDatabase() const;
+
+        inline bool empty() const { return numNodes == 0; }
+
+        inline unsigned int size() const { return numWords; }
+
+        // on disk layout
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            int32_t k, L;
+            int32_t weighting, scoring;
+            uint32_t numNodes, numWords;
+            uint32_t reserved;
+            uint64_t nodesOffset;
+            uint64_t descOffset;
+        };
+
+        struct Node {
+            uint32_t firstChild;    // index of the first child in the node array, children are contiguous
+            uint32_t numChildren;   // 0 for words
+            uint32_t id;            // DBoW3 node id
+            uint32_t wordId;
+            double weight;
+        };
+
+    private:
+        // build the flat layout of a DBoW3 vocabulary file into buffer
+        static bool Build(const string &dbow3Path, vector<char> &buffer);
+
+        // write a flat vocabulary to a temporary file in the directory of path and rename it to path, so a
+        // concurrent or later Map never sees a partly written file
+        static bool Save(const vector<char> &buffer, const string &path);
+
+        // map a flat vocabulary file, returns false if the file is not a valid flat vocabulary
+        bool Map(const string &path);
+
+        // set the pointers into data
+        bool Attach(const char *data, size_t size);
+
+        void Release();
+
+        // the word a descriptor belongs to, and the node id at level nidLevel
+        void TransformOne(const unsigned char *desc, uint32_t &wordId, double &weight, uint32_t &nid,
+                          int nidLevel) const;
+
+        // TransformOne on the descriptors in [min, max)
+        void Transform_Reductor(const unsigned char *descs, int nidLevel, uint32_t *wordIds, double *weights,
+                                uint32_t *nids, int min, int max, Vec10 *stats, int tid) const;
+
+        static const char MAGIC[8];
+        static const uint32_t VERSION = 1;
+
+        // storage, either a memory mapped file or a buffer
+        void *mapped = nullptr;
+        size_t mappedSize = 0;
+        vector<char> buffer;
+
+        const Header *header = nullptr;
+        const Node *nodes = nullptr;
+        const unsigned char *descriptors = nullptr;
+        uint32_t numNodes = 0;
+        uint32_t numWords = 0;
+    };
+}
+
+#endif // LDSO_FLAT_VOCABULARY_H_
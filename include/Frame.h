@@ -18,6 +18,9 @@ namespace ldso {
     struct Feature;
     namespace internal {
         class FrameHessian;
+
+        template<typename Running>
+        class IndexThreadReduce;
     }
     struct Point;
 
@@ -80,8 +83,9 @@ namespace ldso {
         /**
          * compute bow vectors
          * @param voc vocabulary pointer
+         * @param threadReduce optional thread pool for the tree descents
          */
-        void ComputeBoW(shared_ptr<ORBVocabulary> voc);
+        void ComputeBoW(shared_ptr<ORBVocabulary> voc, internal::IndexThreadReduce<Vec10> *threadReduce = nullptr);
 
         // get keyframes in window
         set<shared_ptr<Frame>> GetConnectedKeyFrames();
@@ -89,6 +93,12 @@ namespace ldso {
         // get all associated points
         vector<shared_ptr<Point>> GetPoints();
 
+        /**
+         * update the world position of the points hosted by this frame, same as Point::ComputeWorldPos on each of
+         * them, but the optimized pose is read once and the points are transformed together
+         */
+        void ComputeWorldPoints();
+
         // save & load
         void save(ofstream &fout);    // this will save all the map points
         void load(ifstream &fin, shared_ptr<Frame> &thisFrame, vector<shared_ptr<Frame>> &allKF);
@@ -6,28 +6,43 @@
 #include "Frame.h"
 #include "Point.h"
 #include "internal/CalibHessian.h"
+#include "internal/IndexThreadReduce.h"
 
 #include <set>
+#include <map>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
 
 using namespace std;
 using namespace ldso::internal;
 
+namespace g2o {
+    class SparseOptimizer;
+}
+
 namespace ldso {
 
     class FullSystem;
 
+    class EdgeSim3;
+
     /**
      * The global map contains all keyframes and map points, even if they are marginalized or outdated.
      * The map can be saved to and loaded from disk, if you wanna reuse it.
      *
      * The loop closing thread will call the optimize function if there is a consistent loop closure.
+     * Pose graph optimizations run in one worker thread owned by the map. Requests that arrive while one is pending
+     * are merged into it, and a running incremental optimization is cancelled and restarted with the newer loop.
      */
 
     class Map {
     public:
-        Map(FullSystem *fs) : fullsystem(fs) {}
+        Map(FullSystem *fs);
+
+        ~Map();
 
         /**
          * add a keyframe into the global map
@@ -36,17 +51,18 @@ namespace ldso {
         void AddKeyFrame(shared_ptr<Frame> kf);
 
         /**
-         * optimize pose graph of all kfs
-         * this will start the pose graph optimization thread (usually takes several seconds to return in my machine)
-         * @param allKFs
-         * @return true if pose graph thread is started
+         * request a pose graph optimization of all kfs
+         * The request is merged with the pending ones. If an incremental optimization is running it is cancelled,
+         * and the next one also covers its keyframes.
+         * @return future that is true once an optimization including the current keyframes has finished,
+         * or false if the map is destroyed before
          */
-        bool OptimizeALLKFs();
+        future<bool> OptimizeALLKFs();
 
-        // optimize pose graph on all kfs after odometry loop is done
+        // optimize pose graph on all kfs after odometry loop is done, waits for the result
         void lastOptimizeAllKFs();
 
-        /// update the cached 3d position of all points.
+        /// update the cached 3d position of all points, of the keyframes in the map when it is called
         void UpdateAllWorldPoints();
 
         /**
@@ -57,19 +73,48 @@ namespace ldso {
             return frames.size();
         }
 
-        // is pose graph running?
-        bool Idle() {
+        // block until no pose graph optimization is running or requested
+        void WaitIdle() {
             unique_lock<mutex> lock(mutexPoseGraph);
-            return !poseGraphRunning;
+            poseGraphCond.wait(lock, [this] { return !poseGraphRunning && poseGraphRequests.empty(); });
         }
 
         set<shared_ptr<Frame>, CmpFrameID> GetAllKFs() { return frames; }
 
         unsigned long getLatestOptimizedKfId() const { return latestOptimizedKfId; }
 
+        /**
+         * threads of the work in the background of the odometry: the point refresh of the pose graph worker and the
+         * loop closing share them, instead of keeping NUM_THREADS threads each
+         */
+        IndexThreadReduce<Vec10> *GetBackgroundReduce() { return &backgroundReduce; }
+
     private:
-        // the pose graph optimization thread
-        void runPoseGraphOptimization();
+        // add a request for the pose graph worker
+        future<bool> requestPoseGraph(bool full);
+
+        // the pose graph worker, serves the requests until the map is destroyed
+        void poseGraphLoop();
+
+        /**
+         * optimize the pose graph of framesOpti
+         * @param full optimize all keyframes, otherwise only the ones affected by new or changed edges
+         * @param cancellable stop if poseGraphCancel is set
+         * @return false if cancelled, the poses are left unchanged then
+         */
+        bool runPoseGraphOptimization(bool full, bool cancellable);
+
+        /**
+         * add the new keyframes and poseRel edges of framesOpti to the pose graph and update the changed edges
+         * @return smallest keyframe id connected to a new or changed edge, or -1 if nothing changed
+         */
+        int updatePoseGraph();
+
+        // update the world positions of the points of the given keyframes, in parallel
+        void refreshWorldPoints(const vector<shared_ptr<Frame>> &kfs);
+
+        void refreshWorldPoints_Reductor(const vector<shared_ptr<Frame>> *kfs, int min, int max, Vec10 *stats,
+                                         int tid);
 
         mutex mapMutex; // map mutex to protect its data
         set<shared_ptr<Frame>, CmpFrameID> frames;      // all KFs by ID
@@ -79,8 +124,25 @@ namespace ldso {
         // keyframe id of newest optimized keyframe frame
         unsigned long latestOptimizedKfId = 0;
 
-        bool poseGraphRunning = false;  // is pose graph running?
+        // pose graph worker and its requests, protected by mutexPoseGraph
+        thread poseGraphThread;
         mutex mutexPoseGraph;
+        condition_variable poseGraphCond;       // new requests, finished optimizations
+        vector<promise<bool>> poseGraphRequests;   // pending requests, served by one optimization
+        bool poseGraphRequestFull = false;      // one of the pending requests needs the whole graph
+        bool poseGraphRunning = false;          // is pose graph running?
+        bool poseGraphExit = false;
+        atomic<bool> poseGraphCancel{false};    // cancel the running optimization
+
+        // persistent pose graph, vertex ids are keyframe ids. Only touched by the pose graph thread
+        unique_ptr<g2o::SparseOptimizer> poseGraph;
+        map<pair<int, int>, EdgeSim3 *> poseGraphEdges;    // edges by (kfId, related kfId) of poseRel
+        int poseGraphFixedId = -1;                          // the fixed vertex
+        int poseGraphDirtyId = -1;      // smallest kf id changed but not optimized by a cancelled optimization
+        bool poseGraphLastCancelled = false;    // a run is cancelled at most once in a row, so loops can't starve it
+
+        IndexThreadReduce<Vec10> backgroundReduce;  // threads of refreshWorldPoints and the loop closing
+        mutex mutexPointRefresh;
 
         FullSystem *fullsystem = nullptr;
     };
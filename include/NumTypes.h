@@ -124,8 +124,11 @@ typedef vector<Vec3, Eigen::aligned_allocator<Vec3>> VecVec3;
 typedef vector<Vec2f, Eigen::aligned_allocator<Vec2f>> VecVec2f;
 typedef vector<Vec3f, Eigen::aligned_allocator<Vec3f>> VecVec3f;
 
-// DBoW vocabulary
-typedef DBoW3::Vocabulary ORBVocabulary;
+// DBoW vocabulary, see FlatVocabulary.h
+namespace ldso {
+    class FlatVocabulary;
+}
+typedef ldso::FlatVocabulary ORBVocabulary;
 
 
 #endif // LDSO_NUM_TYPES_H_
@@ -75,6 +75,13 @@ namespace ldso {
     extern int setting_maxOptIterations;
     extern int setting_minOptIterations;
     extern float setting_thOptIterations;
+
+    // adaptive termination of the backend optimization (after setting_minOptIterations): stop before the next solve
+    // when the quadratic model of the last solve predicts less than setting_optPredictedDecreaseTH times the last
+    // actual decrease for continuing along the last step, or when the optimization of a keyframe took more than
+    // setting_optTimeBudgetMs. 0 disables a criterion, both are off by default (fixed iteration count like DSO)
+    extern float setting_optPredictedDecreaseTH;
+    extern float setting_optTimeBudgetMs;
     extern float setting_outlierTH;
     extern float setting_outlierTHSumComponent;
     extern float setting_outlierSmoothnessTH; // higher -> more strict
@@ -183,6 +190,47 @@ namespace ldso {
     // this is only for debugging (and for plotting when writing a paper)
     extern bool setting_showLoopClosing;
 
+    // number of loop candidates queried from the keyframe database, they are verified in parallel
+    extern int setting_loopCandidates;
+
+    // the pose graph is kept between loop closures. If incremental, only the keyframes since the oldest one touched
+    // by a new or changed edge are optimized, the older ones are held fixed. The iterations stop when the chi2
+    // decreases by less than setting_poseGraphChi2TH (relative). The final optimization always uses the whole graph.
+    extern bool setting_poseGraphIncremental;
+    extern float setting_poseGraphChi2TH;
+
+    // after a pose graph optimization, the world positions of the points of a keyframe are only refreshed if its
+    // pose changed by more than this (norm of the sim3 log), 0 refreshes all. Keyframes moved by the odometry since
+    // the last optimization are always refreshed.
+    extern float setting_pointRefreshPoseTH;
+
+    // compute the orientations and descriptors of the corners of a new keyframe in a separate thread instead of in
+    // makeKeyFrame. The keyframe is passed to loop closing once its descriptors are done.
+    extern bool setting_asyncDescriptors;
+
+    // use the AVX2/FMA kernels if the cpu supports them, otherwise fall back to SSE
+    extern bool setting_useAVX2;
+
+    // lazy relinearization in the LM iterations of the backend: a residual keeps its jacobians and energy if its
+    // point idepth and frame-pair precalc changed less than setting_lazyRelinTH since it was linearized. The
+    // threshold is relative and unitless, |new - old| <= th * |old| for the idepth, rotation, translation and the
+    // affine parameters (see ResidualBlock::precalcChanged).
+    // Every setting_lazyRelinFullEvery-th iteration relinearizes everything and logs the energy error of the skipping.
+    // Disabled by default, trades accuracy for backend time
+    extern bool setting_lazyRelin;
+    extern float setting_lazyRelinTH;
+    extern int setting_lazyRelinFullEvery;
+
+    // accumulate the active, linearized and schur complement hessians in a single pass over the points
+    extern bool setting_fusedAccumulation;
+
+    // precision of stitching the fused accumulators into the backend system (the solve is always in double), only
+    // used with setting_fusedAccumulation, the separate accumulation always stitches in double:
+    // 0: double, 1: float (the calibration block is summed with compensation, the per-thread parts pairwise),
+    // 2: stitch like 1, and also stitch and solve in double to log the deviation of the system, of the step and of
+    // the energy change the step is predicted to give
+    extern int setting_backendPrecision;
+
     // use the ninth pattern (described in DSO's paper)
 #define patternP staticPattern[8]
 
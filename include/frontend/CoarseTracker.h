@@ -98,6 +98,17 @@ namespace ldso {
          */
         void calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, const SE3 &refToNew, AffLight aff_g2l);
 
+#if LDSO_HAS_AVX2
+        /**
+         * @brief AVX2 part of calcGSSSE, accumulates the warped buffers 8 at a time into acc
+         * @param[in] lvl image pyramid level
+         * @param[in] a relative affine a between reference and new frame
+         * @param[in] n number of warped terms
+         * @return number of terms processed, the (at most 4) remaining ones are left to the SSE loop
+         */
+        int calcGSAVX(int lvl, float a, int n);
+#endif
+
 
         // point cloud buffers
         // wxh in each pyramid layer
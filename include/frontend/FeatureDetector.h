@@ -18,6 +18,8 @@ namespace ldso {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
         const int HALF_PATCH_SIZE = 15; // half patch size for computing ORB descriptor
+        const int NMS_RADIUS = 5;       // corners closer than this suppress each other
+        const int ORIENTATION_BINS = 360;   // the descriptor pattern is rotated by the orientation quantized to bins
 
         FeatureDetector();
 
@@ -26,18 +28,42 @@ namespace ldso {
         /**
          * detector corners
          * @param frame input frame, feature should already be created by PixelSelector
+         * @param computeDescriptors if false, the orientation and descriptor of the corners are left for a later
+         * ComputeDescriptors call
          * @return number of selected features
          */
-        int DetectCorners(int nFeatures, shared_ptr<Frame> &frame);
+        int DetectCorners(int nFeatures, shared_ptr<Frame> &frame, bool computeDescriptors = true);
 
+        /**
+         * compute the ORB descriptor of a feature, with the pattern rotated by feat->angle
+         * @return 0
+         */
         int ComputeDescriptor(shared_ptr<Frame> &frame, shared_ptr<Feature> feat);
 
+        /**
+         * compute the orientation and the descriptor of all corners in the frame
+         * Uses the AVX2 kernels if available, which give the same descriptors as IC_Angle + ComputeDescriptor
+         * for the same orientation. Only reads the detector's tables, so it may run in another thread than
+         * DetectCorners.
+         * @param fh frame hessian holding the image, frame->frameHessian if null. Pass it if the frame may be
+         * marginalized meanwhile, which releases frame->frameHessian.
+         * @return number of corners
+         */
+        int ComputeDescriptors(shared_ptr<Frame> &frame, shared_ptr<FrameHessian> fh = nullptr);
+
+        /**
+         * non-maximum suppression of the corners found by DetectCorners: isCorner is cleared if a corner closer
+         * than NMS_RADIUS has a higher score, or the same score and a larger index. This is the set the pairwise
+         * comparison of all corners gives, found in the neighbouring cells of a grid.
+         * @param corners features with isCorner set
+         */
+        void SuppressNonMaxima(const vector<shared_ptr<Feature>> &corners);
+
         /**
          * debug stuffs
          */
         void DrawFeatures(shared_ptr<Frame> &frame, const string &windowName = "corner");
 
-    private:
         /**
          * shi-tomasi score
          * @param frame, must have frame hessian since we need dI
@@ -81,6 +107,19 @@ namespace ldso {
             return 0.5 * (dXX + dYY - sqrt((dXX + dYY) * (dXX + dYY) - 4 * (dXX * dYY - dXY * dXY)));
         }
 
+        /**
+         * shi-tomasi score of all pixels in a cell, same as ShiTomasiScore of each pixel up to rounding
+         * The gradient products are summed over the box with running sums over the rows and box sums over the
+         * columns, so a product is computed once per cell instead of once per box it falls in.
+         * @param frame, must have frame hessian since we need dI
+         * @param x0, y0 top left pixel of the cell
+         * @param size cell width and height
+         * @param scores output, size * size scores, row by row
+         */
+        void ShiTomasiCell(shared_ptr<Frame> &frame, int x0, int y0, int size, float *scores, int halfbox = 4,
+                           int level = 0);
+
+    private:
         /**
          * compute the rotation of a feature point
          * @param image the image stored in FrameHessian
@@ -118,8 +157,40 @@ namespace ldso {
         //float minScoreTH = 0.05;
         //float minDistance = 10;
 
+        // descriptor of a feature in the image of its level
+        void ComputeDescriptor(const Vec3f *img, const shared_ptr<Feature> &feat);
+
+        /**
+         * the orientation bin of an angle from IC_Angle, the nearest bin center. An angle exactly between two
+         * centers goes to the upper bin, and the angles next to 2 pi wrap to bin 0, so -pi and pi share a bin.
+         * The AVX2 and the scalar IC_Angle can differ by rounding, a corner next to a bin boundary may then get the
+         * neighbouring bin on the other path; both paths give the same descriptor for the same angle.
+         */
+        inline int OrientationBin(float angle) const {
+            float a = angle < 0 ? angle + float(2 * M_PI) : angle;
+            int bin = int(a * (ORIENTATION_BINS / float(2 * M_PI)) + 0.5f);
+            return bin >= ORIENTATION_BINS ? bin - ORIENTATION_BINS : bin;
+        }
+
+        // the ORB pattern rotated by one orientation bin, pixel offsets of the two points of the 256 tests
+        struct RotatedPattern {
+            signed char x0[256], y0[256], x1[256], y1[256];
+        };
+
         // static data
         std::vector<int> umax;  // used to compute rotation
+        std::vector<RotatedPattern> rotatedPatterns;    // one for each orientation bin
+
+        // buffers of DetectCorners and SuppressNonMaxima, kept to avoid allocations per cell and per frame
+        vector<pair<int, float>> candidates;    // candidates in one grid cell, index and score
+        vector<int> nmsCellStart;               // corners of nms cell c are nmsCellItems[nmsCellStart[c], nmsCellStart[c+1])
+        vector<int> nmsCellItems;
+        vector<int> nmsCellOf;                  // nms cell of each corner
+        vector<float> cellScores;               // shi-tomasi scores of the pixels in one grid cell
+
+        // buffers of ShiTomasiCell
+        vector<float> gradProducts;     // dx*dx, dy*dy and dx*dy planes of the cell with its box border
+        vector<float> boxColumns;       // the products summed over the box rows, for each column
     };
 }
 
@@ -33,6 +33,15 @@ namespace ldso {
         /// the distance of two descriptors
         static int DescriptorDistance(const unsigned char *desc1, const unsigned char *desc2);
 
+        /**
+         * distances of one descriptor to many, uses AVX2 if available
+         * @param desc the descriptor (32 bytes)
+         * @param descs n descriptors stored contiguously (32 * n bytes)
+         * @param n number of descriptors in descs
+         * @param dist output, n distances
+         */
+        static void DescriptorDistances(const unsigned char *desc, const unsigned char *descs, int n, int *dist);
+
         /**
          * Brute-force Search for feature matching
          * @param frame1
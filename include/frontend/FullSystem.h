@@ -14,6 +14,7 @@
 #include "ImageAndExposure.h"
 #include "DSOViewer.h"
 #include "Map.h"
+#include "FlatVocabulary.h"
 #include "FeatureDetector.h"
 #include "FeatureMatcher.h"
 #include "PixelSelector2.h"
@@ -214,14 +215,15 @@ namespace ldso
         /**
          * linearize all the residuals
          * @param fixLinearization if true, fix the jacobians after this linearization
+         * @param lazy if true, skip the residuals whose linearization point barely changed (see setting_lazyRelin)
          * @return
          */
-        Vec3 linearizeAll(bool fixLinearization);
+        Vec3 linearizeAll(bool fixLinearization, bool lazy = false);
 
         // reducer for multi-threading
         void
-        linearizeAll_Reductor(bool fixLinearization, std::vector<shared_ptr<PointFrameResidual>> *toRemove, int min,
-                              int max,
+        linearizeAll_Reductor(bool fixLinearization, bool lazy, std::vector<shared_ptr<PointFrameResidual>> *toRemove,
+                              int min, int max,
                               Vec10 *stats, int tid);
 
         /// step from the backup data
@@ -234,6 +236,16 @@ namespace ldso
         /// load from the backup state
         void loadSateBackup();
 
+        /// collect the active points of the window into optPoints, called at the beginning of optimize
+        void gatherOptPoints();
+
+        // reducers of the point passes in doStepFromBackup, backupState and loadSateBackup
+        void doStepFromBackup_Reductor(float stepfacD, bool momentum, int min, int max, Vec10 *stats, int tid);
+
+        void backupState_Reductor(bool backupStep, int min, int max, Vec10 *stats, int tid);
+
+        void loadStateBackup_Reductor(int min, int max, Vec10 *stats, int tid);
+
         /// energy computing functions, called in optimization
         double calcLEnergy();
 
@@ -265,6 +277,12 @@ namespace ldso
          */
         void mappingLoop();
 
+        /**
+         * descriptor stage, running in its own thread if setting_asyncDescriptors
+         * computes the corner descriptors of the new keyframes in order and passes them to loop closing
+         */
+        void descriptorLoop();
+
         /// print the residual in optimization
         void printOptRes(const Vec3 &res, double resL, double resM, double resPrior, double LExact, float a,
                          float b);
@@ -297,6 +315,13 @@ namespace ldso
 
         // active residuals
         std::vector<shared_ptr<PointFrameResidual>> activeResiduals;
+
+        // optimizer state of the active points, stored contiguously for the backup and step passes of optimize.
+        // The points are gathered once per optimize(), the vectors are indexed like optPoints
+        std::vector<PointHessian *> optPoints;
+        std::vector<float> optIdepthBackup;
+        std::vector<float> optStep;
+        std::vector<float> optStepBackup;
         float currentMinActDist = 2;
 
         std::vector<float> allResVec;
@@ -319,6 +344,14 @@ namespace ldso
         bool runMapping = true;
         bool needToKetchupMapping = false;
 
+        // descriptor stage. All protected by [descriptorMutex].
+        // The frame hessian is queued with its keyframe, so the image stays alive if the keyframe is marginalized first.
+        mutex descriptorMutex;
+        condition_variable descriptorCond;
+        deque<pair<shared_ptr<Frame>, shared_ptr<FrameHessian>>> descriptorQueue;
+        bool descriptorExit = false;
+        thread descriptorThread;
+
     public:
         shared_ptr<Map> globalMap = nullptr; // global map
         FeatureDetector detector;            // feature detector
@@ -9,10 +9,12 @@
 #include "CoarseTracker.h"
 
 #include "internal/CalibHessian.h"
+#include "internal/IndexThreadReduce.h"
 
 #include <list>
 #include <queue>
 #include <mutex>
+#include <atomic>
 
 using namespace std;
 
@@ -33,6 +35,26 @@ namespace ldso {
         // Consistent group, the first is a group of keyframes that are considered as consistent, and the second is how many times they are detected
         typedef pair<set<shared_ptr<Frame>>, int> ConsistentGroup;
 
+        /**
+         * a loop candidate from the keyframe database and the result of its verification
+         */
+        struct LoopCandidate {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+            shared_ptr<Frame> kf = nullptr;
+            double score = 0;
+
+            // verification result
+            bool success = false;
+            string stage = "queued";    // the stage where the verification stopped
+            Sim3 Scr;                   // Sim(3) from the candidate to current
+            Mat77 hessian = Mat77::Zero();
+            vector<Match> inlierMatches;
+
+            // time in milliseconds spent in the stages
+            double timeBoW = 0, timePnP = 0, timePose = 0;
+        };
+
         LoopClosing(FullSystem *fullSystem);
 
         ~LoopClosing() {
@@ -49,9 +71,10 @@ namespace ldso {
         bool DetectLoop(shared_ptr<Frame> &frame);
 
         /**
-         * compute RANSAC pnp in loop frames
+         * verify the loop candidates in parallel with RANSAC pnp and a sim3 optimization, and add the pose graph
+         * edge of the best ranked candidate that passes.
          * however this function will not try to optimize the pose graph, which will be done in full system
-         * @return true if find enough inliers
+         * @return true if a candidate has enough inliers
          */
         bool CorrectLoop(shared_ptr<CalibHessian> Hcalib);
 
@@ -66,23 +89,36 @@ namespace ldso {
             needFinish = finish;
             LOG(INFO) << "wait loop closing to join" << endl;
             mainLoop.join();
-            while (globalMap && globalMap->Idle() == false) {
-                usleep(10000);
-            }
-
-            if (needPoseGraph) {
-                if (globalMap) {
-                    globalMap->OptimizeALLKFs();
-                    usleep(5000);
-                }
-                while (globalMap && globalMap->Idle() == false) {
-                    usleep(10000);
-                }
-            }
+            if (globalMap)
+                globalMap->WaitIdle();
+            CheckPoseGraphResult();
             LOG(INFO) << "Loop closing thread is finished" << endl;
         }
 
     private:
+        /**
+         * log if the pose graph optimization requested for the last loop didn't run. Doesn't wait for it, a
+         * result that isn't ready is covered by the next request, which is merged with it
+         */
+        void CheckPoseGraphResult();
+
+        /**
+         * verify a single loop candidate: bow matching, RANSAC pnp and sim3 optimization.
+         * Stops early if a better ranked candidate has already passed
+         * @param idx index in candidates
+         * @return true if the candidate passes all the checks
+         */
+        bool VerifyCandidate(int idx, shared_ptr<CalibHessian> Hcalib);
+
+        // reducer of VerifyCandidate
+        void VerifyCandidate_Reductor(shared_ptr<CalibHessian> Hcalib, int min, int max, Vec10 *stats, int tid);
+
+        /**
+         * project the active points into the current keyframe and store their idepths in idepthMap,
+         * used by ComputeOptimizedPose
+         */
+        void ComputeIdepthMap();
+
         /**
          * compute an optimized sim3 from a given keyframe to current frame
          * @param pKF given keyframe, also loop candidate
@@ -104,7 +140,10 @@ namespace ldso {
         shared_ptr<DBoW3::Database> kfDB = nullptr;
         shared_ptr<ORBVocabulary> voc = nullptr;
 
-        shared_ptr<Frame> candidateKF = nullptr;
+        vector<LoopCandidate, Eigen::aligned_allocator<LoopCandidate>> candidates;  // sorted by score
+        atomic<int> firstPassed{0};   // index of the best ranked candidate that passed, candidates.size() if none
+        IndexThreadReduce<Vec10> *verifyReduce = nullptr;   // bow transform, candidate verification, owned by the map
+        future<bool> poseGraphResult;   // pose graph optimization requested for the last loop
         vector<shared_ptr<Frame>> allKF;
         map<DBoW3::EntryId, shared_ptr<Frame>> checkedKFs;    // keyframes that are recorded.
         int maxKFId = 0;
@@ -117,7 +156,6 @@ namespace ldso {
         bool finished = false;
         shared_ptr<CalibHessian> Hcalib = nullptr;
         bool needFinish = false;
-        bool needPoseGraph = false;
         float *idepthMap = nullptr;   // i hate this float*
         thread mainLoop;
 
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef LDSO_PNP_RANSAC_H_
+#define LDSO_PNP_RANSAC_H_
+
+#include "NumTypes.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace ldso {
+
+    /**
+     * P3P RANSAC for the loop closing verification
+     *
+     * Hypotheses come from the minimal P3P solver of Kneip et al. (CVPR 2011) on three random correspondences.
+     * The points are kept as structure of arrays, so a hypothesis is scored with Eigen array expressions in chunks,
+     * and the scoring stops once the hypothesis cannot beat the best one anymore. The number of iterations adapts to
+     * the inlier ratio of the best hypothesis. The best pose is refined with Gauss-Newton on its inliers.
+     */
+    class PnPRansac {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+        /**
+         * @param fx, fy, cx, cy pinhole intrinsics of the observations
+         * @param reprojTH inlier threshold of the reprojection error in pixels
+         * @param maxIterations upper bound of the RANSAC iterations
+         * @param confidence probability to draw at least one outlier free sample, used for the adaptive iterations
+         */
+        PnPRansac(float fx, float fy, float cx, float cy, float reprojTH = 8.0, int maxIterations = 100,
+                  float confidence = 0.99);
+
+        /**
+         * estimate the pose from 3d-2d correspondences
+         * @param points 3d points in the reference frame
+         * @param pixels observations of the points in the current frame
+         * @param Tcr output, pose from reference to current
+         * @param inliers output, indices of the inlier correspondences
+         * @return true if a pose with at least 4 inliers is found
+         */
+        bool Solve(const VecVec3f &points, const VecVec2f &pixels, SE3 &Tcr, vector<int> &inliers);
+
+        /**
+         * minimal solver
+         * @param P three 3d points in reference frame
+         * @param f bearing vectors of the three points in the current frame, normalized
+         * @param solutions up to four poses from reference to current
+         * @return number of solutions, 0 for degenerate samples (collinear points, parallel bearings)
+         */
+        static int P3P(const Vec3 P[3], const Vec3 f[3], SE3 solutions[4]);
+
+        int iterations = 0;     // RANSAC iterations of the last Solve
+
+    private:
+        /**
+         * count the inliers of a hypothesis, stops early if it can't get more than bestCount
+         */
+        int CountInliers(const SE3 &Tcr, int bestCount) const;
+
+        void GetInliers(const SE3 &Tcr, vector<int> &inliers) const;
+
+        // Gauss-Newton on the reprojection error of the inliers
+        void Refine(SE3 &Tcr, const vector<int> &inliers) const;
+
+        static const int CHUNK = 64;     // points scored at once
+
+        float fx, fy, cx, cy;
+        float th2;          // squared reprojection threshold
+        int maxIterations;
+        float confidence;
+
+        // the correspondences, structure of arrays
+        Eigen::ArrayXf X, Y, Z, u, v;
+    };
+}
+
+#endif // LDSO_PNP_RANSAC_H_
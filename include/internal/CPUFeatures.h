@@ -0,0 +1,44 @@
+#pragma once
+#ifndef LDSO_CPU_FEATURES_H_
+#define LDSO_CPU_FEATURES_H_
+
+#include "Settings.h"
+
+// AVX2/FMA kernels are compiled with a function-level target attribute, so they are available
+// even if the rest of the code is built without -mavx2, and selected at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LDSO_HAS_AVX2 1
+#define LDSO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define LDSO_HAS_AVX2 0
+#define LDSO_TARGET_AVX2
+#endif
+
+namespace ldso {
+
+    namespace internal {
+
+        /**
+         * check if the cpu supports AVX2 and FMA, the result is cached after the first call
+         * @return true if the 8-wide kernels can be used
+         */
+        inline bool cpuSupportsAVX2() {
+#if LDSO_HAS_AVX2
+            static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            return supported;
+#else
+            return false;
+#endif
+        }
+
+        /**
+         * whether to run the AVX2 code path, controlled by setting_useAVX2 and the cpu capability
+         */
+        inline bool useAVX2() {
+            return setting_useAVX2 && cpuSupportsAVX2();
+        }
+    }
+}
+
+#endif // LDSO_CPU_FEATURES_H_
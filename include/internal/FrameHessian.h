@@ -166,10 +166,10 @@ namespace ldso {
             // dIp[i] is the i-th pyramid with dIp[i][0] is the original image，[1] is dx and [2] is dy
             // by default, we have 6 pyramids, so we have dIp[0...5]
             // created in makeImages()
-            Vec3f *dIp[PYR_LEVELS];
+            Vec3f *dIp[PYR_LEVELS] = {nullptr};
 
             // absolute squared gradient of each pyramid
-            float *absSquaredGrad[PYR_LEVELS];  // only used for pixel select (histograms etc.). no NAN.
+            float *absSquaredGrad[PYR_LEVELS] = {nullptr};  // only used for pixel select (histograms etc.). no NAN.
 
             // dI = dIp[0], the first pyramid
             Vec3f *dI = nullptr;     // trace, fine tracking. Used for direction select (not for gradient histograms etc.)
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef LDSO_HAMMING_AVX2_H_
+#define LDSO_HAMMING_AVX2_H_
+
+#include "internal/CPUFeatures.h"
+
+#if LDSO_HAS_AVX2
+
+namespace ldso {
+
+    namespace internal {
+
+        /**
+         * hamming distance kernel of 32 byte descriptors, shared by the matcher and the vocabulary: the popcount of
+         * a xor b with a 4 bit lookup table, summed with sad_epu8 into four 64 bit partial sums (each < 256)
+         * @param a one descriptor in a register
+         * @param b the other descriptor, unaligned
+         */
+        LDSO_TARGET_AVX2
+        inline __m256i PartialHammingAVX2(__m256i a, const unsigned char *b) {
+            const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i lowMask = _mm256_set1_epi8(0x0f);
+            __m256i x = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *) b));
+            __m256i lo = _mm256_and_si256(x, lowMask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask);
+            __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+            return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+        }
+
+        /**
+         * hamming distance of two 32 byte descriptors, the horizontal sum of PartialHammingAVX2
+         */
+        LDSO_TARGET_AVX2
+        inline int HammingAVX2(__m256i a, const unsigned char *b) {
+            __m256i sad = PartialHammingAVX2(a, b);
+            __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+            return _mm_cvtsi128_si32(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+        }
+    }
+}
+
+#endif
+
+#endif // LDSO_HAMMING_AVX2_H_
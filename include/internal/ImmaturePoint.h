@@ -69,8 +69,8 @@ namespace ldso {
              * @return
              */
             ImmaturePointStatus
-            traceOn(shared_ptr<FrameHessian> frame, const Mat33f &hostToFrame_KRKi, const Vec3f &hostToFrame_Kt,
-                    const Vec2f &hostToFrame_affine, shared_ptr<CalibHessian> HCalib);
+            traceOn(const shared_ptr<FrameHessian> &frame, const Mat33f &hostToFrame_KRKi, const Vec3f &hostToFrame_Kt,
+                    const Vec2f &hostToFrame_affine, const shared_ptr<CalibHessian> &HCalib);
 
             /**
              * compute the energy of the residuals and jacobians
@@ -20,6 +20,7 @@ namespace ldso {
          * Multi thread tasks
          * use reduce function to multi threads a given task
          * like removing outliers or activating points
+         * reduce can be called from several threads, the calls are serialized (stats belongs to the last one)
          * @tparam Running
          */
         template<typename Running>
@@ -56,6 +57,7 @@ namespace ldso {
             inline void
             reduce(function<void(int, int, Running *, int)> callPerIndex, int first, int end, int stepSize = 0) {
 
+                unique_lock<mutex> callLock(callMutex);
                 memset(&stats, 0, sizeof(Running));
 
                 if (stepSize == 0)
@@ -106,6 +108,7 @@ namespace ldso {
             bool isDone[NUM_THREADS];
             bool gotOne[NUM_THREADS];
 
+            mutex callMutex;    // one reduce at a time
             mutex exMutex;
             condition_variable todo_signal;
             condition_variable done_signal;
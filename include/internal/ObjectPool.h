@@ -0,0 +1,178 @@
+#pragma once
+#ifndef LDSO_OBJECT_POOL_H_
+#define LDSO_OBJECT_POOL_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+using namespace std;
+
+namespace ldso {
+
+    namespace internal {
+
+        /**
+         * Handle of an object in an ObjectPool: the slot index plus a generation counter.
+         * The generation is increased when the slot is released, so a handle to a released object resolves
+         * to nullptr instead of pointing to whatever object reuses the slot.
+         */
+        struct PoolHandle {
+            static const uint32_t INVALID = 0xffffffff;
+
+            uint32_t index = INVALID;
+            uint32_t generation = 0;
+
+            inline bool valid() const { return index != INVALID; }
+        };
+
+        /**
+         * Slab allocator with stable integer handles.
+         *
+         * Objects are constructed in place in fixed-size slabs, so objects created one after another lie next to each
+         * other in memory and never move. Released slots are recycled through a free list.
+         * Use makeShared() to keep the shared_ptr interface of the rest of the code: the deleter gives the slot back
+         * to the pool. The control block of each shared_ptr is still a separate heap allocation, and the containers
+         * that own the objects (activeResiduals, PointHessian::residuals, EnergyFunctional::allPoints) still pay the
+         * reference counting. Only loops that do not need ownership avoid it, by storing the PoolHandle and resolving
+         * it with get().
+         *
+         * The pooled type must have a public member "PoolHandle poolHandle", which is set on creation.
+         * create/release are thread safe, get() is lock free. get() does not keep the object alive: a concurrent
+         * release makes later get() calls return nullptr, but a pointer already returned dangles, so the caller
+         * must hold the object alive some other way (for the backend, the window owns it).
+         *
+         * @tparam T type of the pooled objects
+         * @tparam SLAB_SIZE number of objects in one slab
+         */
+        template<typename T, int SLAB_SIZE = 1024>
+        class ObjectPool {
+        public:
+            /**
+             * the pool of type T. It is never destroyed, since shared_ptrs held by static objects may release
+             * their objects after the end of main
+             */
+            static ObjectPool &instance() {
+                static ObjectPool *pool = new ObjectPool;
+                return *pool;
+            }
+
+            /**
+             * construct an object in the pool
+             * @return shared pointer whose deleter returns the slot to this pool
+             */
+            template<typename... Args>
+            shared_ptr<T> makeShared(Args &&... args) {
+                PoolHandle h = allocate();
+                T *obj = new(slotPtr(h.index)) T(std::forward<Args>(args)...);
+                obj->poolHandle = h;
+                return shared_ptr<T>(obj, [this](T *p) { this->release(p); });
+            }
+
+            /**
+             * resolve a handle
+             * @return the object, or nullptr if the handle is invalid or the object has been released
+             */
+            inline T *get(const PoolHandle &h) const {
+                if (!h.valid())
+                    return nullptr;
+                const Slab *s = slab(h.index);
+                const int offset = h.index % SLAB_SIZE;
+                if (s->generation[offset].load(std::memory_order_acquire) != h.generation)
+                    return nullptr;
+                return reinterpret_cast<T *>(s->storage) + offset;
+            }
+
+            // number of living objects
+            inline size_t size() {
+                unique_lock<mutex> lock(poolMutex);
+                return numAlive;
+            }
+
+        private:
+            // Slab pointers are kept in a two level directory: a fixed array of blocks of DIR_BLOCK_SIZE slab pointers.
+            // Blocks are allocated when needed and never move, so get() never races with a growing container. The
+            // fixed array covers the whole 32 bit index space.
+            static const uint32_t DIR_BLOCK_SIZE = 1024;
+            static const uint32_t MAX_SLABS = uint32_t((uint64_t(PoolHandle::INVALID) + 1) / SLAB_SIZE);
+            static const uint32_t MAX_DIR_BLOCKS = (MAX_SLABS + DIR_BLOCK_SIZE - 1) / DIR_BLOCK_SIZE;
+
+            struct Slab {
+                Slab() {
+                    storage = Eigen::internal::aligned_malloc(sizeof(T) * SLAB_SIZE);
+                    for (int i = 0; i < SLAB_SIZE; i++)
+                        generation[i].store(0, std::memory_order_relaxed);
+                }
+
+                ~Slab() {
+                    Eigen::internal::aligned_free(storage);
+                }
+
+                void *storage = nullptr;
+                atomic<uint32_t> generation[SLAB_SIZE];
+            };
+
+            ObjectPool() {
+                for (uint32_t i = 0; i < MAX_DIR_BLOCKS; i++)
+                    directory[i] = nullptr;
+            }
+
+            inline Slab *slab(uint32_t index) const {
+                const uint32_t slabIdx = index / SLAB_SIZE;
+                return directory[slabIdx / DIR_BLOCK_SIZE][slabIdx % DIR_BLOCK_SIZE];
+            }
+
+            inline void *slotPtr(uint32_t index) {
+                return reinterpret_cast<T *>(slab(index)->storage) + index % SLAB_SIZE;
+            }
+
+            PoolHandle allocate() {
+                unique_lock<mutex> lock(poolMutex);
+                if (freeList.empty()) {
+                    // the last slab is one short, since PoolHandle::INVALID is not a valid index
+                    CHECK_LT(numSlabs, MAX_SLABS) << "more than 2^32 objects in one pool";
+                    if (directory[numSlabs / DIR_BLOCK_SIZE] == nullptr)
+                        directory[numSlabs / DIR_BLOCK_SIZE] = new Slab *[DIR_BLOCK_SIZE]();
+                    directory[numSlabs / DIR_BLOCK_SIZE][numSlabs % DIR_BLOCK_SIZE] = new Slab;
+                    // push in reverse order so the slab is filled from the front
+                    for (int i = SLAB_SIZE - 1; i >= 0; i--) {
+                        uint64_t index = uint64_t(numSlabs) * SLAB_SIZE + i;
+                        if (index != PoolHandle::INVALID)
+                            freeList.push_back(uint32_t(index));
+                    }
+                    numSlabs++;
+                }
+                PoolHandle h;
+                h.index = freeList.back();
+                freeList.pop_back();
+                h.generation = slab(h.index)->generation[h.index % SLAB_SIZE].load(std::memory_order_relaxed);
+                numAlive++;
+                return h;
+            }
+
+            void release(T *obj) {
+                const uint32_t index = obj->poolHandle.index;
+                // invalidate the handles before the destructor runs, so a get() during the destruction returns nullptr
+                slab(index)->generation[index % SLAB_SIZE].fetch_add(1, std::memory_order_acq_rel);
+                obj->~T();
+                unique_lock<mutex> lock(poolMutex);
+                freeList.push_back(index);
+                numAlive--;
+            }
+
+            Slab **directory[MAX_DIR_BLOCKS];
+            uint32_t numSlabs = 0;
+            vector<uint32_t> freeList;
+            size_t numAlive = 0;
+            mutex poolMutex;
+        };
+    }
+}
+
+#endif // LDSO_OBJECT_POOL_H_
@@ -22,7 +22,6 @@ namespace ldso {
                 for (int i = 0; i < NUM_THREADS; i++) {
                     accE[i] = 0;
                     accEB[i] = 0;
-                    accD[i] = 0;
                     nframes[i] = 0;
                 }
             };
@@ -31,7 +30,6 @@ namespace ldso {
                 for (int i = 0; i < NUM_THREADS; i++) {
                     if (accE[i] != 0) delete[] accE[i];
                     if (accEB[i] != 0) delete[] accEB[i];
-                    if (accD[i] != 0) delete[] accD[i];
                 }
             };
 
@@ -39,21 +37,31 @@ namespace ldso {
                 if (n != nframes[tid]) {
                     if (accE[tid] != 0) delete[] accE[tid];
                     if (accEB[tid] != 0) delete[] accEB[tid];
-                    if (accD[tid] != 0) delete[] accD[tid];
                     accE[tid] = new AccumulatorXX<8, CPARS>[n * n];
                     accEB[tid] = new AccumulatorX<8>[n * n];
-                    accD[tid] = new AccumulatorXX<8, 8>[n * n * n];
+                    slotD[tid].assign(n * n * n, -1);
+                    keyD[tid].clear();
+                    accD[tid].clear();
+                    pairUsed[tid].assign(n * n, 0);
+                    for (int i = 0; i < n * n; i++) {
+                        accE[tid][i].initialize();
+                        accEB[tid][i].initialize();
+                    }
+                } else {
+                    // only the pairs that got residuals are not zero
+                    for (int i = 0; i < n * n; i++) {
+                        if (!pairUsed[tid][i]) continue;
+                        accE[tid][i].initialize();
+                        accEB[tid][i].initialize();
+                        pairUsed[tid][i] = 0;
+                    }
+                    for (int key : keyD[tid])
+                        slotD[tid][key] = -1;
+                    keyD[tid].clear();
+                    accD[tid].clear();
                 }
                 accbc[tid].initialize();
                 accHcc[tid].initialize();
-
-                for (int i = 0; i < n * n; i++) {
-                    accE[tid][i].initialize();
-                    accEB[tid][i].initialize();
-
-                    for (int j = 0; j < n; j++)
-                        accD[tid][i * n + j].initialize();
-                }
                 nframes[tid] = n;
             }
 
@@ -90,7 +98,11 @@ namespace ldso {
                     stitchDoubleInternal(&H, &b, EF, 0, nframes[0] * nframes[0], 0, -1);
                 }
 
-                // make diagonal by copying over parts.
+                copyTransposedParts(H);
+            }
+
+            // make diagonal by copying over parts.
+            void copyTransposedParts(MatXX &H) const {
                 for (int h = 0; h < nframes[0]; h++) {
                     int hIdx = CPARS + h * 8;
                     H.block<CPARS, 8>(0, hIdx).noalias() = H.block<8, CPARS>(hIdx, 0).transpose();
@@ -99,7 +111,15 @@ namespace ldso {
 
             AccumulatorXX<8, CPARS> *accE[NUM_THREADS];
             AccumulatorX<8> *accEB[NUM_THREADS];
-            AccumulatorXX<8, 8> *accD[NUM_THREADS];
+
+            // The D block (i + n * j) * n + k couples the targets j and k of the residuals of a point hosted in i.
+            // Block sparse: only the blocks that got residuals since setZero are kept, packed in accD in the order of
+            // their first use. slotD maps a block to its index in accD (-1 if unused), keyD maps back for the reset.
+            // A point only touches the blocks it updates, and the stitching only finishes those.
+            vector<AccumulatorXX<8, 8>, Eigen::aligned_allocator<AccumulatorXX<8, 8>>> accD[NUM_THREADS];
+            vector<int> slotD[NUM_THREADS];
+            vector<int> keyD[NUM_THREADS];
+            vector<unsigned char> pairUsed[NUM_THREADS];    // if pair ij got residuals since setZero
             AccumulatorXX<CPARS, CPARS> accHcc[NUM_THREADS];
             AccumulatorX<CPARS> accbc[NUM_THREADS];
             int nframes[NUM_THREADS];
@@ -111,10 +131,39 @@ namespace ldso {
             }
 
         private:
+            friend class EnergyFunctional;
+
+            // the D block with the given key, added to accD if it is not used yet. The reference is only valid until
+            // the next call, accD may grow
+            inline AccumulatorXX<8, 8> &blockD(int key, int tid) {
+                int &slot = slotD[tid][key];
+                if (slot < 0) {
+                    slot = accD[tid].size();
+                    keyD[tid].push_back(key);
+                    accD[tid].emplace_back();
+                    accD[tid].back().initialize();
+                }
+                return accD[tid][slot];
+            }
 
             void stitchDoubleInternal(
                     MatXX *H, VecX *b, EnergyFunctional const *const EF,
-                    int min, int max, Vec10 *stats, int tid);
+                    int min, int max, Vec10 *stats, int tid) {
+                stitchInternal<double>(H, b, EF, min, max, stats, tid);
+            }
+
+            /**
+             * stitch the frame-pair blocks [min, max) into H and b, in double or float (see setting_backendPrecision)
+             */
+            template<typename T>
+            void stitchInternal(
+                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H, Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                    EnergyFunctional const *const EF, int min, int max, Vec10 *stats, int tid);
+
+            // the adjoints of the energy functional in the precision of the stitching
+            static void getAdjoints(EnergyFunctional const *const EF, const Mat88 *&adHost, const Mat88 *&adTarget);
+
+            static void getAdjoints(EnergyFunctional const *const EF, const Mat88f *&adHost, const Mat88f *&adTarget);
         };
 
     }
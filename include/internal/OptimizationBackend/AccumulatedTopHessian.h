@@ -6,6 +6,7 @@
 #include "Settings.h"
 
 #include "internal/PointHessian.h"
+#include "internal/ResidualBlock.h"
 #include "internal/IndexThreadReduce.h"
 #include "internal/OptimizationBackend/MatrixAccumulators.h"
 
@@ -24,31 +25,32 @@ namespace ldso {
             inline AccumulatedTopHessianSSE() {
                 for (int tid = 0; tid < NUM_THREADS; tid++) {
                     nres[tid] = 0;
-                    acc[tid] = 0;
                     nframes[tid] = 0;
                 }
 
             };
 
             inline ~AccumulatedTopHessianSSE() {
-                for (int tid = 0; tid < NUM_THREADS; tid++) {
-                    if (acc[tid] != 0) delete[] acc[tid];
-                }
+                for (int tid = 0; tid < NUM_THREADS; tid++)
+                    freeBlocks(tid);
             };
 
             inline void setZero(int nFrames, int min = 0, int max = 1, Vec10 *stats = 0, int tid = 0) {
 
                 if (nFrames != nframes[tid]) {
-                    if (acc[tid] != 0) delete[] acc[tid];
-#if USE_XI_MODEL
-                    acc[tid] = new Accumulator14[nFrames*nFrames];
-#else
-                    acc[tid] = new AccumulatorApprox[nFrames * nFrames];
-#endif
+                    freeBlocks(tid);
+                    acc[tid].assign(nFrames * nFrames, nullptr);
+                    pairUsed[tid].assign(nFrames * nFrames, 0);
+                } else {
+                    // only the pairs that got residuals are not zero
+                    for (int i = 0; i < nFrames * nFrames; i++) {
+                        if (pairUsed[tid][i]) {
+                            acc[tid][i]->initialize();
+                            pairUsed[tid][i] = 0;
+                        }
+                    }
                 }
 
-                for (int i = 0; i < nFrames * nFrames; i++) { acc[tid][i].initialize(); }
-
                 nframes[tid] = nFrames;
                 nres[tid] = 0;
 
@@ -57,9 +59,28 @@ namespace ldso {
             void stitchDouble(MatXX &H, VecX &b, EnergyFunctional const *const EF, bool usePrior, bool useDelta,
                               int tid = 0);
 
+            /**
+             * accumulate the residuals of one point, only used to marginalize points (mode 2), the window goes
+             * through addBlock
+             */
             template<int mode>
             void addPoint(shared_ptr<PointHessian> p, EnergyFunctional const *const ef, int tid = 0);
 
+            /**
+             * accumulate the active (mode 0) or linearized (mode 1) residuals of a residual block into the
+             * accumulator of its host-target pair, streaming through the slots. The idepth parts of each slot are
+             * left in the block, addPointSums collects them into the points
+             */
+            template<int mode>
+            void addBlock(ResidualBlock *blk, EnergyFunctional const *const ef, int tid = 0);
+
+            /**
+             * sum the idepth parts addBlock left in the slots of the residuals of p into Hdd_acc, bd_acc and
+             * Hcd_acc of p. The order is the one of p->residuals, independent of the threads
+             */
+            template<int mode>
+            static void addPointSums(PointHessian *p);
+
 
             void stitchDoubleMT(IndexThreadReduce<Vec10>* red, MatXX &H, VecX &b, EnergyFunctional const *const EF,
                                 bool usePrior, bool MT) {
@@ -83,7 +104,6 @@ namespace ldso {
                     for (int i = 1; i < NUM_THREADS; i++) {
                         H.noalias() += Hs[i];
                         b.noalias() += bs[i];
-                        nres[0] += nres[i];
                     }
                 } else {
                     H = MatXX::Zero(nframes[0] * 8 + CPARS, nframes[0] * 8 + CPARS);
@@ -91,7 +111,23 @@ namespace ldso {
                     stitchDoubleInternal(&H, &b, EF, usePrior, 0, nframes[0] * nframes[0], 0, -1);
                 }
 
-                // make diagonal by copying over parts.
+                copyTransposedParts(H);
+            }
+
+            /**
+             * number of residuals accumulated since setZero. With MT all the threads took part, otherwise only
+             * thread 0 was set to zero
+             */
+            inline int numResiduals(bool MT) const {
+                int n = nres[0];
+                if (MT)
+                    for (int tid = 1; tid < NUM_THREADS; tid++)
+                        n += nres[tid];
+                return n;
+            }
+
+            // make diagonal by copying over parts.
+            void copyTransposedParts(MatXX &H) const {
                 for (int h = 0; h < nframes[0]; h++) {
                     int hIdx = CPARS + h * 8;
                     H.block<CPARS, 8>(0, hIdx).noalias() = H.block<8, CPARS>(hIdx, 0).transpose();
@@ -105,23 +141,79 @@ namespace ldso {
             }
 
             int nframes[NUM_THREADS];
-            EIGEN_ALIGN16 AccumulatorApprox *acc[NUM_THREADS];
             int nres[NUM_THREADS];
 
+            // acc[tid][h + n * t] is the top hessian of the residuals from host h to target t. Sparse: the
+            // accumulator of a pair is allocated when the pair first gets a residual, pairs that share no residuals
+            // cost one null pointer
+            vector<AccumulatorApprox *> acc[NUM_THREADS];
+
+            // if a host-target pair got residuals since setZero, only these are set to zero and stitched
+            vector<unsigned char> pairUsed[NUM_THREADS];
+
             template<int mode>
-            inline void addPointsInternal(
-                    std::vector<shared_ptr<PointHessian>> *points, EnergyFunctional const *const ef,
+            inline void addBlocksInternal(
+                    std::vector<shared_ptr<ResidualBlock>> *blocks, EnergyFunctional const *const ef,
                     int min = 0, int max = 1, Vec10 *stats = 0, int tid = 0) {
                 for (int i = min; i < max; i++)
-                    addPoint<mode>((*points)[i], ef, tid);
+                    if ((*blocks)[i])
+                        addBlock<mode>((*blocks)[i].get(), ef, tid);
+            }
+
+            template<int mode>
+            static inline void addPointSumsInternal(
+                    std::vector<shared_ptr<PointHessian>> *points, int min = 0, int max = 1, Vec10 *stats = 0,
+                    int tid = 0) {
+                for (int i = min; i < max; i++)
+                    addPointSums<mode>((*points)[i].get());
             }
 
 
         private:
+            friend class EnergyFunctional;
+
+            // the accumulator of a host-target pair, allocate it if needed and mark the pair as used
+            inline AccumulatorApprox *blockTop(int ij, int tid) {
+                if (acc[tid][ij] == nullptr) {
+                    acc[tid][ij] = new AccumulatorApprox;
+                    acc[tid][ij]->initialize();
+                }
+                pairUsed[tid][ij] = 1;
+                return acc[tid][ij];
+            }
+
+            inline void freeBlocks(int tid) {
+                for (auto &a : acc[tid])
+                    delete a;
+                acc[tid].clear();
+            }
+
+            /**
+             * accumulate slot i of a block into a, return the idepth parts of the slot
+             * @param dp adHTdeltaF of the host-target pair, dd deltaF of the point, only used in mode 1
+             */
+            template<int mode>
+            void addSlot(const ResidualBlock &blk, int i, AccumulatorApprox &a, const Mat18f &dp, const VecCf &dc,
+                         float dd, int tid, float &bd, float &Hdd, VecCf &Hcd);
 
             void stitchDoubleInternal(
                     MatXX *H, VecX *b, EnergyFunctional const *const EF, bool usePrior,
-                    int min, int max, Vec10 *stats, int tid);
+                    int min, int max, Vec10 *stats, int tid) {
+                stitchInternal<double>(H, b, EF, usePrior, min, max, stats, tid);
+            }
+
+            /**
+             * stitch the frame-pair blocks [min, max) into H and b, in double or float (see setting_backendPrecision)
+             */
+            template<typename T>
+            void stitchInternal(
+                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H, Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                    EnergyFunctional const *const EF, bool usePrior, int min, int max, Vec10 *stats, int tid);
+
+            // the adjoints of the energy functional in the precision of the stitching
+            static void getAdjoints(EnergyFunctional const *const EF, const Mat88 *&adHost, const Mat88 *&adTarget);
+
+            static void getAdjoints(EnergyFunctional const *const EF, const Mat88f *&adHost, const Mat88f *&adTarget);
         };
     }
 }
@@ -6,9 +6,13 @@
 #include "internal/FrameHessian.h"
 #include "internal/PointHessian.h"
 #include "internal/CalibHessian.h"
+#include "internal/ResidualBlock.h"
 #include "internal/OptimizationBackend/AccumulatedTopHessian.h"
 #include "internal/OptimizationBackend/AccumulatedSCHessian.h"
 
+#include <map>
+#include <functional>
+
 namespace ldso {
     namespace internal {
 
@@ -169,16 +173,54 @@ namespace ldso {
             IndexThreadReduce<Vec10> *red = nullptr;  // passed by full system
 
             /**
-             * connectivity map, the higher 32 bit of the key is host frame's id, and the lower is target frame's id
+             * connectivity between two frames by their global frame ids: [0] the number of active residuals and [1]
+             * the number of marginalized residuals from host to target. Also works for frames that left the window
+             */
+            Eigen::Vector2i getConnectivity(int hostFrameID, int targetFrameID) const;
+
+            /**
+             * visit the connectivity of all the frame pairs seen so far, with (hostFrameID, targetFrameID, connectivity)
+             */
+            void forEachConnectivity(const std::function<void(int, int, const Eigen::Vector2i &)> &f) const;
+
+            /**
+             * residual blocks of the window, indexed like the connectivity by host->idx + target->idx * nFrames.
+             * A block is created with the first residual of a pair and kept while both frames are in the window,
+             * pairs without residuals so far are null
              */
+            vector<shared_ptr<ResidualBlock>> residualBlocks;
+
+        private:
+            /// I really don't know what are they doing in the private functions
+
+            /**
+             * connectivity entry of a frame pair, in the dense window matrix if both frames are in the window,
+             * otherwise in the history
+             */
+            Eigen::Vector2i &connectivityAt(const FrameHessian *host, const FrameHessian *target);
+
+            /**
+             * move the dense connectivity and the residual blocks to the current frame indices, called in makeIDX
+             */
+            void remapConnectivity();
+
+            // dense connectivity of the window, indexed by host->idx + target->idx * frames.size()
+            vector<Eigen::Vector2i, Eigen::aligned_allocator<Eigen::Vector2i>> connectivity;
+            vector<int> connectivityFrameIDs;   // frame id of each row/column of the connectivity
+
+            // connectivity of the frame pairs that left the window, the higher 32 bit of the key is host frame's id,
+            // and the lower is target frame's id
             std::map<uint64_t,
                     Eigen::Vector2i,
                     std::less<uint64_t>,
                     Eigen::aligned_allocator<std::pair<const uint64_t, Eigen::Vector2i>>
-            > connectivityMap;
+            > connectivityHistory;
 
-        private:
-            /// I really don't know what are they doing in the private functions
+            /**
+             * take a residual out of its residual block. Empty blocks stay, they are deleted in remapConnectivity
+             * when one of their frames leaves the window
+             */
+            void removeFromBlock(PointFrameResidual *r);
 
             VecX getStitchedDeltaF() const {
                 VecX d = VecX(CPARS + nFrames * 8);
@@ -199,12 +241,57 @@ namespace ldso {
             void resubstituteFPt(const VecCf &xc, Mat18f *xAd, int min, int max, Vec10 *stats,
                                  int tid);
 
+            /**
+             * build the damped system from the accumulated parts and solve it
+             * @param HS, bS set to the undamped system, after the schur complement
+             * @return the solution x, the step is -x
+             */
+            VecX solveSystem(const MatXX &HA_top, const VecX &bA_top, const MatXX &HL_top, const VecX &bL_top,
+                             const MatXX &H_sc, const VecX &b_sc, const VecX &bM_top, double lambda,
+                             MatXX &HS, VecX &bS);
+
             void accumulateAF_MT(MatXX &H, VecX &b, bool MT);
 
             void accumulateLF_MT(MatXX &H, VecX &b, bool MT);
 
             void accumulateSCF_MT(MatXX &H, VecX &b, bool MT);
 
+            /**
+             * accumulate the active and linearized top hessian (H, b) in one pass over the residual blocks, and the
+             * schur complement (H_sc, b_sc) in one pass over the points. Gives the same system as the three
+             * functions above, with the linearized part already added to the active one
+             */
+            void accumulateFusedF_MT(MatXX &H, VecX &b, MatXX &H_sc, VecX &b_sc, bool MT);
+
+            // set the top (accSSE_top_A) and bottom accumulators of a thread to zero
+            void setZeroAll_Reductor(int min, int max, Vec10 *stats, int tid);
+
+            // reducers of accumulateFusedF_MT
+
+            void addBlocksFused_Reductor(int min, int max, Vec10 *stats, int tid);
+
+            void addPointsFused_Reductor(int min, int max, Vec10 *stats, int tid);
+
+            /**
+             * stitch the accumulated blocks into H, b, H_sc and b_sc. The per-thread parts are computed in T
+             * (float or double, see setting_backendPrecision), reduced pairwise and returned in double
+             */
+            template<typename T>
+            void stitchFused(MatXX &H, VecX &b, MatXX &H_sc, VecX &b_sc, bool MT);
+
+            template<typename T>
+            void stitchFused_Reductor(Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H,
+                                      Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                                      Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H_sc,
+                                      Eigen::Matrix<T, Eigen::Dynamic, 1> *b_sc,
+                                      int min, int max, Vec10 *stats, int tid);
+
+            // reducers of marginalizePointsF
+            void collectPointsToMarg_Reductor(vector<vector<shared_ptr<PointHessian>>> *points, int min, int max,
+                                              Vec10 *stats, int tid);
+
+            void margPoints_Reductor(int min, int max, Vec10 *stats, int tid);
+
             void calcLEnergyPt(int min, int max, Vec10 *stats, int tid);
 
             void orthogonalize(VecX *b, MatXX *H);
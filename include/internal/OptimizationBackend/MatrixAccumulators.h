@@ -3,6 +3,7 @@
 #define LDSO_MATRIX_ACCUMULATORS_H_
 
 #include "NumTypes.h"
+#include "internal/CPUFeatures.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
 #include "SSE2NEON.h"
@@ -11,6 +12,36 @@
 namespace ldso {
     namespace internal {
 
+        /**
+         * Kahan compensated sum of fixed size matrices, for sums with many terms in float
+         * @tparam M matrix type
+         */
+        template<typename M>
+        struct KahanSum {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+            M sum = M::Zero();
+            M c = M::Zero();    // running compensation of the lost low order bits
+
+            inline void add(const M &x) {
+                M y = x - c;
+                M t = sum + y;
+                c = (t - sum) - y;
+                sum = t;
+            }
+        };
+
+        /**
+         * pairwise (tree) reduction of n buffers into buf[0], so the rounding error grows with log(n) instead of n
+         * @tparam M matrix or vector type with operator+=
+         */
+        template<typename M>
+        inline void pairwiseReduce(M *buf, int n) {
+            for (int stride = 1; stride < n; stride *= 2)
+                for (int i = 0; i + stride < n; i += 2 * stride)
+                    buf[i] += buf[i + stride];
+        }
+
         /**
          * Matrix accumulators with different sizes
          * SSE accelerated in some partial specializations
@@ -211,6 +242,7 @@ namespace ldso {
                 memset(SSEData, 0, sizeof(float) * 4 * 105);
                 memset(SSEData1k, 0, sizeof(float) * 4 * 105);
                 memset(SSEData1m, 0, sizeof(float) * 4 * 105);
+                memset(AVXData, 0, sizeof(float) * 8 * 105);
                 num = numIn1 = numIn1k = numIn1m = 0;
             }
 
@@ -470,6 +502,33 @@ namespace ldso {
                 shiftUp(false);
             }
 
+#if LDSO_HAS_AVX2
+            /**
+             * 8-wide version of updateSSE with FMA, only call it if useAVX2() is true.
+             * the 8 lanes are accumulated separately and folded into the 4-lane sums in shiftUp.
+             */
+            LDSO_TARGET_AVX2 inline void updateAVX(
+                    const __m256 J0, const __m256 J1,
+                    const __m256 J2, const __m256 J3,
+                    const __m256 J4, const __m256 J5,
+                    const __m256 J6, const __m256 J7,
+                    const __m256 J8, const __m256 J9,
+                    const __m256 J10, const __m256 J11,
+                    const __m256 J12, const __m256 J13) {
+                const __m256 J[14] = {J0, J1, J2, J3, J4, J5, J6, J7, J8, J9, J10, J11, J12, J13};
+                float *pt = AVXData;
+                for (int r = 0; r < 14; r++)
+                    for (int c = r; c < 14; c++) {
+                        _mm256_storeu_ps(pt, _mm256_fmadd_ps(J[r], J[c], _mm256_loadu_ps(pt)));
+                        pt += 8;
+                    }
+
+                num += 8;
+                numIn1++;
+                shiftUp(false);
+            }
+#endif
+
 
             inline void updateSingle(
                     const float J0, const float J1,
@@ -715,6 +774,7 @@ namespace ldso {
             EIGEN_ALIGN16 float SSEData[4 * 105];
             EIGEN_ALIGN16 float SSEData1k[4 * 105];
             EIGEN_ALIGN16 float SSEData1m[4 * 105];
+            EIGEN_ALIGN16 float AVXData[8 * 105];   // lanes of updateAVX, folded into SSEData1k
             float numIn1, numIn1k, numIn1m;
 
 
@@ -722,10 +782,13 @@ namespace ldso {
                 if (numIn1 > 1000 || force) {
                     for (int i = 0; i < 105; i++)
                         _mm_store_ps(SSEData1k + 4 * i,
-                                     _mm_add_ps(_mm_load_ps(SSEData + 4 * i), _mm_load_ps(SSEData1k + 4 * i)));
+                                     _mm_add_ps(_mm_add_ps(_mm_load_ps(SSEData + 4 * i), _mm_load_ps(SSEData1k + 4 * i)),
+                                                _mm_add_ps(_mm_load_ps(AVXData + 8 * i),
+                                                           _mm_load_ps(AVXData + 8 * i + 4))));
                     numIn1k += numIn1;
                     numIn1 = 0;
                     memset(SSEData, 0, sizeof(float) * 4 * 105);
+                    memset(AVXData, 0, sizeof(float) * 8 * 105);
                 }
 
                 if (numIn1k > 1000 || force) {
@@ -1115,6 +1178,7 @@ namespace ldso {
                 memset(SSEData, 0, sizeof(float) * 4 * 45);
                 memset(SSEData1k, 0, sizeof(float) * 4 * 45);
                 memset(SSEData1m, 0, sizeof(float) * 4 * 45);
+                memset(AVXData, 0, sizeof(float) * 8 * 45);
                 num = numIn1 = numIn1k = numIn1m = 0;
             }
 
@@ -1368,6 +1432,32 @@ namespace ldso {
                 shiftUp(false);
             }
 
+#if LDSO_HAS_AVX2
+            /**
+             * 8-wide version of updateSSE_eighted, only call it if useAVX2() is true
+             */
+            LDSO_TARGET_AVX2 inline void updateAVX_eighted(
+                    const __m256 J0, const __m256 J1,
+                    const __m256 J2, const __m256 J3,
+                    const __m256 J4, const __m256 J5,
+                    const __m256 J6, const __m256 J7,
+                    const __m256 J8, const __m256 w) {
+                const __m256 J[9] = {J0, J1, J2, J3, J4, J5, J6, J7, J8};
+                float *pt = AVXData;
+                for (int r = 0; r < 9; r++) {
+                    const __m256 Jrw = _mm256_mul_ps(J[r], w);
+                    for (int c = r; c < 9; c++) {
+                        _mm256_storeu_ps(pt, _mm256_fmadd_ps(Jrw, J[c], _mm256_loadu_ps(pt)));
+                        pt += 8;
+                    }
+                }
+
+                num += 8;
+                numIn1++;
+                shiftUp(false);
+            }
+#endif
+
 
             inline void updateSingle(
                     const float J0, const float J1,
@@ -1618,6 +1708,7 @@ namespace ldso {
             EIGEN_ALIGN16 float SSEData[4 * 45];
             EIGEN_ALIGN16 float SSEData1k[4 * 45];
             EIGEN_ALIGN16 float SSEData1m[4 * 45];
+            EIGEN_ALIGN16 float AVXData[8 * 45];    // lanes of updateAVX_eighted, folded into SSEData1k
             float numIn1, numIn1k, numIn1m;
 
 
@@ -1625,10 +1716,13 @@ namespace ldso {
                 if (numIn1 > 1000 || force) {
                     for (int i = 0; i < 45; i++)
                         _mm_store_ps(SSEData1k + 4 * i,
-                                     _mm_add_ps(_mm_load_ps(SSEData + 4 * i), _mm_load_ps(SSEData1k + 4 * i)));
+                                     _mm_add_ps(_mm_add_ps(_mm_load_ps(SSEData + 4 * i), _mm_load_ps(SSEData1k + 4 * i)),
+                                                _mm_add_ps(_mm_load_ps(AVXData + 8 * i),
+                                                           _mm_load_ps(AVXData + 8 * i + 4))));
                     numIn1k += numIn1;
                     numIn1 = 0;
                     memset(SSEData, 0, sizeof(float) * 4 * 45);
+                    memset(AVXData, 0, sizeof(float) * 8 * 45);
                 }
 
                 if (numIn1k > 1000 || force) {
@@ -119,7 +119,7 @@ namespace ldso {
 
         virtual void computeError() override;
 
-        // virtual void linearizeOplus() override;
+        virtual void linearizeOplus() override;
     };
 
     /**
@@ -142,7 +142,7 @@ namespace ldso {
             _error = (_measurement.inverse() * v1 * v2.inverse()).log();
         };
 
-        // jacobian implemented by numeric jacobian
+        virtual void linearizeOplus() override;
     };
 
     /**
@@ -164,6 +164,8 @@ namespace ldso {
             _error = (_measurement.inverse() * v1 * v2.inverse()).log();
         };
 
+        virtual void linearizeOplus() override;
+
         virtual double initialEstimatePossible (
                 const OptimizableGraph::VertexSet &, OptimizableGraph::Vertex *) override { return 1.; }
 
@@ -202,7 +204,7 @@ namespace ldso {
 
         virtual void computeError() override;
 
-        // virtual void linearizeOplus() override;
+        virtual void linearizeOplus() override;
 
         bool isDepthValid() {
             return dynamic_cast<const VertexPointInvDepth *>( _vertices[0])->estimate() > 0;
@@ -235,6 +237,8 @@ namespace ldso {
 
         virtual void computeError() override;
 
+        virtual void linearizeOplus() override;
+
     public:
         bool depthValid = true;
     private:
@@ -261,6 +265,8 @@ namespace ldso {
 
         virtual void computeError() override;
 
+        virtual void linearizeOplus() override;
+
     public:
         bool depthValid = true;
 
@@ -297,6 +303,8 @@ namespace ldso {
             _error = _measurement - Scw * pw;
         }
 
+        virtual void linearizeOplus() override;
+
     private:
         Vector3d pw;    // world 3d position
 
@@ -25,6 +25,17 @@ namespace ldso {
 
             PointHessian() {}
 
+            /**
+             * create a point hessian in the point pool
+             */
+            static inline shared_ptr<PointHessian> Create(shared_ptr<ImmaturePoint> rawPoint) {
+                return ObjectPool<PointHessian>::instance().makeShared(rawPoint);
+            }
+
+            static inline shared_ptr<PointHessian> Create() {
+                return ObjectPool<PointHessian>::instance().makeShared();
+            }
+
             inline void setIdepth(float idepth) {
                 this->idepth = idepth;
                 this->idepth_scaled = SCALE_IDEPTH * idepth;
@@ -89,8 +100,6 @@ namespace ldso {
             float idepth_zero = 0;
             float idepth = 0;
             float step = 0;
-            float step_backup;
-            float idepth_backup;
             float nullspaces_scale;
             float idepth_hessian = 0;
             float maxRelBaseline = 0;
@@ -129,8 +138,13 @@ namespace ldso {
             VecCf Hcd_accAF = VecCf::Zero();
             float bd_accAF = 0;
             bool alreadyRemoved = false;
+
+            PoolHandle poolHandle;  // handle in the point pool
         };
 
+        inline PointHessian *PointFrameResidual::getPoint() const {
+            return ObjectPool<PointHessian>::instance().get(pointHandle);
+        }
     }
 
 }
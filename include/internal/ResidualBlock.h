@@ -0,0 +1,116 @@
+#pragma once
+#ifndef LDSO_RESIDUAL_BLOCK_H_
+#define LDSO_RESIDUAL_BLOCK_H_
+
+#include "NumTypes.h"
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace ldso {
+
+    namespace internal {
+
+        class PointFrameResidual;
+
+        class FrameHessian;
+
+        struct FrameFramePrecalc;
+
+        /**
+         * All the residuals of one host/target frame pair, owned by the energy functional.
+         *
+         * The per-residual data is kept in parallel arrays indexed by the slot of the residual, one array per
+         * field, so linearizing a block and accumulating it stream through memory with the same frame-frame
+         * precalc and the same host/target accumulator for every slot. Each residual keeps its block and slot.
+         * Removing a residual moves the last one into its slot, so add and remove are both O(1).
+         */
+        class ResidualBlock {
+        public:
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+            template<typename T>
+            using SlotVector = vector<T, Eigen::aligned_allocator<T>>;
+
+            ResidualBlock(FrameHessian *host_, FrameHessian *target_) : host(host_), target(target_) {}
+
+            // residuals still in the block lose their slot
+            ~ResidualBlock();
+
+            /**
+             * add a residual with zero jacobians, inactive and not linearized. Sets its block and slot
+             */
+            void add(const shared_ptr<PointFrameResidual> &r);
+
+            /**
+             * remove a residual by swapping the last one into its slot
+             */
+            void remove(PointFrameResidual *r);
+
+            inline size_t size() const { return residuals.size(); }
+
+            inline bool empty() const { return residuals.empty(); }
+
+            /**
+             * compute JpJdF of a slot from its jacobians
+             */
+            inline void takeData(int i) {
+                Vec2f JI_JI_Jd = JIdx2[i] * Jpdd[i];
+                for (int k = 0; k < 6; k++)
+                    JpJdF[i][k] = Jpdxi[0][i][k] * JI_JI_Jd[0] + Jpdxi[1][i][k] * JI_JI_Jd[1];
+                JpJdF[i].segment<2>(6) = JabJIdx[i] * Jpdd[i];
+            }
+
+            /**
+             * check if the host-target precalc changed more than th since setLinearized() was called.
+             * All parts are compared relatively, |new - old| > th * |old|: the rotation matrix with the Frobenius norm
+             * (th = 1e-4 is about 1.2e-4 rad), the translation with a floor of 1e-3, the affine offset with a floor of 1
+             */
+            bool precalcChanged(float th) const;
+
+            /**
+             * remember the current host-target precalc as the linearization point of the block
+             */
+            void setLinearized();
+
+            FrameHessian *host = nullptr;
+            FrameHessian *target = nullptr;
+
+            // lazy relinearization
+            bool relinearize = true;    // if false, residuals with unchanged idepth can keep their jacobians
+            bool linValid = false;
+            Mat33f linRTll = Mat33f::Zero();
+            Vec3f lintTll = Vec3f::Zero();
+            Vec2f linAffMode = Vec2f::Zero();
+
+            // ==================================================================================== //
+            // per slot data
+            vector<shared_ptr<PointFrameResidual>> residuals;
+
+            SlotVector<VecNRf> resF;        // residual, 8x1
+            SlotVector<Vec6f> Jpdxi[2];     // the two rows of d[x,y]/d[xi], 2x6
+            SlotVector<VecCf> Jpdc[2];      // the two rows of d[x,y]/d[C], 2x4
+            SlotVector<Vec2f> Jpdd;         // the two rows of d[x,y]/d[idepth], 2x1
+            SlotVector<VecNRf> JIdx[2];     // the two columns of d[r]/d[x,y], 8x2
+            SlotVector<VecNRf> JabF[2];     // the two columns of d[r]/d[ab], 8x2
+            SlotVector<Mat22f> JIdx2;       // = JIdx^T * JIdx
+            SlotVector<Mat22f> JabJIdx;     // = Jab^T * JIdx
+            SlotVector<Mat22f> Jab2;        // = Jab^T * Jab
+
+            SlotVector<VecNRf> resToZeroF;  // residual at the fixed linearization point
+            SlotVector<Vec8f> JpJdF;        // = Jp^T * JIdx^T * JIdx * Jd, the frame-idepth part of the schur complement
+
+            vector<unsigned char> active;       // not OOB, not OUTLIER, used in the accumulations
+            vector<unsigned char> linearized;   // linearization is fixed
+
+            // idepth parts of the slot written by AccumulatedTopHessianSSE::addBlock, summed per point afterwards
+            vector<float> bd;
+            vector<float> Hdd;
+            SlotVector<VecCf> Hcd;
+        };
+    }
+}
+
+#endif // LDSO_RESIDUAL_BLOCK_H_
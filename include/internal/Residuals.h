@@ -7,7 +7,8 @@
 using namespace std;
 
 #include "NumTypes.h"
-#include "internal/RawResidualJacobian.h"
+#include "internal/ResidualBlock.h"
+#include "internal/ObjectPool.h"
 
 namespace ldso {
 
@@ -41,18 +42,22 @@ namespace ldso {
         public:
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
-            PointFrameResidual() : J(new RawResidualJacobian) {}
+            PointFrameResidual() {}
 
             PointFrameResidual(shared_ptr<PointHessian> point_, shared_ptr<FrameHessian> host_,
-                               shared_ptr<FrameHessian> target_) : J(new RawResidualJacobian) {
-                point = point_;
-                host = host_;
-                target = target_;
-                resetOOB();
-            }
+                               shared_ptr<FrameHessian> target_);
 
             virtual ~PointFrameResidual() = default;
 
+            /**
+             * create a residual in the residual pool
+             */
+            static inline shared_ptr<PointFrameResidual> Create(shared_ptr<PointHessian> point_,
+                                                                shared_ptr<FrameHessian> host_,
+                                                                shared_ptr<FrameHessian> target_) {
+                return ObjectPool<PointFrameResidual>::instance().makeShared(point_, host_, target_);
+            }
+
             /**
              * linearize the reprojection, create jacobian matrices
              * @param HCalib
@@ -61,6 +66,7 @@ namespace ldso {
             virtual double linearize(shared_ptr<CalibHessian> &HCalib);
 
             virtual void resetOOB() {
+                lazyValid = false;
                 state_NewEnergy = state_energy = 0;
                 state_NewState = ResState::OUTLIER;
                 setState(ResState::IN);
@@ -75,10 +81,10 @@ namespace ldso {
                     }
 
                     if (state_NewState == ResState::IN) {
-                        isActiveAndIsGoodNEW = true;
+                        block->active[blockIdx] = 1;
                         takeData();
                     } else {
-                        isActiveAndIsGoodNEW = false;
+                        block->active[blockIdx] = 0;
                     }
                 }
 
@@ -98,7 +104,30 @@ namespace ldso {
             weak_ptr<PointHessian> point;
             weak_ptr<FrameHessian> host;
             weak_ptr<FrameHessian> target;
-            shared_ptr<RawResidualJacobian> J = nullptr;
+
+            // jacobians and energy data are stored in a slot of the residual block of the host/target pair. Only
+            // set after the residual is inserted into the energy functional
+            ResidualBlock *block = nullptr;
+            int blockIdx = -1;
+
+            // lazy relinearization: energy returned by the last linearize and the point idepth it was computed with
+            bool lazyValid = false;
+            double lazyEnergy = 0;
+            float lazyIdepth = 0;
+
+            // Non-owning access to the point and frames, without the refcount traffic of lock().
+            // Only valid while the residual is in the active window (the window keeps them alive), use it in the
+            // backend loops and lock() everywhere else.
+            inline PointHessian *getPoint() const;  // defined in PointHessian.h
+
+            inline FrameHessian *getHost() const { return hostFH; }
+
+            inline FrameHessian *getTarget() const { return targetFH; }
+
+            PoolHandle poolHandle;      // handle in the residual pool
+            PoolHandle pointHandle;     // handle of the point hessian in the point pool
+            FrameHessian *hostFH = nullptr;
+            FrameHessian *targetFH = nullptr;
 
             bool isNew = true;
             Eigen::Vector2f projectedTo[MAX_RES_PER_POINT]; // 从host到target的投影点
@@ -106,26 +135,19 @@ namespace ldso {
 
             // ==================================================================================== //
             // Energy stuffs
-            inline bool isActive() const { return isActiveAndIsGoodNEW; }
+
+            // if residual is not OOB & not OUTLIER & should be used during accumulations
+            inline bool isActive() const { return block != nullptr && block->active[blockIdx]; }
+
+            // if linearization is fixed
+            inline bool isLinearized() const { return block != nullptr && block->linearized[blockIdx]; }
 
             // fix the jacobians
             void fixLinearizationF(shared_ptr<EnergyFunctional> ef);
 
             int hostIDX = 0, targetIDX = 0;
 
-            VecNRf res_toZeroF;
-            Vec8f JpJdF = Vec8f::Zero();
-            bool isLinearized = false;  // if linearization is fixed.
-
-            // if residual is not OOB & not OUTLIER & should be used during accumulations
-            bool isActiveAndIsGoodNEW = false;
-
-            void takeData() {
-                Vec2f JI_JI_Jd = J->JIdx2 * J->Jpdd;
-                for (int i = 0; i < 6; i++)
-                    JpJdF[i] = J->Jpdxi[0][i] * JI_JI_Jd[0] + J->Jpdxi[1][i] * JI_JI_Jd[1];
-                JpJdF.segment<2>(6) = J->JabJIdx * J->Jpdd;
-            }
+            void takeData() { block->takeData(blockIdx); }
 
         };
     }
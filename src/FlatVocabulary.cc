@@ -0,0 +1,397 @@
+#include "FlatVocabulary.h"
+#include "frontend/FeatureMatcher.h"
+#include "internal/CPUFeatures.h"
+#include "internal/HammingAVX2.h"
+
+#include <fstream>
+#include <cstdio>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ldso::internal;
+
+namespace ldso {
+
+    const char FlatVocabulary::MAGIC[8] = {'L', 'D', 'S', 'O', 'V', 'O', 'C', 'B'};
+
+    // children of a node are compared in one batch
+    static const uint32_t MAX_BRANCHING = 64;
+
+    // first 8 bytes of a binary DBoW3 vocabulary, see DBoW3::Vocabulary::toStream
+    static const uint64_t DBOW3_BINARY_SIG = 88877711233;
+
+    /**
+     * gives access to the node tree of a DBoW3 vocabulary
+     */
+    class DBoW3VocabularyExport : public DBoW3::Vocabulary {
+    public:
+        inline const std::vector<Node> &nodes() const { return m_nodes; }
+    };
+
+    /**
+     * DBoW3 database without the vocabulary tree, only the word count and the scoring are needed to store and
+     * query bow vectors
+     */
+    class KeyFrameDatabase : public DBoW3::Database {
+    public:
+        KeyFrameDatabase(int k, int L, DBoW3::WeightingType weighting, DBoW3::ScoringType scoring,
+                         unsigned int numWords) : DBoW3::Database(true, 0) {
+            m_voc = new DBoW3::Vocabulary(k, L, weighting, scoring);
+            m_ifile.resize(numWords);
+            m_dfile.resize(0);
+            m_nentries = 0;
+        }
+    };
+
+    FlatVocabulary::~FlatVocabulary() {
+        Release();
+    }
+
+    void FlatVocabulary::Release() {
+        if (mapped)
+            munmap(mapped, mappedSize);
+        mapped = nullptr;
+        mappedSize = 0;
+        buffer.clear();
+        header = nullptr;
+        nodes = nullptr;
+        descriptors = nullptr;
+        numNodes = numWords = 0;
+    }
+
+    bool FlatVocabulary::Load(const string &path) {
+        Release();
+
+        if (Map(path)) {
+            LOG(INFO) << "mapped flat vocabulary " << path << ", words: " << numWords << endl;
+            return true;
+        }
+
+        const string flatPath = path + ".flat";
+        if (Map(flatPath)) {
+            LOG(INFO) << "mapped flat vocabulary " << flatPath << ", words: " << numWords << endl;
+            return true;
+        }
+
+        LOG(INFO) << "no flat vocabulary found, loading DBoW3 vocabulary " << path << endl;
+        vector<char> buf;
+        if (!Build(path, buf))
+            return false;
+
+        // save it for the next run
+        if (Save(buf, flatPath))
+            LOG(INFO) << "saved flat vocabulary to " << flatPath << endl;
+        else
+            LOG(WARNING) << "cannot save flat vocabulary to " << flatPath << endl;
+
+        buffer.swap(buf);
+        return Attach(buffer.data(), buffer.size());
+    }
+
+    bool FlatVocabulary::Convert(const string &dbow3Path, const string &flatPath) {
+        vector<char> buf;
+        if (!Build(dbow3Path, buf))
+            return false;
+        if (!Save(buf, flatPath)) {
+            LOG(ERROR) << "cannot write " << flatPath << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool FlatVocabulary::Save(const vector<char> &buf, const string &path) {
+        const string tmpPath = path + ".tmp." + to_string(getpid());
+        ofstream fout(tmpPath, ios::binary);
+        fout.write(buf.data(), buf.size());
+        fout.close();
+        if (fout.fail() || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool FlatVocabulary::Build(const string &dbow3Path, vector<char> &buf) {
+        DBoW3VocabularyExport voc;
+        try {
+            // DBoW3 reads binary files without checking the stream and goes on with garbage if the file is
+            // truncated, read them from a stream that throws instead
+            ifstream fin(dbow3Path, ios::binary);
+            uint64_t sig = 0;
+            if (fin.read((char *) &sig, sizeof(sig)) && sig == DBOW3_BINARY_SIG) {
+                fin.seekg(0);
+                fin.exceptions(ios::failbit | ios::badbit);
+                voc.fromStream(fin);
+            } else {
+                voc.load(dbow3Path);
+            }
+        } catch (std::exception &e) {
+            LOG(ERROR) << "cannot load vocabulary " << dbow3Path << ": " << e.what() << endl;
+            return false;
+        } catch (std::string &e) {
+            // thrown by DBoW3 for files it cannot open as yml
+            LOG(ERROR) << "cannot load vocabulary " << dbow3Path << ": " << e << endl;
+            return false;
+        }
+
+        const auto &src = voc.nodes();
+        if (src.empty()) {
+            LOG(ERROR) << "vocabulary " << dbow3Path << " is empty" << endl;
+            return false;
+        }
+
+        // breadth first order, the children of a node are pushed together
+        vector<uint32_t> order;
+        vector<uint32_t> firstChild;
+        order.reserve(src.size());
+        firstChild.reserve(src.size());
+        order.push_back(0);
+        for (size_t i = 0; i < order.size(); i++) {
+            const auto &node = src[order[i]];
+            if (node.children.size() > MAX_BRANCHING) {
+                LOG(ERROR) << "branching factor " << node.children.size() << " is not supported" << endl;
+                return false;
+            }
+            firstChild.push_back(order.size());
+            for (auto c: node.children)
+                order.push_back(c);
+        }
+
+        const uint32_t numNodes = order.size();
+        uint32_t numWords = 0;
+        for (auto &node: src)
+            if (node.id != 0 && node.children.empty())
+                numWords++;
+
+        Header header;
+        memset(&header, 0, sizeof(Header));
+        memcpy(header.magic, MAGIC, 8);
+        header.version = VERSION;
+        header.k = voc.getBranchingFactor();
+        header.L = voc.getDepthLevels();
+        header.weighting = voc.getWeightingType();
+        header.scoring = voc.getScoringType();
+        header.numNodes = numNodes;
+        header.numWords = numWords;
+        header.nodesOffset = 64;
+        header.descOffset = (header.nodesOffset + sizeof(Node) * numNodes + 63) / 64 * 64;
+
+        buf.assign(header.descOffset + 32 * size_t(numNodes), 0);
+        memcpy(buf.data(), &header, sizeof(Header));
+        Node *nodes = reinterpret_cast<Node *>(buf.data() + header.nodesOffset);
+        unsigned char *descs = reinterpret_cast<unsigned char *>(buf.data() + header.descOffset);
+
+        for (uint32_t i = 0; i < numNodes; i++) {
+            const auto &node = src[order[i]];
+            nodes[i].firstChild = firstChild[i];
+            nodes[i].numChildren = node.children.size();
+            nodes[i].id = node.id;
+            nodes[i].wordId = node.word_id;
+            nodes[i].weight = node.weight;
+
+            if (i == 0)
+                continue;   // root has no descriptor
+            const cv::Mat &d = node.descriptor;
+            if (d.type() != CV_8U || d.total() * d.elemSize() != 32) {
+                LOG(ERROR) << "vocabulary " << dbow3Path << " does not contain 32 byte binary descriptors" << endl;
+                return false;
+            }
+            memcpy(descs + 32 * size_t(i), d.ptr<unsigned char>(0), 32);
+        }
+        return true;
+    }
+
+    bool FlatVocabulary::Map(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        char magic[8];
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header) ||
+            read(fd, magic, 8) != 8 || memcmp(magic, MAGIC, 8) != 0) {
+            close(fd);
+            return false;
+        }
+
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            LOG(WARNING) << "cannot map " << path << endl;
+            return false;
+        }
+
+        if (!Attach(static_cast<const char *>(data), st.st_size)) {
+            LOG(WARNING) << "invalid flat vocabulary " << path << endl;
+            munmap(data, st.st_size);
+            return false;
+        }
+        mapped = data;
+        mappedSize = st.st_size;
+        return true;
+    }
+
+    bool FlatVocabulary::Attach(const char *data, size_t size) {
+        const Header *h = reinterpret_cast<const Header *>(data);
+        if (size < sizeof(Header) || memcmp(h->magic, MAGIC, 8) != 0 || h->version != VERSION || h->numNodes == 0)
+            return false;
+        if (h->nodesOffset + sizeof(Node) * size_t(h->numNodes) > size ||
+            h->descOffset + 32 * size_t(h->numNodes) > size)
+            return false;
+
+        const Node *n = reinterpret_cast<const Node *>(data + h->nodesOffset);
+        for (uint32_t i = 0; i < h->numNodes; i++)
+            if (n[i].numChildren > MAX_BRANCHING || size_t(n[i].firstChild) + n[i].numChildren > h->numNodes)
+                return false;
+
+        header = h;
+        nodes = n;
+        descriptors = reinterpret_cast<const unsigned char *>(data + h->descOffset);
+        numNodes = h->numNodes;
+        numWords = h->numWords;
+        return true;
+    }
+
+#if LDSO_HAS_AVX2
+
+    /**
+     * index of the closest of n children, the first one on ties like DBoW3.
+     * Four children are compared per iteration and their popcounts are reduced together, so one horizontal sum
+     * serves four distances.
+     */
+    LDSO_TARGET_AVX2
+    static uint32_t ClosestChildAVX2(const unsigned char *desc, const unsigned char *children, uint32_t n) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *) desc);
+
+        int dist[4];
+        int bestDist = INT_MAX;
+        uint32_t best = 0;
+        uint32_t c = 0;
+        for (; c + 4 <= n; c += 4) {
+            // partial sums are < 256, so two children share a 64 bit lane
+            __m256i s01 = _mm256_or_si256(PartialHammingAVX2(a, children + 32 * c),
+                                          _mm256_slli_epi64(PartialHammingAVX2(a, children + 32 * (c + 1)), 32));
+            __m256i s23 = _mm256_or_si256(PartialHammingAVX2(a, children + 32 * (c + 2)),
+                                          _mm256_slli_epi64(PartialHammingAVX2(a, children + 32 * (c + 3)), 32));
+            __m256i s = _mm256_add_epi32(_mm256_unpacklo_epi64(s01, s23), _mm256_unpackhi_epi64(s01, s23));
+            __m128i d = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+            _mm_storeu_si128((__m128i *) dist, d);
+            for (int k = 0; k < 4; k++)
+                if (dist[k] < bestDist) {
+                    bestDist = dist[k];
+                    best = c + k;
+                }
+        }
+        for (; c < n; c++) {
+            int d = FeatureMatcher::DescriptorDistance(desc, children + 32 * c);
+            if (d < bestDist) {
+                bestDist = d;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+#endif
+
+    void FlatVocabulary::TransformOne(const unsigned char *desc, uint32_t &wordId, double &weight, uint32_t &nid,
+                                      int nidLevel) const {
+        int dist[MAX_BRANCHING];
+#if LDSO_HAS_AVX2
+        const bool avx2 = useAVX2();
+#endif
+        uint32_t current = 0;   // root
+        int level = 0;
+        nid = nodes[0].id;
+
+        while (nodes[current].numChildren > 0) {
+            level++;
+            const Node &node = nodes[current];
+            const unsigned char *children = descriptors + 32 * size_t(node.firstChild);
+            uint32_t best = 0;
+#if LDSO_HAS_AVX2
+            if (avx2) {
+                best = ClosestChildAVX2(desc, children, node.numChildren);
+            } else
+#endif
+            {
+                FeatureMatcher::DescriptorDistances(desc, children, node.numChildren, dist);
+                for (uint32_t c = 1; c < node.numChildren; c++)
+                    if (dist[c] < dist[best])
+                        best = c;
+            }
+            current = node.firstChild + best;
+
+            if (level == nidLevel)
+                nid = nodes[current].id;
+        }
+        // the branch ended above the node id level, DBoW3 leaves the node id unset here
+        if (level < nidLevel)
+            nid = nodes[current].id;
+
+        wordId = nodes[current].wordId;
+        weight = nodes[current].weight;
+    }
+
+    void FlatVocabulary::Transform_Reductor(const unsigned char *descs, int nidLevel, uint32_t *wordIds,
+                                            double *weights, uint32_t *nids, int min, int max, Vec10 *stats,
+                                            int tid) const {
+        for (int i = min; i < max; i++)
+            TransformOne(descs + 32 * size_t(i), wordIds[i], weights[i], nids[i], nidLevel);
+    }
+
+    void FlatVocabulary::Transform(const unsigned char *descs, int n, DBoW3::BowVector &bowVec,
+                                   DBoW3::FeatureVector &featVec, int levelsup,
+                                   IndexThreadReduce<Vec10> *threadReduce) const {
+        bowVec.clear();
+        featVec.clear();
+        if (empty() || n <= 0)
+            return;
+
+        // normalization of the scoring, see DBoW3::GeneralScoring::mustNormalize
+        const DBoW3::ScoringType scoring = DBoW3::ScoringType(header->scoring);
+        const DBoW3::WeightingType weighting = DBoW3::WeightingType(header->weighting);
+        const bool mustNormalize = scoring != DBoW3::DOT_PRODUCT;
+        const DBoW3::LNorm norm = scoring == DBoW3::L2_NORM ? DBoW3::L2 : DBoW3::L1;
+        const int nidLevel = header->L - levelsup;
+
+        // the tree descents are independent, only the accumulation below is sequential
+        vector<uint32_t> wordIds(n), nids(n);
+        vector<double> weights(n);
+        if (threadReduce && multiThreading)
+            threadReduce->reduce(bind(&FlatVocabulary::Transform_Reductor, this, descs, nidLevel, wordIds.data(),
+                                      weights.data(), nids.data(), _1, _2, _3, _4), 0, n, 50);
+        else
+            Transform_Reductor(descs, nidLevel, wordIds.data(), weights.data(), nids.data(), 0, n, 0, 0);
+
+        for (int i = 0; i < n; i++) {
+            if (weights[i] <= 0)
+                continue;   // stopped word
+            if (weighting == DBoW3::TF || weighting == DBoW3::TF_IDF)
+                bowVec.addWeight(wordIds[i], weights[i]);
+            else
+                bowVec.addIfNotExist(wordIds[i], weights[i]);
+            featVec.addFeature(nids[i], i);
+        }
+
+        if ((weighting == DBoW3::TF || weighting == DBoW3::TF_IDF) && !bowVec.empty() && !mustNormalize) {
+            // unnecessary when normalizing
+            const double nd = bowVec.size();
+            for (auto &w: bowVec)
+                w.second /= nd;
+        }
+
+        if (mustNormalize)
+            bowVec.normalize(norm);
+    }
+
+    shared_ptr<DBoW3::Database> FlatVocabulary::CreateDatabase() const {
+        return shared_ptr<DBoW3::Database>(new KeyFrameDatabase(
+                header ? header->k : 10, header ? header->L : 6,
+                header ? DBoW3::WeightingType(header->weighting) : DBoW3::TF_IDF,
+                header ? DBoW3::ScoringType(header->scoring) : DBoW3::L1_NORM, numWords));
+    }
+}
@@ -1,6 +1,7 @@
 #include "Frame.h"
 #include "Feature.h"
 #include "Point.h"
+#include "FlatVocabulary.h"
 
 #include "internal/FrameHessian.h"
 #include "internal/GlobalCalib.h"
@@ -85,20 +86,18 @@ namespace ldso {
         return indices;
     }
 
-    void Frame::ComputeBoW(shared_ptr<ORBVocabulary> voc) {
+    void Frame::ComputeBoW(shared_ptr<ORBVocabulary> voc, IndexThreadReduce<Vec10> *threadReduce) {
         // convert corners into BoW
-        vector<cv::Mat> allDesp;
+        vector<unsigned char> allDesp;
+        allDesp.reserve(32 * features.size());
         for (size_t i = 0; i < features.size(); i++) {
             auto &feat = features[i];
             if (feat->isCorner) {
-                cv::Mat m(1, 32, CV_8U);
-                for (int k = 0; k < 32; k++)
-                    m.data[k] = feat->descriptor[k];
-                allDesp.push_back(m);
+                allDesp.insert(allDesp.end(), feat->descriptor, feat->descriptor + 32);
                 bowIdx.push_back(i);
             }
         }
-        voc->transform(allDesp, bowVec, featVec, 4);
+        voc->Transform(allDesp.data(), allDesp.size() / 32, bowVec, featVec, 4, threadReduce);
     }
 
     set<shared_ptr<Frame>> Frame::GetConnectedKeyFrames() {
@@ -118,6 +117,31 @@ namespace ldso {
         return pts;
     }
 
+    void Frame::ComputeWorldPoints() {
+        // the point of a feature is hosted by that feature, see Feature::CreateFromImmature
+        vector<Point *> points;
+        Eigen::Matrix<double, 3, Eigen::Dynamic> pos(3, features.size());
+        points.reserve(features.size());
+        for (auto &feat: features) {
+            if (feat->point) {
+                pos.col(points.size()) = 1.0 / feat->invD * Vec3(
+                        fxiG[0] * feat->uv[0] + cxiG[0],
+                        fyiG[0] * feat->uv[1] + cyiG[0],
+                        1);
+                points.push_back(feat->point.get());
+            }
+        }
+        if (points.empty())
+            return;
+
+        Sim3 Twc = getPoseOpti().inverse();
+        Mat33 sR = Twc.scale() * Twc.rotationMatrix();
+        const int n = points.size();
+        pos.leftCols(n) = (sR * pos.leftCols(n)).colwise() + Twc.translation();
+        for (int i = 0; i < n; i++)
+            points[i]->mWorldPos = pos.col(i);
+    }
+
     void Frame::save(ofstream &fout) {
 
         fout.write((char *) &id, sizeof(id));
@@ -167,7 +191,7 @@ namespace ldso {
         fin.read((char *) &nufeatures, sizeof(int));
         features.resize(nufeatures, nullptr);
         for (auto &feat: features) {
-            feat = shared_ptr<Feature>(new Feature(0, 0, thisFrame));
+            feat = Feature::Create(0, 0, thisFrame);
         }
 
         int n = 0;
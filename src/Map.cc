@@ -19,6 +19,21 @@ using namespace ldso::internal;
 
 namespace ldso {
 
+    Map::Map(FullSystem *fs) : fullsystem(fs) {
+        poseGraphThread = thread(&Map::poseGraphLoop, this);
+    }
+
+    Map::~Map() {
+        {
+            unique_lock<mutex> lock(mutexPoseGraph);
+            poseGraphExit = true;
+            poseGraphCancel = true;
+        }
+        poseGraphCond.notify_all();
+        poseGraphThread.join();
+        // the optimizer owns the vertices and edges of the pose graph
+    }
+
     void Map::AddKeyFrame(shared_ptr<Frame> kf) {
         unique_lock<mutex> mapLock(mapMutex);
         if (frames.find(kf) == frames.end()) {
@@ -28,140 +43,290 @@ namespace ldso {
 
     void Map::lastOptimizeAllKFs() {
         LOG(INFO) << "Final pose graph optimization after odometry is finished.";
+        requestPoseGraph(true).wait();
+    }
 
+    future<bool> Map::OptimizeALLKFs() {
+        return requestPoseGraph(false);
+    }
+
+    future<bool> Map::requestPoseGraph(bool full) {
+        promise<bool> request;
+        future<bool> result = request.get_future();
         {
             unique_lock<mutex> lock(mutexPoseGraph);
-            if (poseGraphRunning) {
-                LOG(FATAL) << "Should not be called while pose graph optimization is running";
+            if (poseGraphExit) {
+                request.set_value(false);
+                return result;
+            }
+            poseGraphRequests.push_back(move(request));
+            poseGraphRequestFull = poseGraphRequestFull || full;
+            // the running one doesn't know the newest loop yet
+            if (poseGraphRunning)
+                poseGraphCancel = true;
+        }
+        poseGraphCond.notify_all();
+        return result;
+    }
+
+    void Map::poseGraphLoop() {
+        while (true) {
+            vector<promise<bool>> requests;
+            bool full = false, cancellable = false;
+            {
+                unique_lock<mutex> lock(mutexPoseGraph);
+                poseGraphCond.wait(lock, [this] { return poseGraphExit || !poseGraphRequests.empty(); });
+                if (poseGraphExit)
+                    break;
+
+                // all pending requests are served by this optimization
+                requests.swap(poseGraphRequests);
+                full = poseGraphRequestFull;
+                poseGraphRequestFull = false;
+                cancellable = !full && !poseGraphLastCancelled;
+                poseGraphCancel = false;
+
+                // lock frames to prevent adding new kfs
+                unique_lock<mutex> mapLock(mapMutex);
+                if (frames.empty()) {
+                    for (auto &r: requests)
+                        r.set_value(false);
+                    continue;
+                }
+                framesOpti = frames;
+                currentKF = *frames.rbegin();
+                poseGraphRunning = true;
             }
+
+            bool done = runPoseGraphOptimization(full, cancellable);
+
+            {
+                unique_lock<mutex> lock(mutexPoseGraph);
+                poseGraphRunning = false;
+                poseGraphLastCancelled = !done;
+                if (done) {
+                    for (auto &r: requests)
+                        r.set_value(true);
+                } else {
+                    // served by the next optimization, which starts right away
+                    LOG(INFO) << "pose graph optimization cancelled by a newer request" << endl;
+                    for (auto &r: requests)
+                        poseGraphRequests.push_back(move(r));
+                }
+            }
+            poseGraphCond.notify_all();
+
+            if (done && fullsystem) fullsystem->RefreshGUI();
         }
 
-        // no locking of mapMutex since we assume that odometry has finished
-        framesOpti = frames;
-        currentKF = *frames.rbegin();
-        runPoseGraphOptimization();
+        unique_lock<mutex> lock(mutexPoseGraph);
+        for (auto &r: poseGraphRequests)
+            r.set_value(false);
+        poseGraphRequests.clear();
+        poseGraphCond.notify_all();
     }
 
-    bool Map::OptimizeALLKFs() {
+    void Map::UpdateAllWorldPoints() {
+        vector<shared_ptr<Frame>> kfs;
         {
-            unique_lock<mutex> lock(mutexPoseGraph);
-            if (poseGraphRunning)
-                return false; // is already running ...
-            // if not, starts it
-            poseGraphRunning = true;
-            // lock frames to prevent adding new kfs
+            // AddKeyFrame inserts under mapMutex, don't hold it during the refresh
             unique_lock<mutex> mapLock(mapMutex);
-            framesOpti = frames;
-            currentKF = *frames.rbegin();
+            kfs.assign(frames.begin(), frames.end());
         }
+        refreshWorldPoints(kfs);
+    }
 
-        //  start the pose graph thread
-        thread th = thread(&Map::runPoseGraphOptimization, this);
-        th.detach();    // it will set posegraphrunning to false when returns
-        return true;
+    void Map::refreshWorldPoints(const vector<shared_ptr<Frame>> &kfs) {
+        unique_lock<mutex> lock(mutexPointRefresh);
+        if (multiThreading)
+            backgroundReduce.reduce(bind(&Map::refreshWorldPoints_Reductor, this, &kfs, _1, _2, _3, _4), 0, kfs.size(), 4);
+        else
+            refreshWorldPoints_Reductor(&kfs, 0, kfs.size(), 0, 0);
     }
 
-    void Map::UpdateAllWorldPoints() {
-        unique_lock<mutex> lock(mutexPoseGraph);
-        for (shared_ptr<Frame> frame: frames) {
-            for (auto &feat: frame->features) {
-                if (feat->point) {
-                    feat->point->ComputeWorldPos();
-                }
-            }
-        }
+    void Map::refreshWorldPoints_Reductor(const vector<shared_ptr<Frame>> *kfs, int min, int max, Vec10 *stats,
+                                          int tid) {
+        for (int i = min; i < max; i++)
+            (*kfs)[i]->ComputeWorldPoints();
     }
 
-    void Map::runPoseGraphOptimization() {
-
-        LOG(INFO) << "start pose graph thread!" << endl;
-        // Setup optimizer
-        g2o::SparseOptimizer optimizer;
-        typedef BlockSolver<BlockSolverTraits<7, 3> > BlockSolverType;
-        BlockSolverType::LinearSolverType *linearSolver;
-        linearSolver = new g2o::LinearSolverEigen<BlockSolverType::PoseMatrixType>();
-        BlockSolverType *solver_ptr = new BlockSolverType(linearSolver);
-        // g2o::OptimizationAlgorithmLevenberg *solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-        g2o::OptimizationAlgorithmGaussNewton *solver = new g2o::OptimizationAlgorithmGaussNewton(solver_ptr);
-        // g2o::OptimizationAlgorithmDogleg *solver = new g2o::OptimizationAlgorithmDogleg(solver_ptr);
-        optimizer.setAlgorithm(solver);
-        optimizer.setVerbose(false);
+    int Map::updatePoseGraph() {
 
-        // keyframes
-        int maxKFid = 0;
-        int cntEdgePR = 0;
+        if (!poseGraph) {
+            // Setup optimizer
+            poseGraph.reset(new g2o::SparseOptimizer());
+            typedef BlockSolver<BlockSolverTraits<7, 3> > BlockSolverType;
+            BlockSolverType::LinearSolverType *linearSolver;
+            linearSolver = new g2o::LinearSolverEigen<BlockSolverType::PoseMatrixType>();
+            BlockSolverType *solver_ptr = new BlockSolverType(linearSolver);
+            g2o::OptimizationAlgorithmGaussNewton *solver = new g2o::OptimizationAlgorithmGaussNewton(solver_ptr);
+            poseGraph->setAlgorithm(solver);
+            poseGraph->setVerbose(false);
+        }
 
-        for (const shared_ptr<Frame> &fr: framesOpti) {
+        int minChangedId = -1;
+        auto touch = [&minChangedId](int id) {
+            if (minChangedId < 0 || id < minChangedId)
+                minChangedId = id;
+        };
 
-            // each kf has Sim3 pose
+        // keyframes
+        for (const shared_ptr<Frame> &fr: framesOpti) {
             int idKF = fr->kfId;
-            if (idKF > maxKFid) {
-                maxKFid = idKF;
-            }
-
-            // P+R
-            VertexSim3 *vSim3 = new VertexSim3();
-            Sim3 Scw = fr->getPoseOpti();
-            CHECK(Scw.scale() > 0);
-            vSim3->setEstimate(Scw);
-            vSim3->setId(idKF);
-            optimizer.addVertex(vSim3);
-
-            // fix the last one since we don't want to affect the frames in window
-            if (fr == currentKF) {
-                vSim3->setFixed(true);
+            VertexSim3 *vSim3 = (VertexSim3 *) poseGraph->vertex(idKF);
+            if (vSim3 == nullptr) {
+                vSim3 = new VertexSim3();
+                Sim3 Scw = fr->getPoseOpti();
+                CHECK(Scw.scale() > 0);
+                vSim3->setEstimate(Scw);
+                vSim3->setId(idKF);
+                poseGraph->addVertex(vSim3);
+                touch(idKF);
+            } else if (idKF >= (int) latestOptimizedKfId) {
+                // the odometry has moved it since the last optimization, older ones keep the last solution
+                Sim3 Scw = fr->getPoseOpti();
+                CHECK(Scw.scale() > 0);
+                vSim3->setEstimate(Scw);
             }
+        }
 
+        // fix the last one since we don't want to affect the frames in window
+        if ((int) currentKF->kfId != poseGraphFixedId) {
+            if (poseGraphFixedId >= 0)
+                poseGraph->vertex(poseGraphFixedId)->setFixed(false);
+            poseGraphFixedId = currentKF->kfId;
+            poseGraph->vertex(poseGraphFixedId)->setFixed(true);
         }
 
-        // edges
+        // edges, the ones in the odometry window are updated with every keyframe, loop edges are added
         for (const shared_ptr<Frame> &fr: framesOpti) {
             unique_lock<mutex> lock(fr->mutexPoseRel);
             for (auto &rel: fr->poseRel) {
-                VertexSim3 *vPR1 = (VertexSim3 *) optimizer.vertex(fr->kfId);
-                VertexSim3 *vPR2 = (VertexSim3 *) optimizer.vertex(rel.first->kfId);
-                EdgeSim3 *edgePR = new EdgeSim3();
+                VertexSim3 *vPR1 = (VertexSim3 *) poseGraph->vertex(fr->kfId);
+                VertexSim3 *vPR2 = (VertexSim3 *) poseGraph->vertex(rel.first->kfId);
                 if (vPR1 == nullptr || vPR2 == nullptr)
                     continue;
-                edgePR->setVertex(0, vPR1);
-                edgePR->setVertex(1, vPR2);
-                edgePR->setMeasurement(rel.second.Tcr);
 
-                if (rel.second.isLoop)
-                    edgePR->setInformation(rel.second.info /* *10 */);
-                else
+                auto key = make_pair(vPR1->id(), vPR2->id());
+                auto it = poseGraphEdges.find(key);
+                if (it == poseGraphEdges.end()) {
+                    EdgeSim3 *edgePR = new EdgeSim3();
+                    edgePR->setVertex(0, vPR1);
+                    edgePR->setVertex(1, vPR2);
+                    edgePR->setMeasurement(rel.second.Tcr);
                     edgePR->setInformation(rel.second.info);
+                    poseGraph->addEdge(edgePR);
+                    poseGraphEdges[key] = edgePR;
+                } else if (it->second->measurement().matrix() != rel.second.Tcr.matrix() ||
+                           it->second->information() != rel.second.info) {
+                    it->second->setMeasurement(rel.second.Tcr);
+                    it->second->setInformation(rel.second.info);
+                } else {
+                    continue;
+                }
+                touch(key.first);
+                touch(key.second);
+            }
+        }
+
+        return minChangedId;
+    }
+
+    bool Map::runPoseGraphOptimization(bool full, bool cancellable) {
+
+        LOG(INFO) << "start pose graph optimization!" << endl;
+        int minChangedId = updatePoseGraph();
+        if (poseGraphDirtyId >= 0 && (minChangedId < 0 || poseGraphDirtyId < minChangedId))
+            minChangedId = poseGraphDirtyId;    // left over from a cancelled optimization
+        poseGraphDirtyId = -1;
 
-                optimizer.addEdge(edgePR);
-                cntEdgePR++;
+        // keyframes older than minId are not optimized, the ones connected to the optimized part are held fixed
+        int minId = (full || !setting_poseGraphIncremental) ? 0 : minChangedId;
+        HyperGraph::EdgeSet activeEdges;
+        vector<OptimizableGraph::Vertex *> anchors;
+        if (minId >= 0) {
+            for (auto &e: poseGraphEdges) {
+                if (max(e.first.first, e.first.second) < minId)
+                    continue;
+                activeEdges.insert(e.second);
+                for (int i = 0; i < 2; i++) {
+                    OptimizableGraph::Vertex *v = static_cast<OptimizableGraph::Vertex *>(e.second->vertex(i));
+                    if (v->id() < minId && !v->fixed()) {
+                        v->setFixed(true);
+                        anchors.push_back(v);
+                    }
+                }
             }
         }
 
-        optimizer.initializeOptimization();
-        optimizer.optimize(25);
+        int iterations = 0;
+        bool cancelled = false;
+        if (!activeEdges.empty()) {
+            poseGraph->initializeOptimization(activeEdges);
+            poseGraph->computeActiveErrors();
+            double chi2 = poseGraph->activeChi2();
+            if (cancellable)
+                poseGraph->push();
 
-        // recover the pose and points estimation
-        for (shared_ptr<Frame> frame: framesOpti) {
-            VertexSim3 *vSim3 = (VertexSim3 *) optimizer.vertex(frame->kfId);
-            Sim3 Scw = vSim3->estimate();
-            CHECK(Scw.scale() > 0);
-
-            frame->setPoseOpti(Scw);
-            // reset the map point world position because we've changed the keyframe pose
-            for (auto &feat: frame->features) {
-                if (feat->point) {
-                    feat->point->ComputeWorldPos();
+            // warm started from the last solution, usually converges in a few iterations
+            while (iterations < 25) {
+                if (cancellable && poseGraphCancel) {
+                    cancelled = true;
+                    break;
                 }
+                poseGraph->optimize(1, iterations > 0);   // the structure is built in the first iteration only
+                iterations++;
+                poseGraph->computeActiveErrors();
+                double newChi2 = poseGraph->activeChi2();
+                bool converged = chi2 - newChi2 < setting_poseGraphChi2TH * chi2;
+                chi2 = newChi2;
+                if (converged)
+                    break;
+            }
+
+            if (cancelled) {
+                poseGraph->pop();
+            } else {
+                if (cancellable)
+                    poseGraph->discardTop();
+                LOG(INFO) << "pose graph optimized " << poseGraph->activeVertices().size() << " of "
+                          << poseGraph->vertices().size() << " keyframes in " << iterations << " iterations" << endl;
             }
         }
 
-        poseGraphRunning = false;
+        for (auto v: anchors)
+            v->setFixed(false);
+
+        if (cancelled) {
+            poseGraphDirtyId = minId;
+            return false;
+        }
+
+        // recover the pose and points estimation
+        if (iterations > 0) {
+            vector<shared_ptr<Frame>> moved;
+            for (shared_ptr<Frame> frame: framesOpti) {
+                if ((int) frame->kfId < minId)
+                    continue;
+                VertexSim3 *vSim3 = (VertexSim3 *) poseGraph->vertex(frame->kfId);
+                Sim3 Scw = vSim3->estimate();
+                CHECK(Scw.scale() > 0);
+
+                Sim3 ScwOld = frame->getPoseOpti();
+                frame->setPoseOpti(Scw);
+
+                // reset the map point world position because we've changed the keyframe pose
+                if (setting_pointRefreshPoseTH <= 0 || frame->kfId >= latestOptimizedKfId ||
+                    (Scw * ScwOld.inverse()).log().norm() > setting_pointRefreshPoseTH)
+                    moved.push_back(frame);
+            }
+            refreshWorldPoints(moved);
+        }
 
         if (currentKF) {
             latestOptimizedKfId = currentKF->kfId;
         }
-
-        if (fullsystem) fullsystem->RefreshGUI();
+        return true;
     }
 
 }
@@ -11,10 +11,10 @@ namespace ldso {
     Point::Point(shared_ptr<Feature> hostFeature) {
         mHostFeature = hostFeature;
         if (hostFeature->ip)    // create from immature point
-            mpPH = shared_ptr<PointHessian>(new PointHessian(hostFeature->ip));
+            mpPH = PointHessian::Create(hostFeature->ip);
         else {
             LOG(ERROR) << "map point created without immature point, this should not happen!" << endl;
-            mpPH = shared_ptr<PointHessian>(new PointHessian());
+            mpPH = PointHessian::Create();
         }
         mpPH->point = hostFeature->point;
         id = mNextId++;
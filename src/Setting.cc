@@ -36,6 +36,8 @@ namespace ldso {
     int setting_maxOptIterations = 6;
     int setting_minOptIterations = 1;
     float setting_thOptIterations = 1.2;
+    float setting_optPredictedDecreaseTH = 0;
+    float setting_optTimeBudgetMs = 0;
     float setting_outlierTH = 12 * 12;                        // higher -> less strict
     float setting_outlierSmoothnessTH = 0;                  // higher -> more strict
     float setting_outlierTHSumComponent = 50 * 50;            // higher -> less strong gradient-based reweighting .
@@ -128,6 +130,20 @@ namespace ldso {
     bool setting_enableLoopClosing = true;
     bool setting_fastLoopClosing = true;
     bool setting_showLoopClosing = false;
+    int setting_loopCandidates = 3;
+    bool setting_poseGraphIncremental = true;
+    float setting_poseGraphChi2TH = 1e-4;
+    float setting_pointRefreshPoseTH = 0;
+    bool setting_asyncDescriptors = true;
+
+    bool setting_useAVX2 = true;
+
+    bool setting_lazyRelin = false;
+    float setting_lazyRelinTH = 1e-4;
+    int setting_lazyRelinFullEvery = 3;
+
+    bool setting_fusedAccumulation = true;
+    int setting_backendPrecision = 0;
 
     void handleKey(char k) {
         char kkk = k;
@@ -575,12 +575,13 @@ namespace ldso {
 
         acc.initialize();
 
+        const float relA = (float) (AffLight::fromToVecExposure(lastRef->ab_exposure, newFrame->ab_exposure,
+                                                                lastRef_aff_g2l, aff_g2l)[0]);
+
         __m128 fxl = _mm_set1_ps(fx[lvl]);
         __m128 fyl = _mm_set1_ps(fy[lvl]);
         __m128 b0 = _mm_set1_ps(lastRef_aff_g2l.b);
-        __m128 a = _mm_set1_ps(
-                (float) (AffLight::fromToVecExposure(lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l,
-                                                     aff_g2l)[0]));
+        __m128 a = _mm_set1_ps(relA);
 
         __m128 one = _mm_set1_ps(1);
         __m128 minusOne = _mm_set1_ps(-1);
@@ -588,7 +589,14 @@ namespace ldso {
 
         int n = buf_warped_n;
         assert(n % 4 == 0);
-        for (int i = 0; i < n; i += 4) {
+
+        int start = 0;
+#if LDSO_HAS_AVX2
+        if (useAVX2())
+            start = calcGSAVX(lvl, relA, n);
+#endif
+
+        for (int i = start; i < n; i += 4) {
             __m128 dx = _mm_mul_ps(_mm_load_ps(buf_warped_dx + i), fxl);
             __m128 dy = _mm_mul_ps(_mm_load_ps(buf_warped_dy + i), fyl);
             __m128 u = _mm_load_ps(buf_warped_u + i);
@@ -631,6 +639,44 @@ namespace ldso {
         b_out.segment<1>(7) *= SCALE_B;
     }
 
+#if LDSO_HAS_AVX2
+    LDSO_TARGET_AVX2 int CoarseTracker::calcGSAVX(int lvl, float a, int n) {
+
+        __m256 fxl = _mm256_set1_ps(fx[lvl]);
+        __m256 fyl = _mm256_set1_ps(fy[lvl]);
+        __m256 b0 = _mm256_set1_ps(lastRef_aff_g2l.b);
+        __m256 av = _mm256_set1_ps(a);
+
+        __m256 one = _mm256_set1_ps(1);
+        __m256 minusOne = _mm256_set1_ps(-1);
+        __m256 zero = _mm256_set1_ps(0);
+
+        // warped buffers are only 16-byte aligned, so use unaligned loads
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 dx = _mm256_mul_ps(_mm256_loadu_ps(buf_warped_dx + i), fxl);
+            __m256 dy = _mm256_mul_ps(_mm256_loadu_ps(buf_warped_dy + i), fyl);
+            __m256 u = _mm256_loadu_ps(buf_warped_u + i);
+            __m256 v = _mm256_loadu_ps(buf_warped_v + i);
+            __m256 id = _mm256_loadu_ps(buf_warped_idepth + i);
+            __m256 uv = _mm256_mul_ps(u, v);
+
+            acc.updateAVX_eighted(
+                    _mm256_mul_ps(id, dx),
+                    _mm256_mul_ps(id, dy),
+                    _mm256_sub_ps(zero, _mm256_mul_ps(id, _mm256_fmadd_ps(u, dx, _mm256_mul_ps(v, dy)))),
+                    _mm256_sub_ps(zero, _mm256_fmadd_ps(uv, dx, _mm256_mul_ps(dy, _mm256_fmadd_ps(v, v, one)))),
+                    _mm256_fmadd_ps(uv, dy, _mm256_mul_ps(dx, _mm256_fmadd_ps(u, u, one))),
+                    _mm256_fmsub_ps(u, dy, _mm256_mul_ps(v, dx)),
+                    _mm256_mul_ps(av, _mm256_sub_ps(b0, _mm256_loadu_ps(buf_warped_refColor + i))),
+                    minusOne,
+                    _mm256_loadu_ps(buf_warped_residual + i),
+                    _mm256_loadu_ps(buf_warped_weight + i));
+        }
+        return i;
+    }
+#endif
+
     // ============================================================================== //
     // Coarse distance map
 
@@ -1,12 +1,120 @@
 #include "Feature.h"
 #include "internal/FrameHessian.h"
 #include "frontend/FeatureDetector.h"
+#include "internal/CPUFeatures.h"
 
 #include <opencv2/opencv.hpp>
 
 namespace ldso {
     extern int bit_pattern_31_[256 * 4];   // forward declare
 
+    // smaller eigenvalue of the structure tensor [xx xy; xy yy]
+    static inline float MinEigenvalue(float xx, float yy, float xy) {
+        float disc = (xx + yy) * (xx + yy) - 4 * (xx * yy - xy * xy);
+        return 0.5f * (xx + yy - sqrtf(disc > 0 ? disc : 0));
+    }
+
+#if LDSO_HAS_AVX2
+
+    /**
+     * AVX2 kernel of ShiTomasiCell, scores of one row of the cell from the column sums, 8 pixels at once
+     * @return number of pixels done, a multiple of 8, the rest is left to the scalar code
+     */
+    LDSO_TARGET_AVX2
+    static int ShiTomasiRowAVX2(const float *colXX, const float *colYY, const float *colXY, int size, int box,
+                                float norm, float *scores) {
+        const __m256 normv = _mm256_set1_ps(norm);
+        const __m256 half = _mm256_set1_ps(0.5f), four = _mm256_set1_ps(4.0f);
+        const __m256 zero = _mm256_setzero_ps();
+        int x = 0;
+        for (; x + 8 <= size; x += 8) {
+            __m256 xx = zero, yy = zero, xy = zero;
+            for (int k = 0; k < box; k++) {
+                xx = _mm256_add_ps(xx, _mm256_loadu_ps(colXX + x + k));
+                yy = _mm256_add_ps(yy, _mm256_loadu_ps(colYY + x + k));
+                xy = _mm256_add_ps(xy, _mm256_loadu_ps(colXY + x + k));
+            }
+            xx = _mm256_mul_ps(xx, normv);
+            yy = _mm256_mul_ps(yy, normv);
+            xy = _mm256_mul_ps(xy, normv);
+            __m256 trace = _mm256_add_ps(xx, yy);
+            __m256 det = _mm256_sub_ps(_mm256_mul_ps(xx, yy), _mm256_mul_ps(xy, xy));
+            __m256 disc = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(trace, trace), _mm256_mul_ps(four, det)), zero);
+            _mm256_storeu_ps(scores + x, _mm256_mul_ps(half, _mm256_sub_ps(trace, _mm256_sqrt_ps(disc))));
+        }
+        return x;
+    }
+
+    LDSO_TARGET_AVX2 static inline float HorizontalSumAVX2(__m256 v) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+
+    /**
+     * AVX2 version of FeatureDetector::IC_Angle, 8 pixels of a row of the circular patch at once
+     * The intensities are gathered from the interleaved Vec3f image. The sums are accumulated per lane, so the
+     * angle differs from the scalar one only by rounding.
+     */
+    LDSO_TARGET_AVX2
+    static float IC_AngleAVX2(const Vec3f *center, int step, const int *umax, int halfPatch) {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i three = _mm256_set1_epi32(3);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 m10 = zero, m01 = zero;
+
+        for (int v = 0; v <= halfPatch; v++) {
+            const int d = umax[v];      // umax[0] is halfPatch, the center line
+            const float *plus = (const float *) (center + v * step);
+            const float *minus = (const float *) (center - v * step);
+            const __m256 vf = _mm256_set1_ps(float(v));
+            const __m256i end = _mm256_set1_epi32(d + 1);
+            for (int u0 = -d; u0 <= d; u0 += 8) {
+                __m256i u = _mm256_add_epi32(_mm256_set1_epi32(u0), lanes);
+                __m256 inside = _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, u));
+                __m256i idx = _mm256_mullo_epi32(u, three);
+                __m256 uf = _mm256_cvtepi32_ps(u);
+                __m256 valPlus = _mm256_mask_i32gather_ps(zero, plus, idx, inside, 4);
+                if (v == 0) {
+                    m10 = _mm256_fmadd_ps(uf, valPlus, m10);
+                } else {
+                    __m256 valMinus = _mm256_mask_i32gather_ps(zero, minus, idx, inside, 4);
+                    m10 = _mm256_fmadd_ps(uf, _mm256_add_ps(valPlus, valMinus), m10);
+                    m01 = _mm256_fmadd_ps(vf, _mm256_sub_ps(valPlus, valMinus), m01);
+                }
+            }
+        }
+        return atan2f(HorizontalSumAVX2(m01), HorizontalSumAVX2(m10));
+    }
+
+    /**
+     * AVX2 version of the tests in FeatureDetector::ComputeDescriptor, the 8 tests of a descriptor byte at once
+     * The sample offsets of the rotated pattern are widened to 32 bit, the intensities gathered and truncated to
+     * int like in the scalar code, and the comparison mask is the byte.
+     */
+    LDSO_TARGET_AVX2
+    static void DescriptorAVX2(const Vec3f *center, int step, const signed char *x0, const signed char *y0,
+                               const signed char *x1, const signed char *y1, unsigned char *descriptor) {
+        const float *base = (const float *) center;
+        const __m256i stepv = _mm256_set1_epi32(step);
+        const __m256i three = _mm256_set1_epi32(3);
+        for (int i = 0; i < 32; i++) {
+            const int j = i * 8;
+            __m256i idx0 = _mm256_add_epi32(
+                    _mm256_mullo_epi32(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) (y0 + j))), stepv),
+                    _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) (x0 + j))));
+            __m256i idx1 = _mm256_add_epi32(
+                    _mm256_mullo_epi32(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) (y1 + j))), stepv),
+                    _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) (x1 + j))));
+            __m256i t0 = _mm256_cvttps_epi32(_mm256_i32gather_ps(base, _mm256_mullo_epi32(idx0, three), 4));
+            __m256i t1 = _mm256_cvttps_epi32(_mm256_i32gather_ps(base, _mm256_mullo_epi32(idx1, three), 4));
+            descriptor[i] = (unsigned char) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t1, t0)));
+        }
+    }
+
+#endif
+
     FeatureDetector::FeatureDetector() {
 
         // compute umax
@@ -25,13 +133,31 @@ namespace ldso {
             umax[v] = v0;
             ++v0;
         }
+
+        // rotate the pattern for each orientation bin. The bin angle goes through the same degree factor as the
+        // feature angle in ComputeDescriptor, and the offsets are truncated the same way.
+        const float factorPI = (float) (CV_PI / 180.f);
+        rotatedPatterns.resize(ORIENTATION_BINS);
+        for (int bin = 0; bin < ORIENTATION_BINS; bin++) {
+            int binAngle = bin <= ORIENTATION_BINS / 2 ? bin : bin - ORIENTATION_BINS;     // in [-pi, pi] as atan2
+            float angle = float(binAngle * 2 * M_PI / ORIENTATION_BINS) * factorPI;
+            float a = (float) cosf(angle), b = (float) sinf(angle);
+            RotatedPattern &rp = rotatedPatterns[bin];
+            const int *pattern = bit_pattern_31_;
+            for (int i = 0; i < 256; i++, pattern += 4) {
+                rp.x0[i] = (signed char) int(pattern[0] * a - pattern[1] * b);
+                rp.y0[i] = (signed char) int(pattern[0] * b + pattern[1] * a);
+                rp.x1[i] = (signed char) int(pattern[2] * a - pattern[3] * b);
+                rp.y1[i] = (signed char) int(pattern[2] * b + pattern[3] * a);
+            }
+        }
     }
 
     FeatureDetector::~FeatureDetector() {
 
     }
 
-    int FeatureDetector::DetectCorners(int nFeatures, shared_ptr<Frame> &frame) {
+    int FeatureDetector::DetectCorners(int nFeatures, shared_ptr<Frame> &frame, bool computeDescriptors) {
 
         // grid it
         int gridsize = int(sqrtf(wG[0] * hG[0] / nFeatures) + 0.5);
@@ -54,7 +180,9 @@ namespace ldso {
                     }
                 }
 
-                vector<pair<int, float>> candidate;
+                candidates.clear();
+                cellScores.resize(gridsize * gridsize);
+                ShiTomasiCell(frame, gx * gridsize, gy * gridsize, gridsize, cellScores.data());
 
                 gradTH = (0.5 * maxGrad) > 5 ? 0.5 * maxGrad : 5;
                 int picked = 0;
@@ -64,9 +192,8 @@ namespace ldso {
                         int idx = y * gridsize + x;
                         if (gradData[y * wG[0] + x] > gradTH) {
                             // this is an candidate
-                            int realX = gx * gridsize + x, realY = gy * gridsize + y;
-                            float s = ShiTomasiScore(frame, realX, realY);
-                            candidate.push_back(pair<int, float>(idx, s));
+                            float s = cellScores[idx];
+                            candidates.push_back(pair<int, float>(idx, s));
                             if (s > maxScore) {
                                 maxScore = s;
                             }
@@ -75,14 +202,18 @@ namespace ldso {
                     }
                 }
 
-                sort(candidate.begin(), candidate.end(),
-                     [](const pair<int, float> &p1, const pair<int, float> &p2) { return p1.second > p2.second; });
+                // only the best ones are picked
+                size_t numPicked = min(candidates.size(), size_t(nfeatInGrid) + 1);
+                partial_sort(candidates.begin(), candidates.begin() + numPicked, candidates.end(),
+                             [](const pair<int, float> &p1, const pair<int, float> &p2) {
+                                 return p1.second > p2.second;
+                             });
 
-                for (auto &p: candidate) {
+                for (auto &p: candidates) {
                     int x = p.first % gridsize;
                     int y = p.first / gridsize;
                     int realX = gx * gridsize + x, realY = gy * gridsize + y;
-                    shared_ptr<Feature> feat(new Feature(realX, realY, frame));
+                    shared_ptr<Feature> feat = Feature::Create(realX, realY, frame);
                     feat->score = p.second;
                     frame->features.push_back(feat);
                     picked++;
@@ -104,38 +235,175 @@ namespace ldso {
             }
         }
 
-        for (int i = 0; i < corners.size(); i++) {
-            for (int j = i + 1; j < corners.size(); j++) {
-                auto &feat1 = corners[i], feat2 = corners[j];
-                if ((feat1->uv - feat2->uv).norm() < 5) {
-                    if (feat1->score > feat2->score)
-                        feat2->isCorner = false;
-                    else
-                        feat1->isCorner = false;
+        SuppressNonMaxima(corners);
+
+        if (computeDescriptors)
+            return ComputeDescriptors(frame);
+
+        int cntCornerSelected = 0;
+        for (auto &feat: frame->features)
+            if (feat->isCorner)
+                cntCornerSelected++;
+        return cntCornerSelected;
+    }
+
+    void FeatureDetector::SuppressNonMaxima(const vector<shared_ptr<Feature>> &corners) {
+
+        // the corners are bucketed into cells of NMS_RADIUS, so only the 3x3 neighbouring cells need to be checked
+        const int numCorners = corners.size();
+        const int cellsX = wG[0] / NMS_RADIUS + 1, cellsY = hG[0] / NMS_RADIUS + 1;
+        const int numCells = cellsX * cellsY;
+        nmsCellStart.assign(numCells + 1, 0);
+        nmsCellOf.resize(numCorners);
+        nmsCellItems.resize(numCorners);
+        for (int i = 0; i < numCorners; i++) {
+            int cx = min(max(int(corners[i]->uv[0]) / NMS_RADIUS, 0), cellsX - 1);
+            int cy = min(max(int(corners[i]->uv[1]) / NMS_RADIUS, 0), cellsY - 1);
+            nmsCellOf[i] = cy * cellsX + cx;
+            nmsCellStart[nmsCellOf[i]]++;
+        }
+        for (int c = 1; c <= numCells; c++)
+            nmsCellStart[c] += nmsCellStart[c - 1];
+        for (int i = numCorners - 1; i >= 0; i--)   // counting sort, each cell stays in ascending index order
+            nmsCellItems[--nmsCellStart[nmsCellOf[i]]] = i;
+
+        for (int i = 0; i < numCorners; i++) {
+            auto &feat1 = corners[i];
+            const int cx = nmsCellOf[i] % cellsX, cy = nmsCellOf[i] / cellsX;
+            bool suppressed = false;
+            for (int ny = max(cy - 1, 0); ny <= min(cy + 1, cellsY - 1) && !suppressed; ny++) {
+                for (int nx = max(cx - 1, 0); nx <= min(cx + 1, cellsX - 1) && !suppressed; nx++) {
+                    const int c = ny * cellsX + nx;
+                    for (int k = nmsCellStart[c]; k < nmsCellStart[c + 1]; k++) {
+                        const int j = nmsCellItems[k];
+                        auto &feat2 = corners[j];
+                        if (j == i || (feat1->uv - feat2->uv).norm() >= NMS_RADIUS)
+                            continue;
+                        if (feat2->score > feat1->score || (feat2->score == feat1->score && j > i)) {
+                            suppressed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (suppressed)
+                feat1->isCorner = false;
+        }
+    }
+
+    void FeatureDetector::ShiTomasiCell(shared_ptr<Frame> &frame, int x0, int y0, int size, float *scores,
+                                        int halfbox, int level) {
+
+        const int w = wG[level], h = hG[level];
+        if (x0 - halfbox < 1 || x0 + size - 1 + halfbox >= w - 1 || y0 - halfbox < 1 || y0 + size - 1 + halfbox >= h - 1) {
+            // some boxes touch the image boundary, where the score is 0
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                    scores[y * size + x] = ShiTomasiScore(frame, x0 + x, y0 + y, halfbox, level);
+            return;
+        }
+
+        // the box of pixel (x, y) in the cell covers the products [x, x + box) x [y, y + box)
+        const int box = 2 * halfbox;
+        const int rw = size + box - 1;
+        const int plane = rw * rw;
+        gradProducts.resize(3 * plane);
+        float *pXX = gradProducts.data(), *pYY = pXX + plane, *pXY = pYY + plane;
+        const Vec3f *dIp = frame->frameHessian->dIp[level];
+        for (int y = 0; y < rw; y++) {
+            const Vec3f *row = dIp + (y0 - halfbox + y) * w + x0 - halfbox;
+            for (int x = 0; x < rw; x++) {
+                float dx = row[x][1], dy = row[x][2];
+                pXX[y * rw + x] = dx * dx;
+                pYY[y * rw + x] = dy * dy;
+                pXY[y * rw + x] = dx * dy;
+            }
+        }
+
+        boxColumns.assign(3 * rw, 0);
+        float *cXX = boxColumns.data(), *cYY = cXX + rw, *cXY = cYY + rw;
+        for (int y = 0; y < box; y++) {
+            for (int x = 0; x < rw; x++) {
+                cXX[x] += pXX[y * rw + x];
+                cYY[x] += pYY[y * rw + x];
+                cXY[x] += pXY[y * rw + x];
+            }
+        }
+
+        const float norm = 1.0f / (2 * box * box);
+#if LDSO_HAS_AVX2
+        const bool avx2 = useAVX2();
+#endif
+        for (int y = 0; y < size; y++) {
+            if (y > 0) {
+                // move the box one row down
+                const int in = (y + box - 1) * rw, out = (y - 1) * rw;
+                for (int x = 0; x < rw; x++) {
+                    cXX[x] += pXX[in + x] - pXX[out + x];
+                    cYY[x] += pYY[in + x] - pYY[out + x];
+                    cXY[x] += pXY[in + x] - pXY[out + x];
                 }
+            }
 
+            float *rowScores = scores + y * size;
+            int x = 0;
+#if LDSO_HAS_AVX2
+            if (avx2)
+                x = ShiTomasiRowAVX2(cXX, cYY, cXY, size, box, norm, rowScores);
+#endif
+            for (; x < size; x++) {
+                float xx = 0, yy = 0, xy = 0;
+                for (int k = 0; k < box; k++) {
+                    xx += cXX[x + k];
+                    yy += cYY[x + k];
+                    xy += cXY[x + k];
+                }
+                rowScores[x] = MinEigenvalue(xx * norm, yy * norm, xy * norm);
             }
         }
+    }
 
+    int FeatureDetector::ComputeDescriptors(shared_ptr<Frame> &frame, shared_ptr<FrameHessian> fh) {
+
+        if (fh == nullptr)
+            fh = frame->frameHessian;
+#if LDSO_HAS_AVX2
+        const bool avx2 = useAVX2();
+#endif
         int cntCornerSelected = 0;
         for (auto &feat: frame->features) {
-            if (feat->isCorner) {
-                feat->angle = IC_Angle(
-                        frame->frameHessian->dIp[feat->level], Vec2f(feat->uv[0], feat->uv[1]), feat->level);
-                ComputeDescriptor(frame, feat);
-                cntCornerSelected++;
+            if (!feat->isCorner)
+                continue;
+            cntCornerSelected++;
+            const Vec3f *img = fh->dIp[feat->level];
+#if LDSO_HAS_AVX2
+            if (avx2) {
+                const int step = wG[feat->level];
+                float ul = feat->uv[0], vl = feat->uv[1];
+                feat->angle = IC_AngleAVX2(img + int(vl) * step + int(ul), step, umax.data(), HALF_PATCH_SIZE);
+                for (int level = 0; level < feat->level; level++) {
+                    ul *= 0.5;
+                    vl *= 0.5;
+                }
+                const RotatedPattern &rp = rotatedPatterns[OrientationBin(feat->angle)];
+                DescriptorAVX2(img + int(vl) * step + int(ul), step, rp.x0, rp.y0, rp.x1, rp.y1, feat->descriptor);
+                continue;
             }
+#endif
+            feat->angle = IC_Angle(img, Vec2f(feat->uv[0], feat->uv[1]), feat->level);
+            ComputeDescriptor(img, feat);
         }
         return cntCornerSelected;
     }
 
     int FeatureDetector::ComputeDescriptor(shared_ptr<Frame> &frame, shared_ptr<Feature> feat) {
+        ComputeDescriptor(frame->frameHessian->dIp[feat->level], feat);
+        return 0;
+    }
 
-        const float factorPI = (float) (CV_PI / 180.f);
+    void FeatureDetector::ComputeDescriptor(const Vec3f *img, const shared_ptr<Feature> &feat) {
 
-        float angle = feat->angle * factorPI;
-        float a = (float) cosf(angle), b = (float) sinf(angle);
-        Vec3f *img = frame->frameHessian->dIp[feat->level];
+        const RotatedPattern &rp = rotatedPatterns[OrientationBin(feat->angle)];
 
         int level = 0;
         float ul = feat->uv[0];
@@ -151,41 +419,16 @@ namespace ldso {
 
         const int step = wG[feat->level];
 
-        int *pattern = bit_pattern_31_;
-#define GET_VALUE(idx) \
-        center[int(pattern[idx]*b + pattern[idx+1]*a)*step + int(pattern[idx]*a - pattern[idx+1]*b)][0]
-
-        for (int i = 0; i < 32; ++i, pattern += 32) {
-            int t0, t1, val;
-            t0 = GET_VALUE(0);
-            t1 = GET_VALUE(2);
-            val = t0 < t1;
-            t0 = GET_VALUE(4);
-            t1 = GET_VALUE(6);
-            val |= (t0 < t1) << 1;
-            t0 = GET_VALUE(8);
-            t1 = GET_VALUE(10);
-            val |= (t0 < t1) << 2;
-            t0 = GET_VALUE(12);
-            t1 = GET_VALUE(14);
-            val |= (t0 < t1) << 3;
-            t0 = GET_VALUE(16);
-            t1 = GET_VALUE(18);
-            val |= (t0 < t1) << 4;
-            t0 = GET_VALUE(20);
-            t1 = GET_VALUE(22);
-            val |= (t0 < t1) << 5;
-            t0 = GET_VALUE(24);
-            t1 = GET_VALUE(26);
-            val |= (t0 < t1) << 6;
-            t0 = GET_VALUE(28);
-            t1 = GET_VALUE(30);
-            val |= (t0 < t1) << 7;
-
+        for (int i = 0; i < 32; ++i) {
+            int val = 0;
+            for (int k = 0; k < 8; ++k) {
+                const int j = i * 8 + k;
+                int t0 = center[rp.y0[j] * step + rp.x0[j]][0];
+                int t1 = center[rp.y1[j] * step + rp.x1[j]][0];
+                val |= (t0 < t1) << k;
+            }
             feat->descriptor[i] = (uchar) val;
         }
-#undef GET_VALUE
-        return 0;
     }
 
     void FeatureDetector::DrawFeatures(shared_ptr<Frame> &frame, const string &windowName) {
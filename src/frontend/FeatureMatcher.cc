@@ -5,6 +5,8 @@
 #include "internal/PointHessian.h"
 #include "internal/ResidualProjections.h"
 #include "internal/Residuals.h"
+#include "internal/CPUFeatures.h"
+#include "internal/HammingAVX2.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d/features2d.hpp>
@@ -15,21 +17,37 @@ namespace ldso {
 
     int FeatureMatcher::DescriptorDistance(const unsigned char *desc1, const unsigned char *desc2) {
 
-        int dist = 0;
-        const int *pa = (int *) desc1;
-        const int *pb = (int *) desc2;
-
-        for (int i = 0; i < 8; i++, pa++, pb++) {
-            unsigned int v = *pa ^*pb;
-#ifdef __SSE2__
-            dist += _mm_popcnt_u64(v);  // SSE is so easy
-#else
-            v = v - ( ( v >> 1 ) & 0x55555555 );
-            v = ( v & 0x33333333 ) + ( ( v >> 2 ) & 0x33333333 );
-            dist += ( ( ( v + ( v >> 4 ) ) & 0xF0F0F0F ) * 0x1010101 ) >> 24;
+        // four 64 bit words, __builtin_popcountll becomes the popcnt instruction if the cpu has it
+        uint64_t a[4], b[4];
+        memcpy(a, desc1, 32);
+        memcpy(b, desc2, 32);
+        return __builtin_popcountll(a[0] ^ b[0]) + __builtin_popcountll(a[1] ^ b[1]) +
+               __builtin_popcountll(a[2] ^ b[2]) + __builtin_popcountll(a[3] ^ b[3]);
+    }
+
+#if LDSO_HAS_AVX2
+
+    /**
+     * AVX2 kernel of DescriptorDistances: one descriptor is one register
+     */
+    LDSO_TARGET_AVX2
+    static void DescriptorDistancesAVX2(const unsigned char *desc, const unsigned char *descs, int n, int *dist) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *) desc);
+        for (int i = 0; i < n; i++)
+            dist[i] = HammingAVX2(a, descs + 32 * i);
+    }
+
 #endif
+
+    void FeatureMatcher::DescriptorDistances(const unsigned char *desc, const unsigned char *descs, int n, int *dist) {
+#if LDSO_HAS_AVX2
+        if (useAVX2()) {
+            DescriptorDistancesAVX2(desc, descs, n, dist);
+            return;
         }
-        return dist;
+#endif
+        for (int i = 0; i < n; i++)
+            dist[i] = DescriptorDistance(desc, descs + 32 * i);
     }
 
     int FeatureMatcher::SearchBruteForce(shared_ptr<Frame> frame1, shared_ptr<Frame> frame2,
@@ -37,21 +55,32 @@ namespace ldso {
 
         matches.reserve(frame1->features.size());
 
+        // descriptors of the corners in frame2, stored contiguously for the one-to-many distance
+        vector<unsigned char> descs2;
+        vector<int> index2;
+        descs2.reserve(32 * frame2->features.size());
+        index2.reserve(frame2->features.size());
+        for (size_t j = 0; j < frame2->features.size(); j++) {
+            shared_ptr<Feature> &f2 = frame2->features[j];
+            if (f2->isCorner == false)
+                continue;
+            descs2.insert(descs2.end(), f2->descriptor, f2->descriptor + 32);
+            index2.push_back(j);
+        }
+        vector<int> dists(index2.size());
+
         for (size_t i = 0; i < frame1->features.size(); i++) {
-            shared_ptr<Feature> f1 = frame1->features[i];
+            shared_ptr<Feature> &f1 = frame1->features[i];
             if (f1->isCorner == false)
                 continue;
             int min_dist = 9999;
             int min_dist_index = -1;
 
-            for (size_t j = 0; j < frame2->features.size(); j++) {
-                shared_ptr<Feature> f2 = frame2->features[j];
-                if (f2->isCorner == false)
-                    continue;
-                int dist = DescriptorDistance(f1->descriptor, f2->descriptor);
-                if (dist < min_dist) {
-                    min_dist = dist;
-                    min_dist_index = j;
+            DescriptorDistances(f1->descriptor, descs2.data(), index2.size(), dists.data());
+            for (size_t j = 0; j < index2.size(); j++) {
+                if (dists[j] < min_dist) {
+                    min_dist = dists[j];
+                    min_dist_index = index2[j];
                 }
             }
 
@@ -73,11 +102,20 @@ namespace ldso {
         DBoW3::FeatureVector::const_iterator f1end = frame1->featVec.end();
         DBoW3::FeatureVector::const_iterator f2end = frame2->featVec.end();
 
+        vector<unsigned char> descs2;
+        vector<int> dists;
+
         while (f1it != f1end && f2it != f2end) {
             if (f1it->first == f2it->first) {
                 // from the same word
-                const vector<unsigned int> vIdx1 = f1it->second;
-                const vector<unsigned int> vIdx2 = f2it->second;
+                const vector<unsigned int> &vIdx1 = f1it->second;
+                const vector<unsigned int> &vIdx2 = f2it->second;
+
+                // descriptors of frame2 in this word, stored contiguously for the one-to-many distance
+                descs2.resize(32 * vIdx2.size());
+                dists.resize(vIdx2.size());
+                for (size_t k = 0; k < vIdx2.size(); k++)
+                    memcpy(&descs2[32 * k], frame2->features[frame2->bowIdx[vIdx2[k]]]->descriptor, 32);
 
                 for (auto &idx1: vIdx1) {
                     auto &feat1 = frame1->features[frame1->bowIdx[idx1]];
@@ -85,13 +123,13 @@ namespace ldso {
                     int bestIdx2 = -1;
                     int bestDist2 = 256;    // 第二近的
 
-                    for (auto &idx2:vIdx2) {
-                        auto &feat2 = frame2->features[frame2->bowIdx[idx2]];
-                        int dist = DescriptorDistance(feat1->descriptor, feat2->descriptor);
+                    DescriptorDistances(feat1->descriptor, descs2.data(), vIdx2.size(), dists.data());
+                    for (size_t k = 0; k < vIdx2.size(); k++) {
+                        int dist = dists[k];
                         if (dist < bestDist1) {
                             bestDist2 = bestDist1;
                             bestDist1 = dist;
-                            bestIdx2 = frame2->bowIdx[idx2];
+                            bestIdx2 = frame2->bowIdx[vIdx2[k]];
                         } else if (dist < bestDist2) {
                             bestDist2 = dist;
                         }
@@ -14,6 +14,7 @@
 
 #include <opencv2/features2d/features2d.hpp>
 #include <iomanip>
+#include <chrono>
 #include <opencv2/highgui/highgui.hpp>
 
 using namespace ldso;
@@ -57,6 +58,9 @@ namespace ldso
         {
             LOG(INFO) << "loop closing is disabled" << endl;
         }
+
+        if (setting_asyncDescriptors)
+            descriptorThread = thread(&FullSystem::descriptorLoop, this);
     }
 
     FullSystem::~FullSystem()
@@ -443,6 +447,17 @@ namespace ldso
 
         mappingThread.join();
 
+        if (descriptorThread.joinable())
+        {
+            // the queued keyframes are still described and passed to loop closing
+            {
+                unique_lock<mutex> lock(descriptorMutex);
+                descriptorExit = true;
+                descriptorCond.notify_all();
+            }
+            descriptorThread.join();
+        }
+
         if (setting_enableLoopClosing)
         {
             loopClosing->SetFinish(true);
@@ -508,8 +523,8 @@ namespace ldso
                     shared_ptr<PointHessian> ph = feat->point->mpPH;
 
                     // add new residuals into this point hessian
-                    shared_ptr<PointFrameResidual> r(
-                        new PointFrameResidual(ph, fh1, fh)); // residual from fh1 to fh
+                    shared_ptr<PointFrameResidual> r =
+                        PointFrameResidual::Create(ph, fh1, fh); // residual from fh1 to fh
 
                     r->setState(ResState::IN);
                     ph->residuals.push_back(r);
@@ -653,7 +668,14 @@ namespace ldso
 
         // add current kf into map and detect loops
         globalMap->AddKeyFrame(fh->frame);
-        if (setting_enableLoopClosing)
+        if (setting_asyncDescriptors)
+        {
+            // the descriptor stage passes it to loop closing
+            unique_lock<mutex> lock(descriptorMutex);
+            descriptorQueue.push_back(make_pair(frame, fh));
+            descriptorCond.notify_all();
+        }
+        else if (setting_enableLoopClosing)
         {
             loopClosing->InsertKeyFrame(frame);
         }
@@ -681,20 +703,20 @@ namespace ldso
         {
             if (fr == frame)
                 continue;
-            for (auto feat : fr->features)
+            for (auto &feat : fr->features)
             {
                 if (feat->status == Feature::FeatureStatus::VALID &&
                     feat->point->status == Point::PointStatus::ACTIVE)
                 {
 
-                    shared_ptr<PointHessian> ph = feat->point->mpPH;
+                    PointHessian *ph = feat->point->mpPH.get();
                     // remove the residuals projected into this frame
                     size_t n = ph->residuals.size();
                     for (size_t i = 0; i < n; i++)
                     {
-                        auto r = ph->residuals[i];
-                        if (r->target.lock() == frame->frameHessian)
+                        if (ph->residuals[i]->getTarget() == frame->frameHessian.get())
                         {
+                            auto r = ph->residuals[i];
                             if (ph->lastResiduals[0].first == r)
                                 ph->lastResiduals[0].first = nullptr;
                             else if (ph->lastResiduals[1].first == r)
@@ -786,8 +808,10 @@ namespace ldso
                 double distScore = 0;
                 for (FrameFramePrecalc &ffh : fr->frameHessian->targetPrecalc)
                 {
-                    if (ffh.target.lock()->frameID > latest->frameHessian->frameID - setting_minFrameAge + 1 ||
-                        ffh.target.lock() == ffh.host.lock())
+                    // the host of the precalc is fr
+                    shared_ptr<FrameHessian> target = ffh.target.lock();
+                    if (target->frameID > latest->frameHessian->frameID - setting_minFrameAge + 1 ||
+                        target == fr->frameHessian)
                         continue;
 
                     distScore += 1 / (1e-5 + ffh.distanceLL);
@@ -821,36 +845,33 @@ namespace ldso
             mnumOptIts = 15;
 
         // get statistics and active residuals.
+        // collect them block by block, so the residuals of one host/target pair are linearized together and their
+        // jacobians are written contiguously
         activeResiduals.clear();
-        int numPoints = 0;
+        activeResiduals.reserve(ef->nResiduals);
         int numLRes = 0;
-        for (shared_ptr<Frame> &fr : frames)
+        for (auto &blk : ef->residualBlocks)
         {
-            for (auto &feat : fr->features)
+            if (!blk)
+                continue;
+            for (auto &r : blk->residuals)
             {
-                shared_ptr<Point> p = feat->point;
-                if (feat->status == Feature::FeatureStatus::VALID && p && p->status == Point::PointStatus::ACTIVE)
+                if (!r->isLinearized())
                 {
-                    auto ph = p->mpPH;
-                    for (auto &r : ph->residuals)
-                    {
-                        if (!r->isLinearized)
-                        {
-                            activeResiduals.push_back(r);
-                            r->resetOOB();
-                        }
-                        else
-                        {
-                            numLRes++;
-                        }
-                    }
+                    activeResiduals.push_back(r);
+                    r->resetOOB();
+                }
+                else
+                {
+                    numLRes++;
                 }
-                numPoints++;
             }
         }
 
         LOG(INFO) << "active residuals: " << activeResiduals.size() << endl;
 
+        gatherOptPoints();
+
         Vec3 lastEnergy = linearizeAll(false);
         double lastEnergyL = calcLEnergy();
         double lastEnergyM = calcMEnergy();
@@ -869,8 +890,31 @@ namespace ldso
         float stepsize = 1;
         VecX previousX = VecX::Constant(CPARS + 8 * frames.size(), NAN);
 
+        // adaptive termination
+        auto optStart = std::chrono::steady_clock::now();
+        double lastDecrease = -1; // actual energy decrease of the last step, negative if it was rejected
+        const char *stopReason = "max iterations";
+        int numIterations = mnumOptIts;
+
         for (int iteration = 0; iteration < mnumOptIts; iteration++)
         {
+            // before paying for the next solve: the decrease the last quadratic model still predicts along the last
+            // step direction x, from where the step -stepsize * x ended. With g = x.bS - stepsize * x.HS.x the model
+            // gives 2 t g - t^2 x.HS.x for a further step -t * x (back along x if g < 0), at most g^2 / x.HS.x
+            if (setting_optPredictedDecreaseTH > 0 && lastDecrease > 0 && iteration >= setting_minOptIterations)
+            {
+                const VecX &x = ef->lastX;
+                double xHx = x.dot(ef->lastHS * x);
+                double g = x.dot(ef->lastbS) - stepsize * xHx;
+                double predicted = xHx > 0 ? g * g / xHx : 0;
+                if (predicted < setting_optPredictedDecreaseTH * lastDecrease)
+                {
+                    stopReason = "predicted decrease";
+                    numIterations = iteration;
+                    break;
+                }
+            }
+
             // solve!
             backupState(iteration != 0);
 
@@ -893,8 +937,9 @@ namespace ldso
 
             bool canbreak = doStepFromBackup(stepsize, stepsize, stepsize, stepsize, stepsize);
 
-            // eval new energy!
-            Vec3 newEnergy = linearizeAll(false);
+            // eval new energy! with lazy relinearization, every setting_lazyRelinFullEvery-th iteration is a full one
+            bool lazy = setting_lazyRelin && (iteration + 1) % setting_lazyRelinFullEvery != 0;
+            Vec3 newEnergy = linearizeAll(false, lazy);
             double newEnergyL = calcLEnergy();
             double newEnergyM = calcMEnergy();
 
@@ -913,6 +958,8 @@ namespace ldso
                 else
                     applyRes_Reductor(true, 0, activeResiduals.size(), 0, 0);
 
+                lastDecrease = lastEnergy[0] + lastEnergy[1] + lastEnergyL + lastEnergyM -
+                               (newEnergy[0] + newEnergy[1] + newEnergyL + newEnergyM);
                 lastEnergy = newEnergy;
                 lastEnergyL = newEnergyL;
                 lastEnergyM = newEnergyM;
@@ -923,16 +970,32 @@ namespace ldso
             {
                 // energy increses, reload the backup state and increase lambda
                 loadSateBackup();
-                lastEnergy = linearizeAll(false);
+                lastEnergy = linearizeAll(false, lazy);
                 lastEnergyL = calcLEnergy();
                 lastEnergyM = calcMEnergy();
                 lambda *= 1e2;
+                lastDecrease = -1;
             }
 
             if (canbreak && iteration >= setting_minOptIterations)
+            {
+                stopReason = "converged";
+                numIterations = iteration + 1;
                 break;
+            }
+
+            if (setting_optTimeBudgetMs > 0 && iteration + 1 >= setting_minOptIterations && iteration + 1 < mnumOptIts &&
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - optStart).count() >
+                    setting_optTimeBudgetMs)
+            {
+                stopReason = "time budget";
+                numIterations = iteration + 1;
+                break;
+            }
         }
 
+        LOG(INFO) << "optimization stopped after " << numIterations << " iterations: " << stopReason << endl;
+
         Vec10 newStateZero = Vec10::Zero();
         newStateZero.segment<2>(6) = frames.back()->frameHessian->get_state().segment<2>(6);
 
@@ -1116,7 +1179,7 @@ namespace ldso
             {
                 shared_ptr<FrameHessian> host = point->feature->host.lock()->frameHessian;
                 shared_ptr<FrameHessian> target = residuals[i]->target.lock();
-                shared_ptr<PointFrameResidual> r(new PointFrameResidual(p, host, target));
+                shared_ptr<PointFrameResidual> r = PointFrameResidual::Create(p, host, target);
 
                 r->state_NewEnergy = r->state_energy = 0;
                 r->state_NewState = ResState::OUTLIER;
@@ -1150,9 +1213,9 @@ namespace ldso
         K(0, 2) = Hcalib->mpCH->cxl();
         K(1, 2) = Hcalib->mpCH->cyl();
 
-        for (shared_ptr<Frame> fr : frames)
+        for (auto &fr : frames)
         {
-            shared_ptr<FrameHessian> host = fr->frameHessian;
+            const shared_ptr<FrameHessian> &host = fr->frameHessian;
 
             SE3 hostToNew = fh->PRE_worldToCam * host->PRE_camToWorld;
             Mat33f KRKi = K * hostToNew.rotationMatrix().cast<float>() * K.inverse();
@@ -1162,12 +1225,12 @@ namespace ldso
                                                     fh->aff_g2l())
                             .cast<float>();
 
-            for (auto feat : fr->features)
+            for (auto &feat : fr->features)
             {
                 if (feat->status == Feature::FeatureStatus::IMMATURE && feat->ip)
                 {
                     // update the immature points
-                    shared_ptr<ImmaturePoint> ph = feat->ip;
+                    ImmaturePoint *ph = feat->ip.get();
                     ph->traceOn(fh, KRKi, Kt, aff, Hcalib->mpCH);
 
                     if (ph->lastTraceStatus == ImmaturePointStatus::IPS_GOOD)
@@ -1216,7 +1279,7 @@ namespace ldso
 
         auto newestFr = frames.back();
         vector<shared_ptr<FrameHessian>> frameHessians;
-        for (auto fr : frames)
+        for (auto &fr : frames)
             frameHessians.push_back(fr->frameHessian);
 
         // make dist map
@@ -1227,7 +1290,7 @@ namespace ldso
         toOptimize.reserve(20000);
 
         // go through all active frames
-        for (auto host : frameHessians)
+        for (auto &host : frameHessians)
         {
             if (host == newestFr->frameHessian)
                 continue;
@@ -1259,7 +1322,7 @@ namespace ldso
                     if (!canActivate)
                     {
                         // if point will be out afterwards, delete it instead.
-                        if (ph->feature->host.lock()->frameHessian->flaggedForMarginalization ||
+                        if (host->flaggedForMarginalization ||
                             ph->lastTraceStatus == IPS_OOB)
                         {
                             feat->status = Feature::FeatureStatus::OUTLIER;
@@ -1403,7 +1466,7 @@ namespace ldso
                             {
                                 r->resetOOB();
                                 r->linearize(this->Hcalib->mpCH);
-                                r->isLinearized = false;
+                                r->block->linearized[r->blockIdx] = 0;
                                 r->applyRes(true);
                                 if (r->isActive())
                                 {
@@ -1444,7 +1507,8 @@ namespace ldso
         {
             LOG(INFO) << "using LDSO point selection strategy " << endl;
             newFrame->frame->features.reserve(setting_desiredImmatureDensity);
-            detector.DetectCorners(setting_desiredImmatureDensity, newFrame->frame);
+            // with setting_asyncDescriptors the descriptors are computed by the descriptor stage
+            detector.DetectCorners(setting_desiredImmatureDensity, newFrame->frame, !setting_asyncDescriptors);
             for (auto &feat : newFrame->frame->features)
             {
                 // create a immature point
@@ -1467,7 +1531,7 @@ namespace ldso
                     if (selectionMap[i] == 0)
                         continue;
 
-                    shared_ptr<Feature> feat(new Feature(x, y, newFrame->frame));
+                    shared_ptr<Feature> feat = Feature::Create(x, y, newFrame->frame);
                     feat->ip = shared_ptr<ImmaturePoint>(
                         new ImmaturePoint(newFrame->frame, feat, selectionMap[i], Hcalib->mpCH));
                     if (!std::isfinite(feat->ip->energyTH))
@@ -1490,7 +1554,7 @@ namespace ldso
             {
                 int x = rng.uniform(20, wG[0] - 20);
                 int y = rng.uniform(20, hG[0] - 20);
-                shared_ptr<Feature> feat(new Feature(x, y, newFrame->frame));
+                shared_ptr<Feature> feat = Feature::Create(x, y, newFrame->frame);
                 feat->ip = shared_ptr<ImmaturePoint>(
                     new ImmaturePoint(newFrame->frame, feat, 1, Hcalib->mpCH));
                 if (!std::isfinite(feat->ip->energyTH))
@@ -1551,7 +1615,7 @@ namespace ldso
                 continue;
             Pnt *point = coarseInitializer->points[0] + i;
 
-            shared_ptr<Feature> feat(new Feature(point->u + 0.5f, point->v + 0.5f, firstFrame->frame));
+            shared_ptr<Feature> feat = Feature::Create(point->u + 0.5f, point->v + 0.5f, firstFrame->frame);
             feat->ip = shared_ptr<ImmaturePoint>(
                 new ImmaturePoint(firstFrame->frame, feat, point->my_type, Hcalib->mpCH));
 
@@ -1642,7 +1706,7 @@ namespace ldso
         ef->solveSystemF(iteration, lambda, Hcalib->mpCH);
     }
 
-    Vec3 FullSystem::linearizeAll(bool fixLinearization)
+    Vec3 FullSystem::linearizeAll(bool fixLinearization, bool lazy)
     {
 
         double lastEnergyP = 0;
@@ -1654,18 +1718,40 @@ namespace ldso
         for (int i = 0; i < NUM_THREADS; i++)
             toRemove[i].clear();
 
+        // lazy relinearization: decide per host-target pair if the precalc moved, the point idepth is checked per
+        // residual. In the full iterations the same check runs to measure the error the skipping would have made
+        const bool lazyCheck = setting_lazyRelin && !fixLinearization;
+        if (lazyCheck)
+            for (auto &blk : ef->residualBlocks)
+                if (blk)
+                    blk->relinearize = blk->precalcChanged(setting_lazyRelinTH);
+
+        Vec10 stats = Vec10::Zero();
         if (multiThreading)
         {
             threadReduce.reduce(
-                bind(&FullSystem::linearizeAll_Reductor, this, fixLinearization, toRemove, _1, _2, _3, _4),
+                bind(&FullSystem::linearizeAll_Reductor, this, fixLinearization, lazy, toRemove, _1, _2, _3, _4),
                 0, activeResiduals.size(), 0);
-            lastEnergyP = threadReduce.stats[0];
+            stats = threadReduce.stats;
         }
         else
         {
-            Vec10 stats;
-            linearizeAll_Reductor(fixLinearization, toRemove, 0, activeResiduals.size(), &stats, 0);
-            lastEnergyP = stats[0];
+            linearizeAll_Reductor(fixLinearization, lazy, toRemove, 0, activeResiduals.size(), &stats, 0);
+        }
+        lastEnergyP = stats[0];
+
+        if (lazyCheck)
+        {
+            for (auto &blk : ef->residualBlocks)
+                if (blk && (!lazy || blk->relinearize))
+                    blk->setLinearized();
+
+            if (lazy)
+                LOG(INFO) << "lazy relinearization: skipped " << stats[1] << " of " << activeResiduals.size()
+                          << " residuals (" << stats[1] / std::max<size_t>(activeResiduals.size(), 1) << ")" << endl;
+            else if (stats[2] > 0)
+                LOG(INFO) << "lazy relinearization: " << stats[2] << " residuals below threshold, energy deviation "
+                          << stats[3] << " (" << stats[3] / std::max(lastEnergyP, 1e-10) << " of the total)" << endl;
         }
 
         setNewFrameEnergyTH();
@@ -1673,9 +1759,9 @@ namespace ldso
         if (fixLinearization)
         {
 
-            for (auto r : activeResiduals)
+            for (const auto &r : activeResiduals)
             {
-                shared_ptr<PointHessian> ph = r->point.lock();
+                PointHessian *ph = r->getPoint();
                 if (ph->lastResiduals[0].first == r)
                     ph->lastResiduals[0].second = r->state_state;
                 else if (ph->lastResiduals[1].first == r)
@@ -1685,9 +1771,9 @@ namespace ldso
             int nResRemoved = 0;
             for (int i = 0; i < NUM_THREADS; i++)
             {
-                for (auto r : toRemove[i])
+                for (const auto &r : toRemove[i])
                 {
-                    shared_ptr<PointHessian> ph = r->point.lock();
+                    PointHessian *ph = r->getPoint();
 
                     if (ph->lastResiduals[0].first == r)
                         ph->lastResiduals[0].first = 0;
@@ -1703,7 +1789,7 @@ namespace ldso
     }
 
     void FullSystem::linearizeAll_Reductor(
-        bool fixLinearization, std::vector<shared_ptr<PointFrameResidual>>
+        bool fixLinearization, bool lazy, std::vector<shared_ptr<PointFrameResidual>>
 
                                    *toRemove,
         int min,
@@ -1716,9 +1802,30 @@ namespace ldso
             k < max;
             k++)
         {
-            shared_ptr<PointFrameResidual> r = activeResiduals[k];
-            (*stats)[0] += r->linearize(Hcalib
-                                            ->mpCH);
+            const shared_ptr<PointFrameResidual> &r = activeResiduals[k];
+            const float idepth = r->getPoint()->idepth_scaled;
+
+            // stats: [0] energy, [1] skipped residuals, [2] residuals below the lazy threshold in a full
+            // linearization, [3] their absolute energy change
+            const bool belowTH = setting_lazyRelin && !fixLinearization && r->lazyValid && !r->block->relinearize &&
+                                 fabsf(idepth - r->lazyIdepth) <= setting_lazyRelinTH * fabsf(r->lazyIdepth);
+            if (belowTH && lazy)
+            {
+                (*stats)[0] += r->lazyEnergy;
+                (*stats)[1]++;
+                continue;
+            }
+
+            double energy = r->linearize(Hcalib->mpCH);
+            (*stats)[0] += energy;
+            if (belowTH)
+            {
+                (*stats)[2]++;
+                (*stats)[3] += fabs(energy - r->lazyEnergy);
+            }
+            r->lazyEnergy = energy;
+            r->lazyIdepth = idepth;
+            r->lazyValid = true;
 
             if (fixLinearization)
             {
@@ -1732,9 +1839,9 @@ namespace ldso
                 {
                     if (r->isNew)
                     {
-                        shared_ptr<PointHessian> p = r->point.lock();
-                        shared_ptr<FrameHessian> host = r->host.lock();
-                        shared_ptr<FrameHessian> target = r->target.lock();
+                        PointHessian *p = r->getPoint();
+                        FrameHessian *host = r->getHost();
+                        FrameHessian *target = r->getTarget();
                         Vec3f ptp_inf = host->targetPrecalc[target->idx].PRE_KRKiTll *
                                         Vec3f(p->u, p->v, 1); // projected point assuming infinite depth.
                         Vec3f ptp = ptp_inf + host->targetPrecalc[target->idx].PRE_KtTll *
@@ -1756,6 +1863,20 @@ namespace ldso
         }
     }
 
+    void FullSystem::gatherOptPoints()
+    {
+        optPoints.clear();
+        for (auto &fr : frames)
+            for (auto &feat : fr->features)
+                if (feat->status == Feature::FeatureStatus::VALID && feat->point &&
+                    feat->point->status == Point::PointStatus::ACTIVE)
+                    optPoints.push_back(feat->point->mpPH.get());
+
+        optIdepthBackup.resize(optPoints.size());
+        optStep.resize(optPoints.size());
+        optStepBackup.resize(optPoints.size());
+    }
+
     // applies step to linearization point.
     bool FullSystem::doStepFromBackup(float stepfacC, float stepfacT, float stepfacR, float stepfacA, float stepfacD)
     {
@@ -1765,11 +1886,10 @@ namespace ldso
         pstepfac.segment<3>(3).setConstant(stepfacR);
         pstepfac.segment<4>(6).setConstant(stepfacA);
 
-        float sumA = 0, sumB = 0, sumT = 0, sumR = 0, sumID = 0, numID = 0;
-
-        float sumNID = 0;
+        float sumA = 0, sumB = 0, sumT = 0, sumR = 0;
 
-        if (setting_solverMode & SOLVER_MOMENTUM)
+        const bool momentum = setting_solverMode & SOLVER_MOMENTUM;
+        if (momentum)
         {
             Hcalib->mpCH->setValue(Hcalib->mpCH->value_backup + Hcalib->mpCH->step);
             for (auto &fr : frames)
@@ -1783,21 +1903,6 @@ namespace ldso
                 sumB += step[7] * step[7];
                 sumT += step.segment<3>(0).squaredNorm();
                 sumR += step.segment<3>(3).squaredNorm();
-
-                for (auto feat : fr->features)
-                {
-                    if (feat->status == Feature::FeatureStatus::VALID && feat->point && feat->point->status == Point::PointStatus::ACTIVE)
-                    {
-
-                        auto ph = feat->point->mpPH;
-                        float step = ph->step + 0.5f * (ph->step_backup);
-                        ph->setIdepth(ph->idepth_backup + step);
-                        sumID += step * step;
-                        sumNID += fabsf(ph->idepth_backup);
-                        numID++;
-                        ph->setIdepthZero(ph->idepth_backup + step);
-                    }
-                }
             }
         }
         else
@@ -1811,29 +1916,30 @@ namespace ldso
                 sumB += fh->step[7] * fh->step[7];
                 sumT += fh->step.segment<3>(0).squaredNorm();
                 sumR += fh->step.segment<3>(3).squaredNorm();
-
-                for (auto feat : fr->features)
-                {
-                    if (feat->status == Feature::FeatureStatus::VALID && feat->point &&
-                        feat->point->status == Point::PointStatus::ACTIVE)
-                    {
-                        auto ph = feat->point->mpPH;
-                        ph->setIdepth(ph->idepth_backup + stepfacD * ph->step);
-                        sumID += ph->step * ph->step;
-                        sumNID += fabsf(ph->idepth_backup);
-                        numID++;
-                        ph->setIdepthZero(ph->idepth_backup + stepfacD * ph->step);
-                    }
-                }
             }
         }
 
+        // points: [0] sum of abs idepths
+        Vec10 stats = Vec10::Zero();
+        if (multiThreading)
+        {
+            threadReduce.reduce(bind(&FullSystem::doStepFromBackup_Reductor, this, stepfacD,
+                                     momentum, _1, _2, _3, _4),
+                                0, optPoints.size(), 0);
+            stats = threadReduce.stats;
+        }
+        else
+        {
+            doStepFromBackup_Reductor(stepfacD, momentum, 0, optPoints.size(), &stats, 0);
+        }
+
+        float numID = optPoints.size();
+        float sumNID = stats[0] / numID;
+
         sumA /= frames.size();
         sumB /= frames.size();
         sumR /= frames.size();
         sumT /= frames.size();
-        sumID /= numID;
-        sumNID /= numID;
 
         EFDeltaValid = false;
         setPrecalcValues();
@@ -1844,69 +1950,73 @@ namespace ldso
                sqrtf(sumT) * sumNID < 0.00005 * setting_thOptIterations;
     }
 
+    void FullSystem::doStepFromBackup_Reductor(float stepfacD, bool momentum, int min, int max, Vec10 *stats,
+                                               int tid)
+    {
+        if (min >= max)
+            return;
+        for (int i = min; i < max; i++)
+            optStep[i] = optPoints[i]->step;
+
+        Eigen::Map<VecXf> step(optStep.data() + min, max - min);
+        Eigen::Map<VecXf> stepBackup(optStepBackup.data() + min, max - min);
+        Eigen::Map<VecXf> idepthBackup(optIdepthBackup.data() + min, max - min);
+
+        // the new idepths are written into optStep, then set to the points
+        if (momentum)
+            step += 0.5f * stepBackup;
+        else
+            step *= stepfacD;
+        (*stats)[0] += idepthBackup.cwiseAbs().sum();
+        step += idepthBackup;
+
+        for (int i = min; i < max; i++)
+        {
+            optPoints[i]->setIdepth(optStep[i]);
+            optPoints[i]->setIdepthZero(optStep[i]);
+        }
+    }
+
     void FullSystem::backupState(bool backupLastStep)
     {
+        const bool momentum = setting_solverMode & SOLVER_MOMENTUM;
 
-        if (setting_solverMode & SOLVER_MOMENTUM)
+        Hcalib->mpCH->value_backup = Hcalib->mpCH->value;
+        if (momentum)
         {
             if (backupLastStep)
-            {
                 Hcalib->mpCH->step_backup = Hcalib->mpCH->step;
-                Hcalib->mpCH->value_backup = Hcalib->mpCH->value;
-                for (auto &fr : frames)
-                {
-                    auto fh = fr->frameHessian;
-                    fh->step_backup = fh->step;
-                    fh->state_backup = fh->get_state();
-                    for (auto feat : fr->features)
-                    {
-                        if (feat->point && feat->point->status == Point::PointStatus::ACTIVE)
-                        {
-                            auto ph = feat->point->mpPH;
-                            ph->idepth_backup = ph->idepth;
-                            ph->step_backup = ph->step;
-                        }
-                    }
-                }
-            }
             else
-            {
                 Hcalib->mpCH->step_backup.setZero();
-                Hcalib->mpCH->value_backup = Hcalib->mpCH->value;
-                for (auto &fr : frames)
-                {
-                    auto fh = fr->frameHessian;
+        }
+
+        for (auto &fr : frames)
+        {
+            auto fh = fr->frameHessian;
+            fh->state_backup = fh->get_state();
+            if (momentum)
+            {
+                if (backupLastStep)
+                    fh->step_backup = fh->step;
+                else
                     fh->step_backup.setZero();
-                    fh->state_backup = fh->get_state();
-                    for (auto feat : fr->features)
-                    {
-                        if (feat->point && feat->point->status == Point::PointStatus::ACTIVE)
-                        {
-                            auto ph = feat->point->mpPH;
-                            ph->idepth_backup = ph->idepth;
-                            ph->step_backup = 0;
-                        }
-                    }
-                }
             }
         }
+
+        if (multiThreading)
+            threadReduce.reduce(bind(&FullSystem::backupState_Reductor, this, momentum && backupLastStep,
+                                     _1, _2, _3, _4),
+                                0, optPoints.size(), 0);
         else
+            backupState_Reductor(momentum && backupLastStep, 0, optPoints.size(), 0, 0);
+    }
+
+    void FullSystem::backupState_Reductor(bool backupStep, int min, int max, Vec10 *stats, int tid)
+    {
+        for (int i = min; i < max; i++)
         {
-            Hcalib->mpCH->value_backup = Hcalib->mpCH->value;
-            for (auto &fr : frames)
-            {
-                auto fh = fr->frameHessian;
-                fh->state_backup = fh->get_state();
-                for (auto feat : fr->features)
-                {
-                    if (feat->status == Feature::FeatureStatus::VALID &&
-                        feat->point->status == Point::PointStatus::ACTIVE)
-                    {
-                        auto ph = feat->point->mpPH;
-                        ph->idepth_backup = ph->idepth;
-                    }
-                }
-            }
+            optIdepthBackup[i] = optPoints[i]->idepth;
+            optStepBackup[i] = backupStep ? optPoints[i]->step : 0;
         }
     }
 
@@ -1918,21 +2028,27 @@ namespace ldso
         {
             auto fh = fr->frameHessian;
             fh->setState(fh->state_backup);
-            for (auto feat : fr->features)
-            {
-                if (feat->point && feat->point->status == Point::PointStatus::ACTIVE)
-                {
-                    auto ph = feat->point->mpPH;
-                    ph->setIdepth(ph->idepth_backup);
-                    ph->setIdepthZero(ph->idepth_backup);
-                }
-            }
         }
 
+        if (multiThreading)
+            threadReduce.reduce(bind(&FullSystem::loadStateBackup_Reductor, this, _1, _2, _3, _4),
+                                0, optPoints.size(), 0);
+        else
+            loadStateBackup_Reductor(0, optPoints.size(), 0, 0);
+
         EFDeltaValid = false;
         setPrecalcValues();
     }
 
+    void FullSystem::loadStateBackup_Reductor(int min, int max, Vec10 *stats, int tid)
+    {
+        for (int i = min; i < max; i++)
+        {
+            optPoints[i]->setIdepth(optIdepthBackup[i]);
+            optPoints[i]->setIdepthZero(optIdepthBackup[i]);
+        }
+    }
+
     double FullSystem::calcLEnergy()
     {
         if (setting_forceAceptStep)
@@ -2022,7 +2138,7 @@ namespace ldso
         auto newFrame = fr->frameHessian;
 
         for (auto &r : activeResiduals)
-            if (r->state_NewEnergyWithOutlier >= 0 && r->target.lock() == newFrame)
+            if (r->state_NewEnergyWithOutlier >= 0 && r->getTarget() == newFrame.get())
             {
                 allResVec.push_back(r->state_NewEnergyWithOutlier);
             }
@@ -2138,6 +2254,32 @@ namespace ldso
         LOG(INFO) << "MAPPING FINISHED!";
     }
 
+    void FullSystem::descriptorLoop()
+    {
+
+        unique_lock<mutex> lock(descriptorMutex);
+        while (true)
+        {
+            while (descriptorQueue.empty() && !descriptorExit)
+                descriptorCond.wait(lock);
+            if (descriptorQueue.empty())
+                break;
+
+            shared_ptr<Frame> frame = descriptorQueue.front().first;
+            shared_ptr<FrameHessian> fh = descriptorQueue.front().second;
+            descriptorQueue.pop_front();
+            lock.unlock();
+
+            detector.ComputeDescriptors(frame, fh);
+            fh = nullptr;
+            if (setting_enableLoopClosing)
+                loopClosing->InsertKeyFrame(frame);
+
+            lock.lock();
+        }
+        LOG(INFO) << "DESCRIPTOR STAGE FINISHED!";
+    }
+
     bool FullSystem::saveAll(const string &filename)
     {
         ofstream fout(filename, ios::out | ios::binary);
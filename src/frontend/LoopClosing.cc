@@ -5,11 +5,13 @@
 #include "frontend/LoopClosing.h"
 #include "frontend/FeatureMatcher.h"
 #include "frontend/FullSystem.h"
+#include "frontend/PnPRansac.h"
 
-#include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <boost/format.hpp>
 
+#include <chrono>
+
 #include <g2o/core/block_solver.h>
 #include <g2o/core/optimization_algorithm_gauss_newton.h>
 #include <g2o/core/optimization_algorithm_levenberg.h>
@@ -21,11 +23,12 @@ namespace ldso {
 
     // -----------------------------------------------------------
     LoopClosing::LoopClosing(FullSystem *fullsystem) :
-            kfDB(new DBoW3::Database(*fullsystem->vocab)), voc(fullsystem->vocab),
+            kfDB(fullsystem->vocab->CreateDatabase()), voc(fullsystem->vocab),
             globalMap(fullsystem->globalMap), Hcalib(fullsystem->Hcalib->mpCH),
             coarseDistanceMap(fullsystem->GetDistanceMap()),
             fullSystem(fullsystem) {
 
+        verifyReduce = globalMap->GetBackgroundReduce();
         mainLoop = thread(&LoopClosing::Run, this);
         idepthMap = new float[wG[0] * hG[0]];
     }
@@ -62,40 +65,32 @@ namespace ldso {
                 allKF.push_back(currentKF);
             }
 
-            currentKF->ComputeBoW(voc);
+            currentKF->ComputeBoW(voc, verifyReduce);
             if (DetectLoop(currentKF)) {
-                bool mapIdle = globalMap->Idle();
                 if (CorrectLoop(Hcalib)) {
-                    // start a pose graph optimization
-                    if (mapIdle) {
-                        LOG(INFO) << "call global pose graph!" << endl;
-                        bool ret = globalMap->OptimizeALLKFs();
-                        if (ret)
-                            needPoseGraph = false;
-                    } else {
-                        LOG(INFO) << "still need pose graph optimization!" << endl;
-                        needPoseGraph = true;
-                    }
+                    // start a pose graph optimization, merged with a pending one or replacing a running one
+                    LOG(INFO) << "call global pose graph!" << endl;
+                    CheckPoseGraphResult();
+                    poseGraphResult = globalMap->OptimizeALLKFs();
                 }
             }
 
-
-            if (needPoseGraph && globalMap->Idle()) {
-                LOG(INFO) << "run another pose graph!" << endl;
-                if (globalMap->OptimizeALLKFs())
-                    needPoseGraph = false;
-            }
-
             usleep(5000);
         }
 
         finished = true;
     }
 
+    void LoopClosing::CheckPoseGraphResult() {
+        if (poseGraphResult.valid() && poseGraphResult.wait_for(chrono::seconds(0)) == future_status::ready &&
+            !poseGraphResult.get())
+            LOG(WARNING) << "pose graph optimization of a loop was not run, the map stopped before" << endl;
+    }
+
     bool LoopClosing::DetectLoop(shared_ptr<Frame> &frame) {
 
         DBoW3::QueryResults results;
-        kfDB->query(frame->bowVec, results, 1, maxKFId - kfGap);
+        kfDB->query(frame->bowVec, results, setting_loopCandidates, maxKFId - kfGap);
 
         if (results.empty()) {
             DBoW3::EntryId id = kfDB->add(frame->bowVec, frame->featVec);
@@ -104,175 +99,220 @@ namespace ldso {
             return false;
         }
 
-        DBoW3::Result r = results[0];
-        candidateKF = checkedKFs[r.Id];
-
         auto connected = frame->GetConnectedKeyFrames();
-        unsigned long minKFId = 9999999, maxKFId = 0;
+        unsigned long minConnectedId = 9999999, maxConnectedId = 0;
 
         for (auto &kf: connected) {
-            if (kf->kfId < minKFId)
-                minKFId = kf->kfId;
-            if (kf->kfId > maxKFId)
-                maxKFId = kf->kfId;
+            if (kf->kfId < minConnectedId)
+                minConnectedId = kf->kfId;
+            if (kf->kfId > maxConnectedId)
+                maxConnectedId = kf->kfId;
+        }
+
+        // results are sorted by score, skip the candidates in the active window
+        candidates.clear();
+        for (auto &r: results) {
+            shared_ptr<Frame> kf = checkedKFs[r.Id];
+            if (kf->kfId <= maxConnectedId && kf->kfId >= minConnectedId)
+                continue;
+            LoopCandidate c;
+            c.kf = kf;
+            c.score = r.Score;
+            candidates.push_back(c);
         }
 
-        if (candidateKF->kfId <= maxKFId && candidateKF->kfId >= minKFId) {
-            // candidate is in active window
+        if (candidates.empty()) {
+            // candidates are in active window
             return false;
         }
 
-        LOG(INFO) << "candidate kf id: " << candidateKF->kfId << ", max id: " << maxKFId << ", min id: " << minKFId
-                  << endl;
+        LOG(INFO) << "best candidate kf id: " << candidates[0].kf->kfId << ", max id: " << maxConnectedId
+                  << ", min id: " << minConnectedId << endl;
 
-        if (r.Score < minScoreAccept) {
+        if (candidates[0].score < minScoreAccept) {
             DBoW3::EntryId id = kfDB->add(frame->bowVec, frame->featVec);
             maxKFId = id;
             checkedKFs[id] = frame;
-            candidateKF = checkedKFs[r.Id];
-            LOG(INFO) << "add loop candidate from " << candidateKF->kfId << ", current: " << frame->kfId << ", score: "
-                      << r.Score << endl;
-            return true;
         }
+        // else: detected a possible loop, don't add into database
 
-        // detected a possible loop
-        candidateKF = checkedKFs[r.Id];
-        LOG(INFO) << "add loop candidate from " << candidateKF->kfId << ", current: " << frame->kfId << ", score: "
-                  << r.Score << endl;
-        return true;   // don't add into database
+        for (auto &c: candidates)
+            LOG(INFO) << "add loop candidate from " << c.kf->kfId << ", current: " << frame->kfId << ", score: "
+                      << c.score << endl;
+        return true;
     }
 
     bool LoopClosing::CorrectLoop(shared_ptr<CalibHessian> Hcalib) {
 
-        // We compute first ORB matches for each candidate
-        FeatureMatcher matcher(0.75, true);
-        bool success = false;
-        int nCandidates = 0; //candidates with enough matches
+        // the idepth map and feature grid of the current keyframe are shared by all candidates
+        ComputeIdepthMap();
+        currentKF->SetFeatureGrid();
 
-        // intrinsics
-        cv::Mat K = cv::Mat::eye(3, 3, CV_32F);
-        K.at<float>(0, 0) = Hcalib->fxl();
-        K.at<float>(1, 1) = Hcalib->fyl();
-        K.at<float>(0, 2) = Hcalib->cxl();
-        K.at<float>(1, 2) = Hcalib->cyl();
+        const int nCandidates = candidates.size();
+        firstPassed = nCandidates;
+        if (nCandidates > 1)
+            verifyReduce->reduce(bind(&LoopClosing::VerifyCandidate_Reductor, this, Hcalib, _1, _2, _3, _4),
+                                0, nCandidates, 1);
+        else
+            VerifyCandidate_Reductor(Hcalib, 0, nCandidates, 0, 0);
 
-        shared_ptr<Frame> pKF = candidateKF;
-        vector<Match> matches;
-        int nmatches = matcher.SearchByBoW(currentKF, pKF, matches);
+        for (auto &c: candidates)
+            LOG(INFO) << "loop candidate " << c.kf->kfId << ": " << c.stage << ", bow " << c.timeBoW << " ms, pnp "
+                      << c.timePnP << " ms, pose " << c.timePose << " ms" << endl;
 
-        if (nmatches < 10) {
-            LOG(INFO) << "no enough matches: " << nmatches << endl;
-        } else {
-            LOG(INFO) << "matches: " << nmatches << endl;
-
-            // now we have a candidate proposed by dbow, let's try opencv's solve pnp ransac to see if there are enough inliers
-            vector<cv::Point3f> p3d;
-            vector<cv::Point2f> p2d;
-            cv::Mat inliers;
-            vector<int> matchIdx;
-
-            for (size_t k = 0; k < matches.size(); k++) {
-                auto &m = matches[k];
-                shared_ptr<Feature> &featKF = pKF->features[m.index2];
-                shared_ptr<Feature> &featCurrent = currentKF->features[m.index1];
-
-                if (featKF->status == Feature::FeatureStatus::VALID &&
-                    featKF->point->status != Point::PointStatus::OUTLIER) {
-                    // there should be a 3d point
-                    // pt unused?
-                    //shared_ptr<Point> &pt = featKF->point;
-                    // compute 3d pos in ref
-                    Vec3f pt3 = (1.0 / featKF->invD) * Vec3f(
-                            Hcalib->fxli() * (featKF->uv[0] - Hcalib->cxl()),
-                            Hcalib->fyli() * (featKF->uv[1] - Hcalib->cyl()),
-                            1
-                    );
-                    cv::Point3f pt3d(pt3[0], pt3[1], pt3[2]);
-                    p3d.push_back(pt3d);
-                    p2d.push_back(cv::Point2f(featCurrent->uv[0], featCurrent->uv[1]));
-                    matchIdx.push_back(k);
-                }
-            }
+        if (firstPassed == nCandidates)
+            return false;
 
-            if (p3d.size() < 10) {
-                LOG(INFO) << "3d points not enough: " << p3d.size() << endl;
-                return false;
-            }
+        LoopCandidate &best = candidates[firstPassed];
+        shared_ptr<Frame> pKF = best.kf;
 
-            cv::Mat R, t;
-#if (defined(CV_VERSION_EPOCH) && CV_VERSION_EPOCH == 2)
-            // OpenCV 2 has "minInliers" parameter
-            cv::solvePnPRansac(p3d, p2d, K, cv::Mat(), R, t, false, 100, 8.0, 0, inliers);
-#else
-            // OpenCV 3 and 4 has "confidence" parameter
-            try {
-              cv::solvePnPRansac(p3d, p2d, K, cv::Mat(), R, t, false, 100, 8.0, 0.99, inliers);
-            } catch (cv::Exception e) {
-              // After RANSAC number of points may drop below 6 which prevents DLT algorithm to work
-              // This only occurs starting from OpenCV 3, it seems to work fine with OpenCV 2
-              // https://github.com/tum-vision/LDSO/issues/47#issuecomment-605413508
-              LOG(INFO) << "Ransac no inliers from " << p3d.size() << " points" << endl;
-              return false;
-            }
-#endif
-            int cntInliers = 0;
+        // setup pose graph
+        {
+            Sim3 SCurRef = best.Scr;
+            unique_lock<mutex> lock(currentKF->mutexPoseRel);
+            currentKF->poseRel[pKF] = Frame::RELPOSE(SCurRef, best.hessian, true);   // and an pose graph edge
+            pKF->poseRel[currentKF] = Frame::RELPOSE(SCurRef.inverse(), best.hessian, true);
+        }
+
+        if (setting_showLoopClosing) {
+            LOG(INFO) << "please see loop closing between " << currentKF->kfId << " and " << pKF->kfId << endl;
+            setting_pause = true;
+            FeatureMatcher matcher(0.75, true);
+            matcher.DrawMatches(currentKF, pKF, best.inlierMatches);
+            setting_pause = false;
+        }
+
+        setting_pause = false;
+        return true;
+    }
 
-            vector<Match> inlierMatches;
-            for (int k = 0; k < inliers.rows; k++) {
-                inlierMatches.push_back(matches[matchIdx[inliers.at<int>(k, 0)]]);
-                cntInliers++;
+    void LoopClosing::VerifyCandidate_Reductor(shared_ptr<CalibHessian> Hcalib, int min, int max, Vec10 *stats,
+                                               int tid) {
+        for (int i = min; i < max; i++) {
+            if (VerifyCandidate(i, Hcalib)) {
+                // keep the best ranked candidate that passed
+                int first = firstPassed;
+                while (i < first && !firstPassed.compare_exchange_weak(first, i));
             }
+        }
+    }
+
+    bool LoopClosing::VerifyCandidate(int idx, shared_ptr<CalibHessian> Hcalib) {
 
-            if (cntInliers < 10) {
-                LOG(INFO) << "Ransac inlier not enough: " << cntInliers << endl;
-                return false;
+        LoopCandidate &c = candidates[idx];
+        shared_ptr<Frame> pKF = c.kf;
+        // cancelled if a better ranked candidate already passed
+        auto cancelled = [&]() {
+            if (firstPassed < idx) {
+                c.stage = "cancelled";
+                return true;
             }
+            return false;
+        };
+        auto elapsed = [](const chrono::steady_clock::time_point &t0) {
+            return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        };
 
-            LOG(INFO) << "Loop detected from kf " << currentKF->kfId << " to " << pKF->kfId
-                      << ", inlier matches: " << cntInliers << endl;
+        if (cancelled())
+            return false;
 
-            // and then test with the estimated Tcw
-            SE3 TcrEsti(
-            SO3::exp(Vec3(R.at<double>(0, 0), R.at<double>(1, 0), R.at<double>(2, 0))),
-                    Vec3(t.at<double>(0, 0), t.at<double>(1, 0), t.at<double>(2, 0)));
+        // We compute first ORB matches for the candidate
+        auto t0 = chrono::steady_clock::now();
+        c.stage = "bow";
+        FeatureMatcher matcher(0.75, true);
+        vector<Match> matches;
+        int nmatches = matcher.SearchByBoW(currentKF, pKF, matches);
+        c.timeBoW = elapsed(t0);
 
-            Sim3 ScrEsti(TcrEsti.matrix());
-            ScrEsti.setScale(1.0);
+        if (nmatches < 10) {
+            LOG(INFO) << "no enough matches: " << nmatches << endl;
+            return false;
+        }
+        LOG(INFO) << "matches: " << nmatches << endl;
 
-            Mat77 Hessian;
+        if (cancelled())
+            return false;
 
-            if (ComputeOptimizedPose(pKF, ScrEsti, Hcalib, Hessian) == false) {
-                return false;
+        // now we have a candidate proposed by dbow, let's try pnp ransac to see if there are enough inliers
+        t0 = chrono::steady_clock::now();
+        c.stage = "pnp";
+
+        VecVec3f p3d;
+        VecVec2f p2d;
+        vector<int> matchIdx;
+        p3d.reserve(matches.size());
+        p2d.reserve(matches.size());
+
+        for (size_t k = 0; k < matches.size(); k++) {
+            auto &m = matches[k];
+            shared_ptr<Feature> &featKF = pKF->features[m.index2];
+            shared_ptr<Feature> &featCurrent = currentKF->features[m.index1];
+
+            if (featKF->status == Feature::FeatureStatus::VALID &&
+                featKF->point->status != Point::PointStatus::OUTLIER) {
+                // there should be a 3d point
+                // compute 3d pos in ref
+                p3d.push_back((1.0 / featKF->invD) * Vec3f(
+                        Hcalib->fxli() * (featKF->uv[0] - Hcalib->cxl()),
+                        Hcalib->fyli() * (featKF->uv[1] - Hcalib->cyl()),
+                        1
+                ));
+                p2d.push_back(featCurrent->uv);
+                matchIdx.push_back(k);
             }
+        }
 
-            // setup pose graph
-            {
-                Sim3 SCurRef = ScrEsti;
-                unique_lock<mutex> lock(currentKF->mutexPoseRel);
-                currentKF->poseRel[pKF] = Frame::RELPOSE(SCurRef, Hessian, true);   // and an pose graph edge
-                pKF->poseRel[currentKF] = Frame::RELPOSE(SCurRef.inverse(), Hessian, true);
-            }
+        if (p3d.size() < 10) {
+            LOG(INFO) << "3d points not enough: " << p3d.size() << endl;
+            c.timePnP = elapsed(t0);
+            return false;
+        }
 
-            success = true;
+        PnPRansac ransac(Hcalib->fxl(), Hcalib->fyl(), Hcalib->cxl(), Hcalib->cyl(), 8.0, 100, 0.99);
+        SE3 TcrEsti;
+        vector<int> inliers;
+        if (!ransac.Solve(p3d, p2d, TcrEsti, inliers)) {
+            LOG(INFO) << "Ransac no inliers from " << p3d.size() << " points" << endl;
+            c.timePnP = elapsed(t0);
+            return false;
+        }
+        c.timePnP = elapsed(t0);
 
-            if (setting_showLoopClosing && success) {
-                LOG(INFO) << "please see loop closing between " << currentKF->kfId << " and " << pKF->kfId << endl;
-                setting_pause = true;
-                matcher.DrawMatches(currentKF, pKF, inlierMatches);
-                setting_pause = false;
-            }
+        int cntInliers = inliers.size();
+        c.inlierMatches.clear();
+        for (int k: inliers)
+            c.inlierMatches.push_back(matches[matchIdx[k]]);
 
-            setting_pause = false;
+        if (cntInliers < 10) {
+            LOG(INFO) << "Ransac inlier not enough: " << cntInliers << endl;
+            return false;
         }
-        nCandidates++;
-        return success;
+
+        LOG(INFO) << "Loop detected from kf " << currentKF->kfId << " to " << pKF->kfId
+                  << ", inlier matches: " << cntInliers << ", ransac iterations: " << ransac.iterations << endl;
+
+        if (cancelled())
+            return false;
+
+        // and then test with the estimated Tcw
+        t0 = chrono::steady_clock::now();
+        c.stage = "pose";
+        Sim3 ScrEsti(TcrEsti.matrix());
+        ScrEsti.setScale(1.0);
+
+        bool ok = ComputeOptimizedPose(pKF, ScrEsti, Hcalib, c.hessian);
+        c.timePose = elapsed(t0);
+        if (!ok)
+            return false;
+
+        c.Scr = ScrEsti;
+        c.success = true;
+        c.stage = "passed";
+        return true;
     }
 
-    bool LoopClosing::ComputeOptimizedPose(shared_ptr<Frame> pKF, Sim3 &Scr, shared_ptr<CalibHessian> Hcalib,
-                                           Mat77 &H, float windowSize) {
+    void LoopClosing::ComputeIdepthMap() {
 
-        LOG(INFO) << "computing optimized pose" << endl;
-        int TH_HIGH = 50;
         vector<shared_ptr<Frame>> activeFrames = fullSystem->GetActiveFrames();
         // make the idepth map
         memset(idepthMap, 0, sizeof(float) * wG[0] * hG[0]);
@@ -316,10 +356,15 @@ namespace ldso {
             idepthMap[idx + 1 - wG[0]] = idep;
             idepthMap[idx + 1 + wG[0]] = idep;
         }
+    }
 
-        // optimize the current Tcw
-        currentKF->SetFeatureGrid();
+    bool LoopClosing::ComputeOptimizedPose(shared_ptr<Frame> pKF, Sim3 &Scr, shared_ptr<CalibHessian> Hcalib,
+                                           Mat77 &H, float windowSize) {
+
+        LOG(INFO) << "computing optimized pose" << endl;
+        int TH_HIGH = 50;
 
+        // idepthMap and the feature grid of currentKF are set in CorrectLoop
         // vector<shared_ptr<Feature>> matchedFeatures;
         VecVec3 matchedPoints;
         VecVec3 matchedFeatures;
@@ -340,6 +385,9 @@ namespace ldso {
         Ki << Hcalib->fxli(), 0, Hcalib->cxli(), 0, Hcalib->fyli(), Hcalib->cyli(), 0, 0, 1;
 
         // search by projection
+        vector<size_t> candIdx;
+        vector<unsigned char> candDescs;
+        vector<int> candDists;
         for (auto &p: candidateFeatures) {
 
             Vec3 pRef = (1.0 / p->invD) * Vec3(
@@ -358,17 +406,16 @@ namespace ldso {
             int bestDist2 = 256;
             int bestIdx = -1;
 
-            // look for points nearby
+            // look for points nearby, keep the ones with similar rotation and a valid depth
             auto indices = currentKF->GetFeatureInGrid(u, v, windowSize);
             float idepth = 0;
 
+            candIdx.clear();
+            candDescs.clear();
             for (size_t &k: indices) {
                 shared_ptr<Feature> &feat = currentKF->features[k];
                 if (fabsf(feat->angle - p->angle) < 0.2) {
                     // check rotation first
-                    int dist = FeatureMatcher::DescriptorDistance(feat->descriptor,
-                                                                  p->descriptor);
-
                     int ui = int(feat->uv[0] + 0.5f), vi = int(feat->uv[1] + 0.5f);
                     idepth = idepthMap[vi * wG[0] + ui];
 
@@ -377,14 +424,21 @@ namespace ldso {
                         // well in stereo case you can still do this
                         continue;
                     }
+                    candIdx.push_back(k);
+                    candDescs.insert(candDescs.end(), feat->descriptor, feat->descriptor + 32);
+                }
+            }
 
-                    if (dist < bestDist) {
-                        bestDist2 = bestDist;
-                        bestDist = dist;
-                        bestIdx = k;
-                    } else if (dist < bestDist2) {
-                        bestDist2 = dist;
-                    }
+            candDists.resize(candIdx.size());
+            FeatureMatcher::DescriptorDistances(p->descriptor, candDescs.data(), candIdx.size(), candDists.data());
+            for (size_t c = 0; c < candIdx.size(); c++) {
+                int dist = candDists[c];
+                if (dist < bestDist) {
+                    bestDist2 = bestDist;
+                    bestDist = dist;
+                    bestIdx = candIdx[c];
+                } else if (dist < bestDist2) {
+                    bestDist2 = dist;
                 }
             }
 
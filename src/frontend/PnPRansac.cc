@@ -0,0 +1,343 @@
+#include "frontend/PnPRansac.h"
+
+#include <complex>
+#include <random>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace ldso {
+
+    /**
+     * real parts of the roots of a x^4 + b x^3 + c x^2 + d x + e (Ferrari), polished with two Newton steps
+     */
+    static void SolveQuartic(const double *factors, double roots[4]) {
+        const double A = factors[0], B = factors[1], C = factors[2], D = factors[3], E = factors[4];
+
+        const double A_pw2 = A * A, B_pw2 = B * B;
+        const double A_pw3 = A_pw2 * A, B_pw3 = B_pw2 * B;
+        const double A_pw4 = A_pw3 * A, B_pw4 = B_pw3 * B;
+
+        const double alpha = -3 * B_pw2 / (8 * A_pw2) + C / A;
+        const double beta = B_pw3 / (8 * A_pw3) - B * C / (2 * A_pw2) + D / A;
+        const double gamma = -3 * B_pw4 / (256 * A_pw4) + B_pw2 * C / (16 * A_pw3) - B * D / (4 * A_pw2) + E / A;
+
+        const double alpha_pw2 = alpha * alpha, alpha_pw3 = alpha_pw2 * alpha;
+
+        std::complex<double> P(-alpha_pw2 / 12 - gamma, 0);
+        std::complex<double> Q(-alpha_pw3 / 108 + alpha * gamma / 3 - beta * beta / 8, 0);
+        std::complex<double> R = -Q / 2.0 + sqrt(pow(Q, 2.0) / 4.0 + pow(P, 3.0) / 27.0);
+
+        std::complex<double> U = pow(R, (1.0 / 3.0));
+        std::complex<double> y;
+        if (U.real() == 0)
+            y = -5.0 * alpha / 6.0 - pow(Q, (1.0 / 3.0));
+        else
+            y = -5.0 * alpha / 6.0 - P / (3.0 * U) + U;
+
+        std::complex<double> w = sqrt(alpha + 2.0 * y);
+
+        roots[0] = (-B / (4.0 * A) + 0.5 * (w + sqrt(-(3.0 * alpha + 2.0 * y + 2.0 * beta / w)))).real();
+        roots[1] = (-B / (4.0 * A) + 0.5 * (w - sqrt(-(3.0 * alpha + 2.0 * y + 2.0 * beta / w)))).real();
+        roots[2] = (-B / (4.0 * A) + 0.5 * (-w + sqrt(-(3.0 * alpha + 2.0 * y - 2.0 * beta / w)))).real();
+        roots[3] = (-B / (4.0 * A) + 0.5 * (-w - sqrt(-(3.0 * alpha + 2.0 * y - 2.0 * beta / w)))).real();
+
+        for (int i = 0; i < 4; i++) {
+            double x = roots[i];
+            for (int it = 0; it < 2; it++) {
+                double f = (((A * x + B) * x + C) * x + D) * x + E;
+                double df = ((4 * A * x + 3 * B) * x + 2 * C) * x + D;
+                if (fabs(df) < 1e-12) break;
+                x -= f / df;
+            }
+            roots[i] = x;
+        }
+    }
+
+    PnPRansac::PnPRansac(float fx, float fy, float cx, float cy, float reprojTH, int maxIterations,
+                         float confidence) :
+            fx(fx), fy(fy), cx(cx), cy(cy), th2(reprojTH * reprojTH), maxIterations(maxIterations),
+            confidence(confidence) {}
+
+    bool PnPRansac::Solve(const VecVec3f &points, const VecVec2f &pixels, SE3 &Tcr, vector<int> &inliers) {
+        assert(points.size() == pixels.size());
+        const int n = points.size();
+        inliers.clear();
+        iterations = 0;
+        if (n < 4)
+            return false;
+
+        X.resize(n);
+        Y.resize(n);
+        Z.resize(n);
+        u.resize(n);
+        v.resize(n);
+        for (int i = 0; i < n; i++) {
+            X[i] = points[i][0];
+            Y[i] = points[i][1];
+            Z[i] = points[i][2];
+            u[i] = pixels[i][0];
+            v[i] = pixels[i][1];
+        }
+
+        std::mt19937 rng(n);    // deterministic for a given problem size
+        std::uniform_int_distribution<int> dist(0, n - 1);
+
+        int bestCount = 0;
+        SE3 bestT;
+        int neededIterations = maxIterations;
+        const double logConf = log(1.0 - confidence);
+
+        for (iterations = 0; iterations < neededIterations; iterations++) {
+            int idx[3];
+            idx[0] = dist(rng);
+            do idx[1] = dist(rng); while (idx[1] == idx[0]);
+            do idx[2] = dist(rng); while (idx[2] == idx[0] || idx[2] == idx[1]);
+
+            Vec3 P[3], f[3];
+            for (int k = 0; k < 3; k++) {
+                P[k] = points[idx[k]].cast<double>();
+                f[k] = Vec3((pixels[idx[k]][0] - cx) / fx, (pixels[idx[k]][1] - cy) / fy, 1).normalized();
+            }
+
+            SE3 solutions[4];
+            int nsol = P3P(P, f, solutions);
+            for (int s = 0; s < nsol; s++) {
+                int count = CountInliers(solutions[s], bestCount);
+                if (count > bestCount) {
+                    bestCount = count;
+                    bestT = solutions[s];
+
+                    // adapt the number of iterations to the inlier ratio
+                    double w = double(bestCount) / n;
+                    double pNoOutlier = 1.0 - w * w * w;
+                    if (pNoOutlier <= 0)
+                        neededIterations = 0;
+                    else if (pNoOutlier < 1)
+                        neededIterations = std::min(maxIterations, int(ceil(logConf / log(pNoOutlier))));
+                }
+            }
+        }
+
+        if (bestCount < 4)
+            return false;
+
+        GetInliers(bestT, inliers);
+        SE3 refined = bestT;
+        Refine(refined, inliers);
+        if (CountInliers(refined, 0) >= int(inliers.size())) {
+            bestT = refined;
+            GetInliers(bestT, inliers);
+        }
+
+        Tcr = bestT;
+        return true;
+    }
+
+    int PnPRansac::P3P(const Vec3 P[3], const Vec3 f[3], SE3 solutions[4]) {
+
+        Vec3 P1 = P[0], P2 = P[1], P3 = P[2];
+
+        // degenerate if the world points are collinear, up to the float precision the points come in
+        if ((P2 - P1).cross(P3 - P1).norm() < 1e-5 * (P2 - P1).norm() * (P3 - P1).norm())
+            return 0;
+
+        Vec3 f1 = f[0], f2 = f[1], f3 = f[2];
+
+        // intermediate camera frame
+        Vec3 e1 = f1;
+        Vec3 e3 = f1.cross(f2);
+        if (e3.norm() < 1e-10)
+            return 0;
+        e3.normalize();
+        Vec3 e2 = e3.cross(e1);
+        Mat33 T;
+        T.row(0) = e1.transpose();
+        T.row(1) = e2.transpose();
+        T.row(2) = e3.transpose();
+        f3 = T * f3;
+
+        // enforce theta within [0, pi] by swapping the first two points
+        if (f3[2] > 0) {
+            std::swap(f1, f2);
+            std::swap(P1, P2);
+
+            e1 = f1;
+            e3 = f1.cross(f2).normalized();
+            e2 = e3.cross(e1);
+            T.row(0) = e1.transpose();
+            T.row(1) = e2.transpose();
+            T.row(2) = e3.transpose();
+            f3 = T * f[2];
+        }
+
+        // intermediate world frame
+        Vec3 n1 = P2 - P1;
+        double d_12 = n1.norm();
+        n1 /= d_12;
+        Vec3 n3 = n1.cross(P3 - P1).normalized();
+        Vec3 n2 = n3.cross(n1);
+        Mat33 N;
+        N.row(0) = n1.transpose();
+        N.row(1) = n2.transpose();
+        N.row(2) = n3.transpose();
+        Vec3 P3n = N * (P3 - P1);
+
+        double phi_1 = f3[0] / f3[2];
+        double phi_2 = f3[1] / f3[2];
+        double p_1 = P3n[0];
+        double p_2 = P3n[1];
+
+        double cos_beta = f1.dot(f2);
+        double b = 1 / (1 - cos_beta * cos_beta) - 1;
+        b = cos_beta < 0 ? -sqrt(b) : sqrt(b);
+
+        double phi_1_pw2 = phi_1 * phi_1;
+        double phi_2_pw2 = phi_2 * phi_2;
+        double p_1_pw2 = p_1 * p_1;
+        double p_1_pw3 = p_1_pw2 * p_1;
+        double p_1_pw4 = p_1_pw3 * p_1;
+        double p_2_pw2 = p_2 * p_2;
+        double p_2_pw3 = p_2_pw2 * p_2;
+        double p_2_pw4 = p_2_pw3 * p_2;
+        double d_12_pw2 = d_12 * d_12;
+        double b_pw2 = b * b;
+
+        double factors[5];
+        factors[0] = -phi_2_pw2 * p_2_pw4 - p_2_pw4 * phi_1_pw2 - p_2_pw4;
+        factors[1] = 2 * p_2_pw3 * d_12 * b + 2 * phi_2_pw2 * p_2_pw3 * d_12 * b - 2 * phi_2 * p_2_pw3 * phi_1 * d_12;
+        factors[2] = -phi_2_pw2 * p_2_pw2 * p_1_pw2 - phi_2_pw2 * p_2_pw2 * d_12_pw2 * b_pw2 -
+                     phi_2_pw2 * p_2_pw2 * d_12_pw2 + phi_2_pw2 * p_2_pw4 + p_2_pw4 * phi_1_pw2 +
+                     2 * p_1 * p_2_pw2 * d_12 + 2 * phi_1 * phi_2 * p_1 * p_2_pw2 * d_12 * b -
+                     p_2_pw2 * p_1_pw2 * phi_1_pw2 + 2 * p_1 * p_2_pw2 * phi_2_pw2 * d_12 -
+                     p_2_pw2 * d_12_pw2 * b_pw2 - 2 * p_1_pw2 * p_2_pw2;
+        factors[3] = 2 * p_1_pw2 * p_2 * d_12 * b + 2 * phi_2 * p_2_pw3 * phi_1 * d_12 -
+                     2 * phi_2_pw2 * p_2_pw3 * d_12 * b - 2 * p_1 * p_2 * d_12_pw2 * b;
+        factors[4] = -2 * phi_2 * p_2_pw2 * phi_1 * p_1 * d_12 * b + phi_2_pw2 * p_2_pw2 * d_12_pw2 +
+                     2 * p_1_pw3 * d_12 - p_1_pw2 * d_12_pw2 + phi_2_pw2 * p_2_pw2 * p_1_pw2 - p_1_pw4 -
+                     2 * phi_2_pw2 * p_2_pw2 * p_1 * d_12 + p_2_pw2 * phi_1_pw2 * p_1_pw2 +
+                     phi_2_pw2 * p_2_pw2 * d_12_pw2 * b_pw2;
+
+        double roots[4];
+        SolveQuartic(factors, roots);
+
+        int nsol = 0;
+        for (int i = 0; i < 4; i++) {
+            double cos_theta = roots[i];
+            if (!std::isfinite(cos_theta) || fabs(cos_theta) > 1)
+                continue;
+
+            double cot_alpha = (-phi_1 * p_1 / phi_2 - cos_theta * p_2 + d_12 * b) /
+                               (-phi_1 * cos_theta * p_2 / phi_2 + p_1 - d_12);
+
+            double sin_theta = sqrt(1 - cos_theta * cos_theta);
+            double sin_alpha = sqrt(1 / (cot_alpha * cot_alpha + 1));
+            double cos_alpha = sqrt(1 - sin_alpha * sin_alpha);
+            if (cot_alpha < 0)
+                cos_alpha = -cos_alpha;
+            if (!std::isfinite(cos_alpha) || !std::isfinite(sin_alpha))
+                continue;
+
+            // camera center and orientation in the reference frame
+            Vec3 C(d_12 * cos_alpha * (sin_alpha * b + cos_alpha),
+                   cos_theta * d_12 * sin_alpha * (sin_alpha * b + cos_alpha),
+                   sin_theta * d_12 * sin_alpha * (sin_alpha * b + cos_alpha));
+            C = P1 + N.transpose() * C;
+
+            Mat33 R;
+            R << -cos_alpha, -sin_alpha * cos_theta, -sin_alpha * sin_theta,
+                    sin_alpha, -cos_alpha * cos_theta, -cos_alpha * sin_theta,
+                    0, -sin_theta, cos_theta;
+            R = N.transpose() * R.transpose() * T;
+
+            // R rotates current to reference, make it a proper rotation before building the SE3
+            Eigen::JacobiSVD<Mat33> svd(R, Eigen::ComputeFullU | Eigen::ComputeFullV);
+            Mat33 Rrc = svd.matrixU() * svd.matrixV().transpose();
+            if (Rrc.determinant() < 0)
+                continue;
+
+            // the real parts of complex roots, and roots that put the points behind the camera, also give poses:
+            // keep only those that map the three points onto their bearings
+            SE3 Tcr(Rrc.transpose(), -Rrc.transpose() * C);
+            bool consistent = true;
+            for (int k = 0; k < 3; k++) {
+                Vec3 pc = Tcr * P[k];
+                consistent = consistent && f[k].dot(pc) > (1 - 1e-8) * pc.norm();
+            }
+            if (consistent)
+                solutions[nsol++] = Tcr;
+        }
+        return nsol;
+    }
+
+    int PnPRansac::CountInliers(const SE3 &Tcr, int bestCount) const {
+        typedef Eigen::Array<float, Eigen::Dynamic, 1, 0, CHUNK, 1> ArrayChunk;
+
+        const Mat33f R = Tcr.rotationMatrix().cast<float>();
+        const Vec3f t = Tcr.translation().cast<float>();
+        const int n = X.size();
+
+        int count = 0;
+        for (int s = 0; s < n; s += CHUNK) {
+            const int m = std::min(int(CHUNK), n - s);
+            ArrayChunk x = R(0, 0) * X.segment(s, m) + R(0, 1) * Y.segment(s, m) + R(0, 2) * Z.segment(s, m) + t[0];
+            ArrayChunk y = R(1, 0) * X.segment(s, m) + R(1, 1) * Y.segment(s, m) + R(1, 2) * Z.segment(s, m) + t[1];
+            ArrayChunk z = R(2, 0) * X.segment(s, m) + R(2, 1) * Y.segment(s, m) + R(2, 2) * Z.segment(s, m) + t[2];
+            ArrayChunk iz = z.inverse();
+            ArrayChunk du = fx * x * iz + cx - u.segment(s, m);
+            ArrayChunk dv = fy * y * iz + cy - v.segment(s, m);
+            count += ((du.square() + dv.square() < th2) && (z > 0)).count();
+
+            // the remaining points can't make this hypothesis better than the best one
+            if (count + (n - s - m) <= bestCount)
+                return count;
+        }
+        return count;
+    }
+
+    void PnPRansac::GetInliers(const SE3 &Tcr, vector<int> &inliers) const {
+        const Mat33f R = Tcr.rotationMatrix().cast<float>();
+        const Vec3f t = Tcr.translation().cast<float>();
+        inliers.clear();
+        for (int i = 0; i < X.size(); i++) {
+            Vec3f pc = R * Vec3f(X[i], Y[i], Z[i]) + t;
+            if (pc[2] <= 0)
+                continue;
+            float du = fx * pc[0] / pc[2] + cx - u[i];
+            float dv = fy * pc[1] / pc[2] + cy - v[i];
+            if (du * du + dv * dv < th2)
+                inliers.push_back(i);
+        }
+    }
+
+    void PnPRansac::Refine(SE3 &Tcr, const vector<int> &inliers) const {
+        for (int it = 0; it < 5; it++) {
+            Mat66 H = Mat66::Zero();
+            Vec6 b = Vec6::Zero();
+            for (int i: inliers) {
+                Vec3 pc = Tcr * Vec3(X[i], Y[i], Z[i]);
+                if (pc[2] <= 0)
+                    continue;
+                double iz = 1.0 / pc[2];
+                Vec2 e(fx * pc[0] * iz + cx - u[i], fy * pc[1] * iz + cy - v[i]);
+
+                // derivative of the projection w.r.t. a left perturbation (translation, rotation)
+                Eigen::Matrix<double, 2, 3> dp;
+                dp << fx * iz, 0, -fx * pc[0] * iz * iz,
+                        0, fy * iz, -fy * pc[1] * iz * iz;
+                Eigen::Matrix<double, 2, 6> J;
+                J.leftCols<3>() = dp;
+                J.rightCols<3>() = -dp * SO3::hat(pc);
+
+                H.noalias() += J.transpose() * J;
+                b.noalias() += J.transpose() * e;
+            }
+            Vec6 dx = -H.ldlt().solve(b);
+            if (!dx.allFinite())
+                return;
+            Tcr = SE3::exp(dx) * Tcr;
+            if (dx.norm() < 1e-8)
+                return;
+        }
+    }
+}
@@ -45,9 +45,9 @@ namespace ldso {
          * * SKIP -> point has not been updated.
          */
         ImmaturePointStatus ImmaturePoint::traceOn(
-                shared_ptr<FrameHessian> frame, const Mat33f &hostToFrame_KRKi,
+                const shared_ptr<FrameHessian> &frame, const Mat33f &hostToFrame_KRKi,
                 const Vec3f &hostToFrame_Kt, const Vec2f &hostToFrame_affine,
-                shared_ptr<CalibHessian> HCalib) {
+                const shared_ptr<CalibHessian> &HCalib) {
 
             if (lastTraceStatus == ImmaturePointStatus::IPS_OOB) return lastTraceStatus;
             float maxPixSearch = (wG[0] + hG[0]) * setting_maxPixSearch;
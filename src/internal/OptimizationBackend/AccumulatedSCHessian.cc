@@ -9,7 +9,7 @@ namespace ldso {
         void AccumulatedSCHessianSSE::addPoint(shared_ptr<PointHessian> p, bool shiftPriorToZero, int tid) {
 
             int ngoodres = 0;
-            for (auto r : p->residuals)
+            for (auto &r : p->residuals)
                 if (r->isActive())
                     ngoodres++;
 
@@ -33,26 +33,45 @@ namespace ldso {
 
             assert(std::isfinite((float) (p->HdiF)));
 
-            int nFrames2 = nframes[tid] * nframes[tid];
-            for (auto r1 : p->residuals) {
+            for (auto &r1 : p->residuals) {
                 if (!r1->isActive()) continue;
                 int r1ht = r1->hostIDX + r1->targetIDX * nframes[tid];
+                pairUsed[tid][r1ht] = 1;
+                const Vec8f &JpJdF1 = r1->block->JpJdF[r1->blockIdx];
 
-                for (auto r2 : p->residuals) {
+                for (auto &r2 : p->residuals) {
                     if (!r2->isActive())
                         continue;
 
-                    accD[tid][r1ht + r2->targetIDX * nFrames2].update(r1->JpJdF, r2->JpJdF, p->HdiF);
+                    blockD(r1ht * nframes[tid] + r2->targetIDX, tid).update(
+                            JpJdF1, r2->block->JpJdF[r2->blockIdx], p->HdiF);
                 }
 
-                accE[tid][r1ht].update(r1->JpJdF, Hcd, p->HdiF);
-                accEB[tid][r1ht].update(r1->JpJdF, p->HdiF * p->bdSumF);
+                accE[tid][r1ht].update(JpJdF1, Hcd, p->HdiF);
+                accEB[tid][r1ht].update(JpJdF1, p->HdiF * p->bdSumF);
             }
         }
 
-        void AccumulatedSCHessianSSE::stitchDoubleInternal(
-                MatXX *H, VecX *b, EnergyFunctional const *const EF,
-                int min, int max, Vec10 *stats, int tid) {
+        void AccumulatedSCHessianSSE::getAdjoints(EnergyFunctional const *const EF, const Mat88 *&adHost,
+                                                  const Mat88 *&adTarget) {
+            adHost = EF->adHost;
+            adTarget = EF->adTarget;
+        }
+
+        void AccumulatedSCHessianSSE::getAdjoints(EnergyFunctional const *const EF, const Mat88f *&adHost,
+                                                  const Mat88f *&adTarget) {
+            adHost = EF->adHostF;
+            adTarget = EF->adTargetF;
+        }
+
+        template<typename T>
+        void AccumulatedSCHessianSSE::stitchInternal(
+                Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H, Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                EnergyFunctional const *const EF, int min, int max, Vec10 *stats, int tid) {
+            typedef Eigen::Matrix<T, 8, 8> Mat88T;
+            typedef Eigen::Matrix<T, 8, CPARS> Mat8CT;
+            typedef Eigen::Matrix<T, 8, 1> Vec8T;
+
             int toAggregate = NUM_THREADS;
             if (tid == -1) {
                 toAggregate = 1;
@@ -60,9 +79,10 @@ namespace ldso {
             }    // special case: if we dont do multithreading, dont aggregate.
             if (min == max) return;
 
+            const Mat88T *adHost, *adTarget;
+            getAdjoints(EF, adHost, adTarget);
 
             int nf = nframes[0];
-            int nframes2 = nf * nf;
 
             for (int k = min; k < max; k++) {
                 int i = k % nf;
@@ -72,39 +92,49 @@ namespace ldso {
                 int jIdx = CPARS + j * 8;
                 int ijIdx = i + nf * j;
 
-                Mat8C Hpc = Mat8C::Zero();
-                Vec8 bp = Vec8::Zero();
+                // pairs without residuals contribute nothing
+                bool used = false;
+                for (int tid2 = 0; tid2 < toAggregate; tid2++)
+                    used = used || pairUsed[tid2][ijIdx];
+                if (!used) continue;
+
+                Mat8CT Hpc = Mat8CT::Zero();
+                Vec8T bp = Vec8T::Zero();
 
                 for (int tid2 = 0; tid2 < toAggregate; tid2++) {
+                    if (!pairUsed[tid2][ijIdx]) continue;
                     accE[tid2][ijIdx].finish();
                     accEB[tid2][ijIdx].finish();
-                    Hpc += accE[tid2][ijIdx].A1m.cast<double>();
-                    bp += accEB[tid2][ijIdx].A1m.cast<double>();
+                    Hpc += accE[tid2][ijIdx].A1m.template cast<T>();
+                    bp += accEB[tid2][ijIdx].A1m.template cast<T>();
                 }
 
-                H[tid].block<8, CPARS>(iIdx, 0) += EF->adHost[ijIdx] * Hpc;
-                H[tid].block<8, CPARS>(jIdx, 0) += EF->adTarget[ijIdx] * Hpc;
-                b[tid].segment<8>(iIdx) += EF->adHost[ijIdx] * bp;
-                b[tid].segment<8>(jIdx) += EF->adTarget[ijIdx] * bp;
+                H[tid].template block<8, CPARS>(iIdx, 0) += adHost[ijIdx] * Hpc;
+                H[tid].template block<8, CPARS>(jIdx, 0) += adTarget[ijIdx] * Hpc;
+                b[tid].template segment<8>(iIdx) += adHost[ijIdx] * bp;
+                b[tid].template segment<8>(jIdx) += adTarget[ijIdx] * bp;
 
 
                 for (int k = 0; k < nf; k++) {
                     int kIdx = CPARS + k * 8;
-                    int ijkIdx = ijIdx + k * nframes2;
                     int ikIdx = i + nf * k;
 
-                    Mat88 accDM = Mat88::Zero();
+                    Mat88T accDM = Mat88T::Zero();
 
+                    bool haveD = false;
                     for (int tid2 = 0; tid2 < toAggregate; tid2++) {
-                        accD[tid2][ijkIdx].finish();
-                        if (accD[tid2][ijkIdx].num == 0) continue;
-                        accDM += accD[tid2][ijkIdx].A1m.cast<double>();
+                        const int slot = slotD[tid2][ijIdx * nf + k];
+                        if (slot < 0) continue;
+                        accD[tid2][slot].finish();
+                        accDM += accD[tid2][slot].A1m.template cast<T>();
+                        haveD = true;
                     }
+                    if (!haveD) continue;
 
-                    H[tid].block<8, 8>(iIdx, iIdx) += EF->adHost[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-                    H[tid].block<8, 8>(jIdx, kIdx) += EF->adTarget[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
-                    H[tid].block<8, 8>(jIdx, iIdx) += EF->adTarget[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-                    H[tid].block<8, 8>(iIdx, kIdx) += EF->adHost[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
+                    H[tid].template block<8, 8>(iIdx, iIdx) += adHost[ijIdx] * accDM * adHost[ikIdx].transpose();
+                    H[tid].template block<8, 8>(jIdx, kIdx) += adTarget[ijIdx] * accDM * adTarget[ikIdx].transpose();
+                    H[tid].template block<8, 8>(jIdx, iIdx) += adTarget[ijIdx] * accDM * adHost[ikIdx].transpose();
+                    H[tid].template block<8, 8>(iIdx, kIdx) += adHost[ijIdx] * accDM * adTarget[ikIdx].transpose();
                 }
             }
 
@@ -112,16 +142,21 @@ namespace ldso {
                 for (int tid2 = 0; tid2 < toAggregate; tid2++) {
                     accHcc[tid2].finish();
                     accbc[tid2].finish();
-                    H[tid].topLeftCorner<CPARS, CPARS>() += accHcc[tid2].A1m.cast<double>();
-                    b[tid].head<CPARS>() += accbc[tid2].A1m.cast<double>();
+                    H[tid].template topLeftCorner<CPARS, CPARS>() += accHcc[tid2].A1m.template cast<T>();
+                    b[tid].template head<CPARS>() += accbc[tid2].A1m.template cast<T>();
                 }
             }
         }
 
+        template void AccumulatedSCHessianSSE::stitchInternal<double>(
+                MatXX *H, VecX *b, EnergyFunctional const *const EF, int min, int max, Vec10 *stats, int tid);
+
+        template void AccumulatedSCHessianSSE::stitchInternal<float>(
+                MatXXf *H, VecXf *b, EnergyFunctional const *const EF, int min, int max, Vec10 *stats, int tid);
+
         void AccumulatedSCHessianSSE::stitchDouble(MatXX &H, VecX &b, const EnergyFunctional *const EF, int tid) {
 
             int nf = nframes[0];
-            int nframes2 = nf * nf;
 
             H = MatXX::Zero(nf * 8 + CPARS, nf * 8 + CPARS);
             b = VecX::Zero(nf * 8 + CPARS);
@@ -133,6 +168,7 @@ namespace ldso {
                     int jIdx = CPARS + j * 8;
                     int ijIdx = i + nf * j;
 
+                    if (!pairUsed[tid][ijIdx]) continue;
                     accE[tid][ijIdx].finish();
                     accEB[tid][ijIdx].finish();
 
@@ -147,12 +183,12 @@ namespace ldso {
 
                     for (int k = 0; k < nf; k++) {
                         int kIdx = CPARS + k * 8;
-                        int ijkIdx = ijIdx + k * nframes2;
                         int ikIdx = i + nf * k;
 
-                        accD[tid][ijkIdx].finish();
-                        if (accD[tid][ijkIdx].num == 0) continue;
-                        Mat88 accDM = accD[tid][ijkIdx].A1m.cast<double>();
+                        const int slot = slotD[tid][ijIdx * nf + k];
+                        if (slot < 0) continue;
+                        accD[tid][slot].finish();
+                        Mat88 accDM = accD[tid][slot].A1m.cast<double>();
 
                         H.block<8, 8>(iIdx, iIdx) += EF->adHost[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
 
@@ -1,102 +1,119 @@
 #include "internal/OptimizationBackend/AccumulatedTopHessian.h"
 #include "internal/OptimizationBackend/EnergyFunctional.h"
+#include "internal/Residuals.h"
 
 namespace ldso {
 
     namespace internal {
 
         template<int mode>
-        void AccumulatedTopHessianSSE::addPoint(shared_ptr<PointHessian> p, EnergyFunctional const *const ef,
-                                                int tid) { // 0 = active, 1 = linearized, 2=marginalize
+        void AccumulatedTopHessianSSE::addSlot(const ResidualBlock &blk, int i, AccumulatorApprox &a,
+                                               const Mat18f &dp, const VecCf &dc, float dd, int tid,
+                                               float &bd, float &Hdd, VecCf &Hcd) {
+            // 0 = active, 1 = linearized, 2=marginalize
+            const Vec6f *Jpdxi[2] = {&blk.Jpdxi[0][i], &blk.Jpdxi[1][i]};
+            const VecCf *Jpdc[2] = {&blk.Jpdc[0][i], &blk.Jpdc[1][i]};
+            const Vec2f &Jpdd = blk.Jpdd[i];
+            const float *JIdx0 = blk.JIdx[0][i].data(), *JIdx1 = blk.JIdx[1][i].data();
+            const float *JabF0 = blk.JabF[0][i].data(), *JabF1 = blk.JabF[1][i].data();
+            const Mat22f &JIdx2 = blk.JIdx2[i];
+            const Mat22f &JabJIdx = blk.JabJIdx[i];
+            const Mat22f &Jab2 = blk.Jab2[i];
+
+            VecNRf resApprox;
+            if (mode == 0)
+                resApprox = blk.resF[i];
+            if (mode == 2)
+                resApprox = blk.resToZeroF[i];
+            if (mode == 1) {
+                // compute Jp*delta
+                __m128 Jp_delta_x = _mm_set1_ps(Jpdxi[0]->dot(dp.head<6>()) + Jpdc[0]->dot(dc) + Jpdd[0] * dd);
+                __m128 Jp_delta_y = _mm_set1_ps(Jpdxi[1]->dot(dp.head<6>()) + Jpdc[1]->dot(dc) + Jpdd[1] * dd);
+                __m128 delta_a = _mm_set1_ps((float) (dp[6]));
+                __m128 delta_b = _mm_set1_ps((float) (dp[7]));
+
+                const float *resToZeroF = blk.resToZeroF[i].data();
+                for (int k = 0; k < patternNum; k += 4) {
+                    // PATTERN: rtz = resF - [JI*Jp Ja]*delta.
+                    __m128 rtz = _mm_load_ps(resToZeroF + k);
+                    rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(JIdx0 + k), Jp_delta_x));
+                    rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(JIdx1 + k), Jp_delta_y));
+                    rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(JabF0 + k), delta_a));
+                    rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(JabF1 + k), delta_b));
+                    _mm_store_ps(((float *) &resApprox) + k, rtz);
+                }
+            }
 
+            // need to compute JI^T * r, and Jab^T * r. (both are 2-vectors).
+            Vec2f JI_r(0, 0);
+            Vec2f Jab_r(0, 0);
+            float rr = 0;
+            for (int k = 0; k < patternNum; k++) {
+                JI_r[0] += resApprox[k] * JIdx0[k];
+                JI_r[1] += resApprox[k] * JIdx1[k];
+                Jab_r[0] += resApprox[k] * JabF0[k];
+                Jab_r[1] += resApprox[k] * JabF1[k];
+                rr += resApprox[k] * resApprox[k];
+            }
 
-            assert(mode == 0 || mode == 1 || mode == 2);
+            a.update(
+                    Jpdc[0]->data(), Jpdxi[0]->data(),
+                    Jpdc[1]->data(), Jpdxi[1]->data(),
+                    JIdx2(0, 0), JIdx2(0, 1), JIdx2(1, 1));
 
-            VecCf dc = ef->cDeltaF;
-            float dd = p->deltaF;
+            a.updateBotRight(
+                    Jab2(0, 0), Jab2(0, 1), Jab_r[0],
+                    Jab2(1, 1), Jab_r[1], rr);
 
-            float bd_acc = 0;
-            float Hdd_acc = 0;
-            VecCf Hcd_acc = VecCf::Zero();
+            a.updateTopRight(
+                    Jpdc[0]->data(), Jpdxi[0]->data(),
+                    Jpdc[1]->data(), Jpdxi[1]->data(),
+                    JabJIdx(0, 0), JabJIdx(0, 1),
+                    JabJIdx(1, 0), JabJIdx(1, 1),
+                    JI_r[0], JI_r[1]);
 
-            for (shared_ptr<PointFrameResidual> &r : p->residuals) {
-                if (mode == 0) {
-                    if (r->isLinearized || !r->isActive())
-                        continue;
-                }
-                if (mode == 1) {
-                    if (!r->isLinearized || !r->isActive())
-                        continue;
-                }
-                if (mode == 2) {    // marginalize, must be already linearized
-                    if (!r->isActive())
-                        continue;
-                    assert(r->isLinearized);
-                }
+            Vec2f Ji2_Jpdd = JIdx2 * Jpdd;
+            bd = JI_r[0] * Jpdd[0] + JI_r[1] * Jpdd[1];
+            Hdd = Ji2_Jpdd.dot(Jpdd);
+            Hcd = *Jpdc[0] * Ji2_Jpdd[0] + *Jpdc[1] * Ji2_Jpdd[1];
 
-                shared_ptr<RawResidualJacobian> rJ = r->J;
-                int htIDX = r->hostIDX + r->targetIDX * nframes[tid];
-                Mat18f dp = ef->adHTdeltaF[htIDX];
-
-                VecNRf resApprox;
-                if (mode == 0)
-                    resApprox = rJ->resF;
-                if (mode == 2)
-                    resApprox = r->res_toZeroF;
-                if (mode == 1) {
-                    // compute Jp*delta
-                    __m128 Jp_delta_x = _mm_set1_ps(
-                            rJ->Jpdxi[0].dot(dp.head<6>()) + rJ->Jpdc[0].dot(dc) + rJ->Jpdd[0] * dd);
-                    __m128 Jp_delta_y = _mm_set1_ps(
-                            rJ->Jpdxi[1].dot(dp.head<6>()) + rJ->Jpdc[1].dot(dc) + rJ->Jpdd[1] * dd);
-                    __m128 delta_a = _mm_set1_ps((float) (dp[6]));
-                    __m128 delta_b = _mm_set1_ps((float) (dp[7]));
-
-                    for (int i = 0; i < patternNum; i += 4) {
-                        // PATTERN: rtz = resF - [JI*Jp Ja]*delta.
-                        __m128 rtz = _mm_load_ps(((float *) &r->res_toZeroF) + i);
-                        rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JIdx)) + i), Jp_delta_x));
-                        rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JIdx + 1)) + i), Jp_delta_y));
-                        rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JabF)) + i), delta_a));
-                        rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JabF + 1)) + i), delta_b));
-                        _mm_store_ps(((float *) &resApprox) + i, rtz);
-                    }
-                }
-
-                // need to compute JI^T * r, and Jab^T * r. (both are 2-vectors).
-                Vec2f JI_r(0, 0);
-                Vec2f Jab_r(0, 0);
-                float rr = 0;
-                for (int i = 0; i < patternNum; i++) {
-                    JI_r[0] += resApprox[i] * rJ->JIdx[0][i];
-                    JI_r[1] += resApprox[i] * rJ->JIdx[1][i];
-                    Jab_r[0] += resApprox[i] * rJ->JabF[0][i];
-                    Jab_r[1] += resApprox[i] * rJ->JabF[1][i];
-                    rr += resApprox[i] * resApprox[i];
-                }
-
-                acc[tid][htIDX].update(
-                        rJ->Jpdc[0].data(), rJ->Jpdxi[0].data(),
-                        rJ->Jpdc[1].data(), rJ->Jpdxi[1].data(),
-                        rJ->JIdx2(0, 0), rJ->JIdx2(0, 1), rJ->JIdx2(1, 1));
-
-                acc[tid][htIDX].updateBotRight(
-                        rJ->Jab2(0, 0), rJ->Jab2(0, 1), Jab_r[0],
-                        rJ->Jab2(1, 1), Jab_r[1], rr);
+            nres[tid]++;
+        }
 
-                acc[tid][htIDX].updateTopRight(
-                        rJ->Jpdc[0].data(), rJ->Jpdxi[0].data(),
-                        rJ->Jpdc[1].data(), rJ->Jpdxi[1].data(),
-                        rJ->JabJIdx(0, 0), rJ->JabJIdx(0, 1),
-                        rJ->JabJIdx(1, 0), rJ->JabJIdx(1, 1),
-                        JI_r[0], JI_r[1]);
+        template<int mode>
+        void AccumulatedTopHessianSSE::addBlock(ResidualBlock *blk, EnergyFunctional const *const ef, int tid) {
+            static_assert(mode == 0 || mode == 1, "addBlock accumulates the active or the linearized residuals");
+
+            const int htIDX = blk->host->idx + blk->target->idx * nframes[tid];
+            const Mat18f &dp = ef->adHTdeltaF[htIDX];
+            const VecCf &dc = ef->cDeltaF;
+
+            AccumulatorApprox *a = nullptr;
+            const int n = blk->size();
+            for (int i = 0; i < n; i++) {
+                if (!blk->active[i] || blk->linearized[i] != (mode == 1))
+                    continue;
+                if (a == nullptr)
+                    a = blockTop(htIDX, tid);
+                const float dd = mode == 1 ? blk->residuals[i]->getPoint()->deltaF : 0;
+                addSlot<mode>(*blk, i, *a, dp, dc, dd, tid, blk->bd[i], blk->Hdd[i], blk->Hcd[i]);
+            }
+        }
 
-                Vec2f Ji2_Jpdd = rJ->JIdx2 * rJ->Jpdd;
-                bd_acc += JI_r[0] * rJ->Jpdd[0] + JI_r[1] * rJ->Jpdd[1];
-                Hdd_acc += Ji2_Jpdd.dot(rJ->Jpdd);
-                Hcd_acc += rJ->Jpdc[0] * Ji2_Jpdd[0] + rJ->Jpdc[1] * Ji2_Jpdd[1];
+        template<int mode>
+        void AccumulatedTopHessianSSE::addPointSums(PointHessian *p) {
+            float bd_acc = 0;
+            float Hdd_acc = 0;
+            VecCf Hcd_acc = VecCf::Zero();
 
-                nres[tid]++;
+            for (shared_ptr<PointFrameResidual> &r : p->residuals) {
+                const ResidualBlock *blk = r->block;
+                const int i = r->blockIdx;
+                if (!blk->active[i] || blk->linearized[i] != (mode == 1))
+                    continue;
+                bd_acc += blk->bd[i];
+                Hdd_acc += blk->Hdd[i];
+                Hcd_acc += blk->Hcd[i];
             }
 
             if (mode == 0) {
@@ -104,27 +121,63 @@ namespace ldso {
                 p->bd_accAF = bd_acc;
                 p->Hcd_accAF = Hcd_acc;
             }
-            if (mode == 1 || mode == 2) {
+            if (mode == 1) {
                 p->Hdd_accLF = Hdd_acc;
                 p->bd_accLF = bd_acc;
                 p->Hcd_accLF = Hcd_acc;
             }
-            if (mode == 2) {
-                p->Hcd_accAF.setZero();
-                p->Hdd_accAF = 0;
-                p->bd_accAF = 0;
+        }
+
+        template<int mode>
+        void AccumulatedTopHessianSSE::addPoint(shared_ptr<PointHessian> p, EnergyFunctional const *const ef,
+                                                int tid) {
+            static_assert(mode == 2, "addPoint marginalizes a point, the window is accumulated by addBlock");
+
+            VecCf dc = ef->cDeltaF;
+            float dd = p->deltaF;
+
+            float bd_acc = 0;
+            float Hdd_acc = 0;
+            VecCf Hcd_acc = VecCf::Zero();
+
+            for (shared_ptr<PointFrameResidual> &r : p->residuals) {
+                // marginalize, must be already linearized
+                if (!r->isActive())
+                    continue;
+                assert(r->isLinearized());
+
+                int htIDX = r->hostIDX + r->targetIDX * nframes[tid];
+                float bd, Hdd;
+                VecCf Hcd;
+                addSlot<mode>(*r->block, r->blockIdx, *blockTop(htIDX, tid), ef->adHTdeltaF[htIDX], dc, dd, tid,
+                              bd, Hdd, Hcd);
+
+                bd_acc += bd;
+                Hdd_acc += Hdd;
+                Hcd_acc += Hcd;
             }
 
+            p->Hdd_accLF = Hdd_acc;
+            p->bd_accLF = bd_acc;
+            p->Hcd_accLF = Hcd_acc;
+
+            p->Hcd_accAF.setZero();
+            p->Hdd_accAF = 0;
+            p->bd_accAF = 0;
         }
 
         template void
-        AccumulatedTopHessianSSE::addPoint<0>(shared_ptr<PointHessian> p, EnergyFunctional const *const ef, int tid);
+        AccumulatedTopHessianSSE::addPoint<2>(shared_ptr<PointHessian> p, EnergyFunctional const *const ef, int tid);
 
         template void
-        AccumulatedTopHessianSSE::addPoint<1>(shared_ptr<PointHessian> p, EnergyFunctional const *const ef, int tid);
+        AccumulatedTopHessianSSE::addBlock<0>(ResidualBlock *blk, EnergyFunctional const *const ef, int tid);
 
         template void
-        AccumulatedTopHessianSSE::addPoint<2>(shared_ptr<PointHessian> p, EnergyFunctional const *const ef, int tid);
+        AccumulatedTopHessianSSE::addBlock<1>(ResidualBlock *blk, EnergyFunctional const *const ef, int tid);
+
+        template void AccumulatedTopHessianSSE::addPointSums<0>(PointHessian *p);
+
+        template void AccumulatedTopHessianSSE::addPointSums<1>(PointHessian *p);
 
         void AccumulatedTopHessianSSE::stitchDouble(MatXX &H, VecX &b, EnergyFunctional const *const EF, bool usePrior,
                                                     bool useDelta, int tid) {
@@ -137,11 +190,11 @@ namespace ldso {
                     int tIdx = CPARS + t * 8;
                     int aidx = h + nframes[tid] * t;
 
+                    if (!pairUsed[tid][aidx]) continue;
+                    acc[tid][aidx]->finish();
+                    if (acc[tid][aidx]->num == 0) continue;
 
-                    acc[tid][aidx].finish();
-                    if (acc[tid][aidx].num == 0) continue;
-
-                    MatPCPC accH = acc[tid][aidx].H.cast<double>();
+                    MatPCPC accH = acc[tid][aidx]->H.cast<double>();
 
 
                     H.block<8, 8>(hIdx, hIdx).noalias() +=
@@ -190,8 +243,26 @@ namespace ldso {
             }
         }
 
-        void AccumulatedTopHessianSSE::stitchDoubleInternal(MatXX *H, VecX *b, EnergyFunctional const *const EF,
-                                                            bool usePrior, int min, int max, Vec10 *stats, int tid) {
+        void AccumulatedTopHessianSSE::getAdjoints(EnergyFunctional const *const EF, const Mat88 *&adHost,
+                                                   const Mat88 *&adTarget) {
+            adHost = EF->adHost;
+            adTarget = EF->adTarget;
+        }
+
+        void AccumulatedTopHessianSSE::getAdjoints(EnergyFunctional const *const EF, const Mat88f *&adHost,
+                                                   const Mat88f *&adTarget) {
+            adHost = EF->adHostF;
+            adTarget = EF->adTargetF;
+        }
+
+        template<typename T>
+        void AccumulatedTopHessianSSE::stitchInternal(Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H,
+                                                      Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                                                      EnergyFunctional const *const EF,
+                                                      bool usePrior, int min, int max, Vec10 *stats, int tid) {
+            typedef Eigen::Matrix<T, 8 + CPARS + 1, 8 + CPARS + 1> MatPCPCT;
+            typedef Eigen::Matrix<T, 8, 8> Mat88T;
+
             int toAggregate = NUM_THREADS;
             if (tid == -1) {
                 toAggregate = 1;
@@ -199,6 +270,12 @@ namespace ldso {
             }    // special case: if we dont do multithreading, dont aggregate.
             if (min == max) return;
 
+            const Mat88T *adHost, *adTarget;
+            getAdjoints(EF, adHost, adTarget);
+
+            // the calibration block gets a contribution from every frame pair, sum it with compensation
+            KahanSum<Eigen::Matrix<T, CPARS, CPARS>> Hcc;
+            KahanSum<Eigen::Matrix<T, CPARS, 1>> bc;
 
             for (int k = min; k < max; k++) {
                 int h = k % nframes[0];
@@ -210,50 +287,68 @@ namespace ldso {
 
                 assert(aidx == k);
 
-                MatPCPC accH = MatPCPC::Zero();
+                MatPCPCT accH = MatPCPCT::Zero();
 
+                bool used = false;
                 for (int tid2 = 0; tid2 < toAggregate; tid2++) {
-                    acc[tid2][aidx].finish();
-                    if (acc[tid2][aidx].num == 0) continue;
-                    accH += acc[tid2][aidx].H.cast<double>();
+                    if (!pairUsed[tid2][aidx]) continue;
+                    acc[tid2][aidx]->finish();
+                    if (acc[tid2][aidx]->num == 0) continue;
+                    accH += acc[tid2][aidx]->H.template cast<T>();
+                    used = true;
                 }
+                if (!used) continue;
 
-                H[tid].block<8, 8>(hIdx, hIdx).noalias() +=
-                        EF->adHost[aidx] * accH.block<8, 8>(CPARS, CPARS) * EF->adHost[aidx].transpose();
+                H[tid].template block<8, 8>(hIdx, hIdx).noalias() +=
+                        adHost[aidx] * accH.template block<8, 8>(CPARS, CPARS) * adHost[aidx].transpose();
 
-                H[tid].block<8, 8>(tIdx, tIdx).noalias() +=
-                        EF->adTarget[aidx] * accH.block<8, 8>(CPARS, CPARS) * EF->adTarget[aidx].transpose();
+                H[tid].template block<8, 8>(tIdx, tIdx).noalias() +=
+                        adTarget[aidx] * accH.template block<8, 8>(CPARS, CPARS) * adTarget[aidx].transpose();
 
-                H[tid].block<8, 8>(hIdx, tIdx).noalias() +=
-                        EF->adHost[aidx] * accH.block<8, 8>(CPARS, CPARS) * EF->adTarget[aidx].transpose();
+                H[tid].template block<8, 8>(hIdx, tIdx).noalias() +=
+                        adHost[aidx] * accH.template block<8, 8>(CPARS, CPARS) * adTarget[aidx].transpose();
 
-                H[tid].block<8, CPARS>(hIdx, 0).noalias() += EF->adHost[aidx] * accH.block<8, CPARS>(CPARS, 0);
+                H[tid].template block<8, CPARS>(hIdx, 0).noalias() +=
+                        adHost[aidx] * accH.template block<8, CPARS>(CPARS, 0);
 
-                H[tid].block<8, CPARS>(tIdx, 0).noalias() += EF->adTarget[aidx] * accH.block<8, CPARS>(CPARS, 0);
+                H[tid].template block<8, CPARS>(tIdx, 0).noalias() +=
+                        adTarget[aidx] * accH.template block<8, CPARS>(CPARS, 0);
 
-                H[tid].topLeftCorner<CPARS, CPARS>().noalias() += accH.block<CPARS, CPARS>(0, 0);
+                Hcc.add(accH.template block<CPARS, CPARS>(0, 0));
 
-                b[tid].segment<8>(hIdx).noalias() += EF->adHost[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
+                b[tid].template segment<8>(hIdx).noalias() +=
+                        adHost[aidx] * accH.template block<8, 1>(CPARS, CPARS + 8);
 
-                b[tid].segment<8>(tIdx).noalias() += EF->adTarget[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
-
-                b[tid].head<CPARS>().noalias() += accH.block<CPARS, 1>(0, CPARS + 8);
+                b[tid].template segment<8>(tIdx).noalias() +=
+                        adTarget[aidx] * accH.template block<8, 1>(CPARS, CPARS + 8);
 
+                bc.add(accH.template block<CPARS, 1>(0, CPARS + 8));
             }
 
+            H[tid].template topLeftCorner<CPARS, CPARS>() += Hcc.sum;
+            b[tid].template head<CPARS>() += bc.sum;
 
             // only do this on one thread.
             if (min == 0 && usePrior) {
-                H[tid].diagonal().head<CPARS>() += EF->cPrior;
-                b[tid].head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>());
+                H[tid].diagonal().template head<CPARS>() += EF->cPrior.template cast<T>();
+                b[tid].template head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>()).template cast<T>();
                 for (int h = 0; h < nframes[tid]; h++) {
-                    H[tid].diagonal().segment<8>(CPARS + h * 8) += EF->frames[h]->prior;
-                    b[tid].segment<8>(CPARS + h * 8) += EF->frames[h]->prior.cwiseProduct(EF->frames[h]->delta_prior);
+                    H[tid].diagonal().template segment<8>(CPARS + h * 8) += EF->frames[h]->prior.template cast<T>();
+                    b[tid].template segment<8>(CPARS + h * 8) +=
+                            EF->frames[h]->prior.cwiseProduct(EF->frames[h]->delta_prior).template cast<T>();
 
                 }
             }
         }
 
+        template void AccumulatedTopHessianSSE::stitchInternal<double>(
+                MatXX *H, VecX *b, EnergyFunctional const *const EF, bool usePrior, int min, int max, Vec10 *stats,
+                int tid);
+
+        template void AccumulatedTopHessianSSE::stitchInternal<float>(
+                MatXXf *H, VecXf *b, EnergyFunctional const *const EF, bool usePrior, int min, int max, Vec10 *stats,
+                int tid);
+
     };
 
 }
\ No newline at end of file
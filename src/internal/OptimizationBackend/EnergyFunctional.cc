@@ -24,11 +24,23 @@ namespace ldso {
         }
 
         void EnergyFunctional::insertResidual(shared_ptr<PointFrameResidual> r) {
+            const int n = connectivityFrameIDs.size();
+            assert(r->getHost()->idx < n && r->getTarget()->idx < n);
+            shared_ptr<ResidualBlock> &block = residualBlocks[r->getHost()->idx + r->getTarget()->idx * n];
+            if (block == nullptr)
+                block = shared_ptr<ResidualBlock>(new ResidualBlock(r->getHost(), r->getTarget()));
+            block->add(r);
+
             r->takeData();
-            connectivityMap[(((uint64_t) r->host.lock()->frameID) << 32) + ((uint64_t) r->target.lock()->frameID)][0]++;
+            connectivityAt(r->getHost(), r->getTarget())[0]++;
             nResiduals++;
         }
 
+        void EnergyFunctional::removeFromBlock(PointFrameResidual *r) {
+            if (r->block != nullptr)
+                r->block->remove(r);
+        }
+
         void EnergyFunctional::insertFrame(shared_ptr<FrameHessian> fh, shared_ptr<CalibHessian> Hcalib) {
             fh->takeData();
             frames.push_back(fh);
@@ -49,23 +61,16 @@ namespace ldso {
             EFDeltaValid = false;
 
             setAdjointsF(Hcalib);
-            makeIDX();
-
-            // set connectivity map
-            for (auto fh2: frames) {
-                connectivityMap[(((uint64_t) fh->frameID) << 32) + ((uint64_t) fh2->frameID)] = Eigen::Vector2i(0, 0);
-                if (fh2 != fh)
-                    connectivityMap[(((uint64_t) fh2->frameID) << 32) + ((uint64_t) fh->frameID)] = Eigen::Vector2i(0,
-                                                                                                                    0);
-            }
+            makeIDX();  // also adds the frame to the connectivity
         }
 
         void EnergyFunctional::dropResidual(shared_ptr<PointFrameResidual> r) {
 
             // remove this residual from pointHessian->residualsAll
-            shared_ptr<PointHessian> p = r->point.lock();
+            PointHessian *p = r->getPoint();
+            removeFromBlock(r.get());
             deleteOut<PointFrameResidual>(p->residuals, r);
-            connectivityMap[(((uint64_t) r->host.lock()->frameID) << 32) + ((uint64_t) r->target.lock()->frameID)][0]--;
+            connectivityAt(r->getHost(), r->getTarget())[0]--;
             nResiduals--;
         }
 
@@ -152,8 +157,8 @@ namespace ldso {
 
         void EnergyFunctional::removePoint(shared_ptr<PointHessian> ph) {
             for (auto &r: ph->residuals) {
-                connectivityMap[(((uint64_t) r->host.lock()->frameID) << 32) +
-                                ((uint64_t) r->target.lock()->frameID)][0]--;
+                removeFromBlock(r.get());
+                connectivityAt(r->getHost(), r->getTarget())[0]--;
                 nResiduals--;
             }
             ph->residuals.clear();
@@ -166,38 +171,44 @@ namespace ldso {
 
             allPointsToMarg.clear();
 
-            // go through all points to see which to marg
-            for (auto f: frames) {
-                for (shared_ptr<Feature> feat: f->frame->features) {
-
-                    if (feat->status == Feature::FeatureStatus::VALID &&
-                        feat->point->status == Point::PointStatus::MARGINALIZED) {
-                        shared_ptr<PointHessian> p = feat->point->mpPH;
-                        p->priorF *= setting_idepthFixPriorMargFac;
-                        for (auto r: p->residuals)
-                            if (r->isActive())
-                                connectivityMap[(((uint64_t) r->host.lock()->frameID) << 32) +
-                                                ((uint64_t) r->target.lock()->frameID)][1]++;
-                        allPointsToMarg.push_back(p);
-                    }
-                }
-            }
+            // go through all points to see which to marg, one frame per job. The points are kept per frame so the
+            // order does not depend on the threads
+            vector<vector<shared_ptr<PointHessian>>> pointsToMargPerFrame(frames.size());
+            if (multiThreading)
+                red->reduce(bind(&EnergyFunctional::collectPointsToMarg_Reductor, this, &pointsToMargPerFrame,
+                                 _1, _2, _3, _4), 0, frames.size(), 1);
+            else
+                collectPointsToMarg_Reductor(&pointsToMargPerFrame, 0, frames.size(), 0, 0);
 
-            accSSE_bot->setZero(nFrames);
-            accSSE_top_A->setZero(nFrames);
+            for (auto &points: pointsToMargPerFrame)
+                allPointsToMarg.insert(allPointsToMarg.end(), points.begin(), points.end());
 
-            for (auto p : allPointsToMarg) {
-                accSSE_top_A->addPoint<2>(p, this);
-                accSSE_bot->addPoint(p, false);
-                removePoint(p);
+            for (auto &p: allPointsToMarg) {
+                for (auto &r: p->residuals)
+                    if (r->isActive())
+                        connectivityAt(r->getHost(), r->getTarget())[1]++;
             }
 
             MatXX M, Msc;
             VecX Mb, Mbsc;
-            accSSE_top_A->stitchDouble(M, Mb, this, false, false);
-            accSSE_bot->stitchDouble(Msc, Mbsc, this);
+            if (multiThreading) {
+                red->reduce(bind(&EnergyFunctional::setZeroAll_Reductor, this, _1, _2, _3, _4), 0, 0, 0);
+                red->reduce(bind(&EnergyFunctional::margPoints_Reductor, this, _1, _2, _3, _4), 0,
+                            allPointsToMarg.size(), 50);
+                accSSE_top_A->stitchDoubleMT(red, M, Mb, this, false, true);
+                accSSE_bot->stitchDoubleMT(red, Msc, Mbsc, this, true);
+            } else {
+                accSSE_bot->setZero(nFrames);
+                accSSE_top_A->setZero(nFrames);
+                margPoints_Reductor(0, allPointsToMarg.size(), 0, 0);
+                accSSE_top_A->stitchDouble(M, Mb, this, false, false);
+                accSSE_bot->stitchDouble(Msc, Mbsc, this);
+            }
+
+            for (auto &p : allPointsToMarg)
+                removePoint(p);
 
-            resInM += accSSE_top_A->nres[0];
+            resInM += accSSE_top_A->numResiduals(multiThreading);
 
             MatXX H = M - Msc;
             VecX b = Mb - Mbsc;
@@ -221,6 +232,27 @@ namespace ldso {
             makeIDX();
         }
 
+        void EnergyFunctional::collectPointsToMarg_Reductor(vector<vector<shared_ptr<PointHessian>>> *points,
+                                                            int min, int max, Vec10 *stats, int tid) {
+            for (int i = min; i < max; i++) {
+                for (shared_ptr<Feature> &feat: frames[i]->frame->features) {
+                    if (feat->status == Feature::FeatureStatus::VALID &&
+                        feat->point->status == Point::PointStatus::MARGINALIZED) {
+                        shared_ptr<PointHessian> &p = feat->point->mpPH;
+                        p->priorF *= setting_idepthFixPriorMargFac;
+                        (*points)[i].push_back(p);
+                    }
+                }
+            }
+        }
+
+        void EnergyFunctional::margPoints_Reductor(int min, int max, Vec10 *stats, int tid) {
+            for (int i = min; i < max; i++) {
+                accSSE_top_A->addPoint<2>(allPointsToMarg[i], this, tid);
+                accSSE_bot->addPoint(allPointsToMarg[i], false, tid);
+            }
+        }
+
         void EnergyFunctional::dropPointsF() {
 
             for (auto f: frames) {
@@ -250,12 +282,63 @@ namespace ldso {
             MatXX HL_top, HA_top, H_sc;
             VecX bL_top, bA_top, bM_top, b_sc;
 
-            accumulateAF_MT(HA_top, bA_top, multiThreading);
-            accumulateLF_MT(HL_top, bL_top, multiThreading);
-            accumulateSCF_MT(H_sc, b_sc, multiThreading);
+            if (setting_fusedAccumulation) {
+                // HA_top, bA_top contain the linearized part as well
+                accumulateFusedF_MT(HA_top, bA_top, H_sc, b_sc, multiThreading);
+                HL_top = MatXX::Zero(HA_top.rows(), HA_top.cols());
+                bL_top = VecX::Zero(bA_top.size());
+            } else {
+                static bool warnedPrecision = false;
+                if (setting_backendPrecision != 0 && !warnedPrecision) {
+                    LOG(WARNING) << "setting_backendPrecision " << setting_backendPrecision
+                                 << " needs setting_fusedAccumulation, stitching in double" << endl;
+                    warnedPrecision = true;
+                }
+                accumulateAF_MT(HA_top, bA_top, multiThreading);
+                accumulateLF_MT(HL_top, bL_top, multiThreading);
+                accumulateSCF_MT(H_sc, b_sc, multiThreading);
+            }
 
             bM_top = (bM + HM * getStitchedDeltaF());
 
+            VecX x = solveSystem(HA_top, bA_top, HL_top, bL_top, H_sc, b_sc, bM_top, lambda, lastHS, lastbS);
+
+            if (setting_fusedAccumulation && setting_backendPrecision == 2) {
+                // validation: stitch and solve again in double, compare the systems and the energy change the
+                // quadratic model of the double system predicts for the two steps
+                MatXX Hd, H_scd, HSd;
+                VecX bd, b_scd, bSd;
+                stitchFused<double>(Hd, bd, H_scd, b_scd, multiThreading);
+                VecX xd = solveSystem(Hd, bd, HL_top, bL_top, H_scd, b_scd, bM_top, lambda, HSd, bSd);
+
+                double dE = x.dot(HSd * x) - 2 * x.dot(bSd);
+                double dEd = xd.dot(HSd * xd) - 2 * xd.dot(bSd);
+                LOG(INFO) << "float stitching, relative deviation: H " << (HA_top - Hd).norm() / Hd.norm()
+                          << ", b " << (bA_top - bd).norm() / bd.norm()
+                          << ", H_sc " << (H_sc - H_scd).norm() / H_scd.norm()
+                          << ", b_sc " << (b_sc - b_scd).norm() / b_scd.norm()
+                          << "; step " << (x - xd).norm() / xd.norm()
+                          << ", predicted energy change " << dE << " (double: " << dEd << ", difference "
+                          << dE - dEd << ")" << endl;
+            }
+
+            if ((setting_solverMode & SOLVER_ORTHOGONALIZE_X) ||
+                (iteration >= 2 && (setting_solverMode & SOLVER_ORTHOGONALIZE_X_LATER))) {
+                VecX xOld = x;
+                orthogonalize(&x, 0);
+            }
+
+            lastX = x;
+
+            currentLambda = lambda;
+            resubstituteF_MT(x, HCalib, multiThreading);
+            currentLambda = 0;
+
+        }
+
+        VecX EnergyFunctional::solveSystem(const MatXX &HA_top, const VecX &bA_top, const MatXX &HL_top,
+                                           const VecX &bL_top, const MatXX &H_sc, const VecX &b_sc,
+                                           const VecX &bM_top, double lambda, MatXX &HS, VecX &bS) {
             MatXX HFinal_top;
             VecX bFinal_top;
 
@@ -274,8 +357,8 @@ namespace ldso {
 
                 HFinal_top = HT_act + HM;
                 bFinal_top = bT_act + bM_top;
-                lastHS = HFinal_top;
-                lastbS = bFinal_top;
+                HS = HFinal_top;
+                bS = bFinal_top;
 
                 for (int i = 0; i < 8 * nFrames + CPARS; i++)
                     HFinal_top(i, i) *= (1 + lambda);
@@ -283,8 +366,8 @@ namespace ldso {
                 HFinal_top = HL_top + HM + HA_top;
                 bFinal_top = bL_top + bM_top + bA_top - b_sc;
 
-                lastHS = HFinal_top - H_sc;
-                lastbS = bFinal_top;
+                HS = HFinal_top - H_sc;
+                bS = bFinal_top;
 
                 for (int i = 0; i < 8 * nFrames + CPARS; i++)
                     HFinal_top(i, i) *= (1 + lambda);
@@ -336,18 +419,7 @@ namespace ldso {
 
             }
 
-            if ((setting_solverMode & SOLVER_ORTHOGONALIZE_X) ||
-                (iteration >= 2 && (setting_solverMode & SOLVER_ORTHOGONALIZE_X_LATER))) {
-                VecX xOld = x;
-                orthogonalize(&x, 0);
-            }
-
-            lastX = x;
-
-            currentLambda = lambda;
-            resubstituteF_MT(x, HCalib, multiThreading);
-            currentLambda = 0;
-
+            return x;
         }
 
         double EnergyFunctional::calcMEnergyF() {
@@ -382,6 +454,8 @@ namespace ldso {
             for (unsigned int idx = 0; idx < frames.size(); idx++)
                 frames[idx]->idx = idx;
 
+            remapConnectivity();
+
             allPoints.clear();
 
             for (auto f: frames) {
@@ -391,8 +465,8 @@ namespace ldso {
                         shared_ptr<PointHessian> p = feat->point->mpPH;
                         allPoints.push_back(p);
                         for (auto &r : p->residuals) {
-                            r->hostIDX = r->host.lock()->idx;
-                            r->targetIDX = r->target.lock()->idx;
+                            r->hostIDX = r->getHost()->idx;
+                            r->targetIDX = r->getTarget()->idx;
                         }
                     }
                 }
@@ -400,6 +474,89 @@ namespace ldso {
             EFIndicesValid = true;
         }
 
+        void EnergyFunctional::remapConnectivity() {
+            const int nOld = connectivityFrameIDs.size();
+            const int nNew = frames.size();
+
+            bool same = nOld == nNew;
+            for (int i = 0; same && i < nNew; i++)
+                same = connectivityFrameIDs[i] == frames[i]->frameID;
+            if (same)
+                return;
+
+            // old slot of each frame in the window, -1 for new frames
+            vector<int> oldSlot(nNew, -1);
+            vector<bool> kept(nOld, false);
+            for (int i = 0; i < nNew; i++) {
+                for (int j = 0; j < nOld; j++) {
+                    if (connectivityFrameIDs[j] == frames[i]->frameID) {
+                        oldSlot[i] = j;
+                        kept[j] = true;
+                        break;
+                    }
+                }
+            }
+
+            // pairs with a frame that left the window go to the history
+            for (int h = 0; h < nOld; h++)
+                for (int t = 0; t < nOld; t++)
+                    if (!kept[h] || !kept[t])
+                        connectivityHistory[(((uint64_t) connectivityFrameIDs[h]) << 32) +
+                                            ((uint64_t) connectivityFrameIDs[t])] = connectivity[h + t * nOld];
+
+            // the blocks of these pairs are released with the old matrix
+            vector<Eigen::Vector2i, Eigen::aligned_allocator<Eigen::Vector2i>> remapped(
+                    nNew * nNew, Eigen::Vector2i(0, 0));
+            vector<shared_ptr<ResidualBlock>> remappedBlocks(nNew * nNew);
+            for (int h = 0; h < nNew; h++)
+                for (int t = 0; t < nNew; t++)
+                    if (oldSlot[h] >= 0 && oldSlot[t] >= 0) {
+                        remapped[h + t * nNew] = connectivity[oldSlot[h] + oldSlot[t] * nOld];
+                        remappedBlocks[h + t * nNew].swap(residualBlocks[oldSlot[h] + oldSlot[t] * nOld]);
+                    }
+
+            connectivity.swap(remapped);
+            residualBlocks.swap(remappedBlocks);
+            connectivityFrameIDs.resize(nNew);
+            for (int i = 0; i < nNew; i++)
+                connectivityFrameIDs[i] = frames[i]->frameID;
+        }
+
+        Eigen::Vector2i &EnergyFunctional::connectivityAt(const FrameHessian *host, const FrameHessian *target) {
+            const int n = connectivityFrameIDs.size();
+            if (host->idx < n && target->idx < n && connectivityFrameIDs[host->idx] == host->frameID &&
+                connectivityFrameIDs[target->idx] == target->frameID)
+                return connectivity[host->idx + target->idx * n];
+            // one of them already left the window, happens when dropping the residuals of a marginalized frame
+            return connectivityHistory[(((uint64_t) host->frameID) << 32) + ((uint64_t) target->frameID)];
+        }
+
+        Eigen::Vector2i EnergyFunctional::getConnectivity(int hostFrameID, int targetFrameID) const {
+            const int n = connectivityFrameIDs.size();
+            int h = -1, t = -1;
+            for (int i = 0; i < n; i++) {
+                if (connectivityFrameIDs[i] == hostFrameID) h = i;
+                if (connectivityFrameIDs[i] == targetFrameID) t = i;
+            }
+            if (h >= 0 && t >= 0)
+                return connectivity[h + t * n];
+
+            auto it = connectivityHistory.find((((uint64_t) hostFrameID) << 32) + ((uint64_t) targetFrameID));
+            if (it == connectivityHistory.end())
+                return Eigen::Vector2i(0, 0);
+            return it->second;
+        }
+
+        void EnergyFunctional::forEachConnectivity(
+                const std::function<void(int, int, const Eigen::Vector2i &)> &f) const {
+            for (auto &c: connectivityHistory)
+                f(int(c.first >> 32), int(c.first & 0xffffffff), c.second);
+            const int n = connectivityFrameIDs.size();
+            for (int t = 0; t < n; t++)
+                for (int h = 0; h < n; h++)
+                    f(connectivityFrameIDs[h], connectivityFrameIDs[t], connectivity[h + t * n]);
+        }
+
         void EnergyFunctional::setDeltaF(shared_ptr<CalibHessian> HCalib) {
             if (adHTdeltaF != 0) delete[] adHTdeltaF;
             adHTdeltaF = new Mat18f[nFrames * nFrames];
@@ -535,7 +692,7 @@ namespace ldso {
 
                 for (auto r : p->residuals) {
                     if (!r->isActive()) continue;
-                    b -= xAd[r->hostIDX * nFrames + r->targetIDX] * r->JpJdF;
+                    b -= xAd[r->hostIDX * nFrames + r->targetIDX] * r->block->JpJdF[r->blockIdx];
                 }
 
                 if (!std::isfinite(b) || std::isnan(b)) {
@@ -551,25 +708,20 @@ namespace ldso {
             if (MT) {
                 red->reduce(bind(&AccumulatedTopHessianSSE::setZero, accSSE_top_A, nFrames, _1, _2, _3, _4), 0,
                             0, 0);
-                red->reduce(bind(&AccumulatedTopHessianSSE::addPointsInternal<0>,
-                                 accSSE_top_A, &allPoints, this, _1, _2, _3, _4), 0, allPoints.size(), 50);
+                red->reduce(bind(&AccumulatedTopHessianSSE::addBlocksInternal<0>,
+                                 accSSE_top_A, &residualBlocks, this, _1, _2, _3, _4), 0, residualBlocks.size(), 1);
+                red->reduce(bind(&AccumulatedTopHessianSSE::addPointSumsInternal<0>,
+                                 &allPoints, _1, _2, _3, _4), 0, allPoints.size(), 50);
                 accSSE_top_A->stitchDoubleMT(red, H, b, this, false, true);
-                resInA = accSSE_top_A->nres[0];
+                resInA = accSSE_top_A->numResiduals(MT);
             } else {
                 accSSE_top_A->setZero(nFrames);
-                int cntPointAdded = 0;
-                for (auto f : frames) {
-                    for (shared_ptr<Feature> &feat: f->frame->features) {
-                        if (feat->status == Feature::FeatureStatus::VALID && feat->point &&
-                            feat->point->status == Point::PointStatus::ACTIVE) {
-                            auto p = feat->point->mpPH;
-                            accSSE_top_A->addPoint<0>(p, this);
-                            cntPointAdded++;
-                        }
-                    }
-                }
+                for (auto &blk : residualBlocks)
+                    if (blk)
+                        accSSE_top_A->addBlock<0>(blk.get(), this);
+                AccumulatedTopHessianSSE::addPointSumsInternal<0>(&allPoints, 0, allPoints.size());
                 accSSE_top_A->stitchDoubleMT(red, H, b, this, false, false);
-                resInA = accSSE_top_A->nres[0];
+                resInA = accSSE_top_A->numResiduals(MT);
             }
         }
 
@@ -578,25 +730,20 @@ namespace ldso {
             if (MT) {
                 red->reduce(bind(&AccumulatedTopHessianSSE::setZero, accSSE_top_L, nFrames, _1, _2, _3, _4), 0,
                             0, 0);
-                red->reduce(bind(&AccumulatedTopHessianSSE::addPointsInternal<1>,
-                                 accSSE_top_L, &allPoints, this, _1, _2, _3, _4), 0, allPoints.size(), 50);
+                red->reduce(bind(&AccumulatedTopHessianSSE::addBlocksInternal<1>,
+                                 accSSE_top_L, &residualBlocks, this, _1, _2, _3, _4), 0, residualBlocks.size(), 1);
+                red->reduce(bind(&AccumulatedTopHessianSSE::addPointSumsInternal<1>,
+                                 &allPoints, _1, _2, _3, _4), 0, allPoints.size(), 50);
                 accSSE_top_L->stitchDoubleMT(red, H, b, this, true, true);
-                resInL = accSSE_top_L->nres[0];
+                resInL = accSSE_top_L->numResiduals(MT);
             } else {
                 accSSE_top_L->setZero(nFrames);
-                int cntPointAdded = 0;
-                for (auto f : frames) {
-                    for (auto feat: f->frame->features) {
-                        if (feat->status == Feature::FeatureStatus::VALID &&
-                            feat->point->status == Point::PointStatus::ACTIVE) {
-                            auto p = feat->point->mpPH;
-                            accSSE_top_L->addPoint<1>(p, this);
-                            cntPointAdded++;
-                        }
-                    }
-                }
+                for (auto &blk : residualBlocks)
+                    if (blk)
+                        accSSE_top_L->addBlock<1>(blk.get(), this);
+                AccumulatedTopHessianSSE::addPointSumsInternal<1>(&allPoints, 0, allPoints.size());
                 accSSE_top_L->stitchDoubleMT(red, H, b, this, true, false);
-                resInL = accSSE_top_L->nres[0];
+                resInL = accSSE_top_L->numResiduals(MT);
             }
         }
 
@@ -624,6 +771,111 @@ namespace ldso {
             }
         }
 
+        void EnergyFunctional::accumulateFusedF_MT(MatXX &H, VecX &b, MatXX &H_sc, VecX &b_sc, bool MT) {
+            // the active and linearized parts go into the same accumulator, and are stitched together with the prior
+            if (MT) {
+                red->reduce(bind(&EnergyFunctional::setZeroAll_Reductor, this, _1, _2, _3, _4), 0, 0, 0);
+                red->reduce(bind(&EnergyFunctional::addBlocksFused_Reductor, this, _1, _2, _3, _4), 0,
+                            residualBlocks.size(), 1);
+                resInA = red->stats[0];
+                resInL = red->stats[1];
+                red->reduce(bind(&EnergyFunctional::addPointsFused_Reductor, this, _1, _2, _3, _4), 0,
+                            allPoints.size(), 50);
+            } else {
+                setZeroAll_Reductor(0, 1, 0, 0);
+                Vec10 stats = Vec10::Zero();
+                addBlocksFused_Reductor(0, residualBlocks.size(), &stats, 0);
+                resInA = stats[0];
+                resInL = stats[1];
+                addPointsFused_Reductor(0, allPoints.size(), &stats, 0);
+            }
+
+            // 1 and 2 stitch the same way, 2 only adds the validation in solveSystemF
+            if (setting_backendPrecision == 0) {
+                stitchFused<double>(H, b, H_sc, b_sc, MT);
+            } else {
+                stitchFused<float>(H, b, H_sc, b_sc, MT);
+            }
+        }
+
+        template<typename T>
+        void EnergyFunctional::stitchFused(MatXX &H, VecX &b, MatXX &H_sc, VecX &b_sc, bool MT) {
+            typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> MatXXT;
+            typedef Eigen::Matrix<T, Eigen::Dynamic, 1> VecXT;
+
+            const int dim = nFrames * 8 + CPARS;
+            const int nBuf = MT ? NUM_THREADS : 1;
+            MatXXT Hs[NUM_THREADS], Hs_sc[NUM_THREADS];
+            VecXT bs[NUM_THREADS], bs_sc[NUM_THREADS];
+            for (int i = 0; i < nBuf; i++) {
+                Hs[i] = MatXXT::Zero(dim, dim);
+                bs[i] = VecXT::Zero(dim);
+                Hs_sc[i] = MatXXT::Zero(dim, dim);
+                bs_sc[i] = VecXT::Zero(dim);
+            }
+
+            if (MT) {
+                red->reduce(bind(&EnergyFunctional::stitchFused_Reductor<T>, this, Hs, bs, Hs_sc, bs_sc,
+                                 _1, _2, _3, _4), 0, nFrames * nFrames, 0);
+            } else {
+                stitchFused_Reductor<T>(Hs, bs, Hs_sc, bs_sc, 0, nFrames * nFrames, 0, -1);
+            }
+
+            pairwiseReduce(Hs, nBuf);
+            pairwiseReduce(bs, nBuf);
+            pairwiseReduce(Hs_sc, nBuf);
+            pairwiseReduce(bs_sc, nBuf);
+
+            H = Hs[0].template cast<double>();
+            b = bs[0].template cast<double>();
+            H_sc = Hs_sc[0].template cast<double>();
+            b_sc = bs_sc[0].template cast<double>();
+
+            accSSE_top_A->copyTransposedParts(H);
+            accSSE_bot->copyTransposedParts(H_sc);
+        }
+
+        void EnergyFunctional::setZeroAll_Reductor(int min, int max, Vec10 *stats, int tid) {
+            accSSE_top_A->setZero(nFrames, min, max, stats, tid);
+            accSSE_bot->setZero(nFrames, min, max, stats, tid);
+        }
+
+        void EnergyFunctional::addBlocksFused_Reductor(int min, int max, Vec10 *stats, int tid) {
+            // stats: [0] active residuals, [1] linearized residuals
+            for (int i = min; i < max; i++) {
+                ResidualBlock *blk = residualBlocks[i].get();
+                if (blk == nullptr)
+                    continue;
+                const int nres0 = accSSE_top_A->nres[tid];
+                accSSE_top_A->addBlock<0>(blk, this, tid);
+                const int nres1 = accSSE_top_A->nres[tid];
+                accSSE_top_A->addBlock<1>(blk, this, tid);
+                (*stats)[0] += nres1 - nres0;
+                (*stats)[1] += accSSE_top_A->nres[tid] - nres1;
+            }
+        }
+
+        void EnergyFunctional::addPointsFused_Reductor(int min, int max, Vec10 *stats, int tid) {
+            for (int i = min; i < max; i++) {
+                const shared_ptr<PointHessian> &p = allPoints[i];
+                AccumulatedTopHessianSSE::addPointSums<0>(p.get());
+                AccumulatedTopHessianSSE::addPointSums<1>(p.get());
+
+                // uses the Hdd/bd/Hcd sums just collected into the point
+                accSSE_bot->addPoint(p, true, tid);
+            }
+        }
+
+        template<typename T>
+        void EnergyFunctional::stitchFused_Reductor(Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H,
+                                                    Eigen::Matrix<T, Eigen::Dynamic, 1> *b,
+                                                    Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> *H_sc,
+                                                    Eigen::Matrix<T, Eigen::Dynamic, 1> *b_sc,
+                                                    int min, int max, Vec10 *stats, int tid) {
+            accSSE_top_A->stitchInternal<T>(H, b, this, true, min, max, stats, tid);
+            accSSE_bot->stitchInternal<T>(H_sc, b_sc, this, min, max, stats, tid);
+        }
+
         void EnergyFunctional::calcLEnergyPt(int min, int max, Vec10 *stats, int tid) {
 
             Accumulator11 E;
@@ -635,19 +887,23 @@ namespace ldso {
                 float dd = p->deltaF;
 
                 for (auto r : p->residuals) {
-                    if (!r->isLinearized || !r->isActive()) continue;
+                    if (!r->isLinearized() || !r->isActive()) continue;
 
                     Mat18f dp = adHTdeltaF[r->hostIDX + nFrames * r->targetIDX];
-                    shared_ptr<RawResidualJacobian> rJ = r->J;
+                    const ResidualBlock *blk = r->block;
+                    const int k = r->blockIdx;
+                    const float *JIdx0 = blk->JIdx[0][k].data(), *JIdx1 = blk->JIdx[1][k].data();
+                    const float *JabF0 = blk->JabF[0][k].data(), *JabF1 = blk->JabF[1][k].data();
+                    const float *resToZeroF = blk->resToZeroF[k].data();
 
                     // compute Jp*delta
-                    float Jp_delta_x_1 = rJ->Jpdxi[0].dot(dp.head<6>())
-                                         + rJ->Jpdc[0].dot(dc)
-                                         + rJ->Jpdd[0] * dd;
+                    float Jp_delta_x_1 = blk->Jpdxi[0][k].dot(dp.head<6>())
+                                         + blk->Jpdc[0][k].dot(dc)
+                                         + blk->Jpdd[k][0] * dd;
 
-                    float Jp_delta_y_1 = rJ->Jpdxi[1].dot(dp.head<6>())
-                                         + rJ->Jpdc[1].dot(dc)
-                                         + rJ->Jpdd[1] * dd;
+                    float Jp_delta_y_1 = blk->Jpdxi[1][k].dot(dp.head<6>())
+                                         + blk->Jpdc[1][k].dot(dc)
+                                         + blk->Jpdd[k][1] * dd;
 
                     __m128 Jp_delta_x = _mm_set1_ps(Jp_delta_x_1);
                     __m128 Jp_delta_y = _mm_set1_ps(Jp_delta_y_1);
@@ -656,22 +912,21 @@ namespace ldso {
 
                     for (int i = 0; i + 3 < patternNum; i += 4) {
                         // PATTERN: E = (2*res_toZeroF + J*delta) * J*delta.
-                        __m128 Jdelta = _mm_mul_ps(_mm_load_ps(((float *) (rJ->JIdx)) + i), Jp_delta_x);
-                        Jdelta = _mm_add_ps(Jdelta,
-                                            _mm_mul_ps(_mm_load_ps(((float *) (rJ->JIdx + 1)) + i), Jp_delta_y));
-                        Jdelta = _mm_add_ps(Jdelta, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JabF)) + i), delta_a));
-                        Jdelta = _mm_add_ps(Jdelta, _mm_mul_ps(_mm_load_ps(((float *) (rJ->JabF + 1)) + i), delta_b));
+                        __m128 Jdelta = _mm_mul_ps(_mm_load_ps(JIdx0 + i), Jp_delta_x);
+                        Jdelta = _mm_add_ps(Jdelta, _mm_mul_ps(_mm_load_ps(JIdx1 + i), Jp_delta_y));
+                        Jdelta = _mm_add_ps(Jdelta, _mm_mul_ps(_mm_load_ps(JabF0 + i), delta_a));
+                        Jdelta = _mm_add_ps(Jdelta, _mm_mul_ps(_mm_load_ps(JabF1 + i), delta_b));
 
-                        __m128 r0 = _mm_load_ps(((float *) &r->res_toZeroF) + i);
+                        __m128 r0 = _mm_load_ps(resToZeroF + i);
                         r0 = _mm_add_ps(r0, r0);
                         r0 = _mm_add_ps(r0, Jdelta);
                         Jdelta = _mm_mul_ps(Jdelta, r0);
                         E.updateSSENoShift(Jdelta);
                     }
                     for (int i = ((patternNum >> 2) << 2); i < patternNum; i++) {
-                        float Jdelta = rJ->JIdx[0][i] * Jp_delta_x_1 + rJ->JIdx[1][i] * Jp_delta_y_1 +
-                                       rJ->JabF[0][i] * dp[6] + rJ->JabF[1][i] * dp[7];
-                        E.updateSingleNoShift((float) (Jdelta * (Jdelta + 2 * r->res_toZeroF[i])));
+                        float Jdelta = JIdx0[i] * Jp_delta_x_1 + JIdx1[i] * Jp_delta_y_1 +
+                                       JabF0[i] * dp[6] + JabF1[i] * dp[7];
+                        E.updateSingleNoShift((float) (Jdelta * (Jdelta + 2 * resToZeroF[i])));
                     }
                 }
 
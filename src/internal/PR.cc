@@ -6,17 +6,120 @@ using namespace ldso::internal;
 
 namespace ldso {
 
+    // Jacobians are w.r.t. the left-multiplied updates of the vertices, exp(delta) * T. Tangent vectors are ordered
+    // as in Sophus: translation, rotation, (log of scale).
+
+    /**
+     * matrix of the adjoint action ad(e) of sim3
+     */
+    static Mat77 adSim3(const Vec7 &e) {
+        Mat77 ad = Mat77::Zero();
+        ad.block<3, 3>(0, 0) = SO3::hat(e.segment<3>(3)) + e[6] * Mat33::Identity();
+        ad.block<3, 3>(0, 3) = SO3::hat(e.head<3>());
+        ad.block<3, 1>(0, 6) = -e.head<3>();
+        ad.block<3, 3>(3, 3) = SO3::hat(e.segment<3>(3));
+        return ad;
+    }
+
+    /**
+     * inverse of the left jacobian of se3 in closed form, log(exp(a) * exp(e)) = e + Jl^-1(e) a.
+     * Jl(e) = [Jl(phi) Q; 0 Jl(phi)] for e = (rho, phi), Q from Barfoot, State Estimation for Robotics, (7.86)
+     */
+    static Mat66 invLeftJacobianSE3(const Vec6 &e) {
+        const Mat33 R = SO3::hat(e.head<3>());
+        const Mat33 P = SO3::hat(e.tail<3>());
+        const Mat33 PP = P * P;
+        const double theta2 = e.tail<3>().squaredNorm();
+        const double theta = sqrt(theta2);
+
+        // kJ: the PP coefficient of Jl^-1(phi), k1..k3: the coefficients of Q
+        double kJ, k1, k2, k3;
+        if (theta < 0.05) {
+            // taylor series, the closed forms cancel badly for small angles
+            kJ = 1.0 / 12.0 + theta2 / 720.0 + theta2 * theta2 / 30240.0;
+            k1 = 1.0 / 6.0 - theta2 / 120.0 + theta2 * theta2 / 5040.0;
+            k2 = 1.0 / 24.0 - theta2 / 720.0 + theta2 * theta2 / 40320.0;
+            k3 = 1.0 / 120.0 - theta2 / 2520.0 + theta2 * theta2 / 120960.0;
+        } else {
+            const double s = sin(theta), c = cos(theta);
+            const double theta4 = theta2 * theta2;
+            kJ = 1.0 / theta2 - (1 + c) / (2 * theta * s);
+            k1 = (theta - s) / (theta2 * theta);
+            k2 = (theta2 + 2 * c - 2) / (2 * theta4);
+            k3 = (2 * theta - 3 * s + theta * c) / (2 * theta4 * theta);
+        }
+
+        const Mat33 JlInvSO3 = Mat33::Identity() - 0.5 * P + kJ * PP;
+        const Mat33 PRP = P * R * P;
+        const Mat33 Q = 0.5 * R + k1 * (P * R + R * P + PRP) + k2 * (PP * R + R * PP - 3 * PRP) +
+                        k3 * (PRP * P + P * PRP);
+
+        Mat66 JlInv = Mat66::Zero();
+        JlInv.block<3, 3>(0, 0) = JlInvSO3;
+        JlInv.block<3, 3>(0, 3) = -JlInvSO3 * Q * JlInvSO3;
+        JlInv.block<3, 3>(3, 3) = JlInvSO3;
+        return JlInv;
+    }
+
+    /**
+     * inverse of the left jacobian of sim3 from the series ad / (exp(ad) - 1) = sum B_n ad^n / n!, up to ad^10.
+     * The series converges for |e| < 2 pi, the truncation error at |e| = 1 is below 1e-9
+     */
+    static Mat77 invLeftJacobianSim3(const Vec7 &e) {
+        const Mat77 ad = adSim3(e);
+        const Mat77 ad2 = ad * ad;
+        const Mat77 I = Mat77::Identity();
+
+        // B_2k / (2k)!, the odd terms vanish except for -ad/2
+        static const double coeffs[5] = {1.0 / 12.0, -1.0 / 720.0, 1.0 / 30240.0, -1.0 / 1209600.0, 1.0 / 47900160.0};
+        Mat77 sum = coeffs[4] * I;
+        for (int k = 3; k >= 0; k--)
+            sum = coeffs[k] * I + ad2 * sum;
+        return I - 0.5 * ad + ad2 * sum;
+    }
+
+    /**
+     * derivative of the pinhole projection (fx*x/z+cx, fy*y/z+cy) w.r.t. the point
+     */
+    static inline Matrix<double, 2, 3> projectionJacobian(const Vec3 &p, double fx, double fy) {
+        double zinv = 1.0 / p[2];
+        Matrix<double, 2, 3> J;
+        J << fx * zinv, 0, -fx * p[0] * zinv * zinv,
+                0, fy * zinv, -fy * p[1] * zinv * zinv;
+        return J;
+    }
+
     void EdgeIDPPrior::computeError() {
         const VertexPointInvDepth *vIDP = static_cast<const VertexPointInvDepth *>(_vertices[0]);
         _error(0) = vIDP->estimate() - _measurement;
     }
 
-    /*
     void EdgeIDPPrior::linearizeOplus() {
         _jacobianOplusXi.setZero();
         _jacobianOplusXi(0) = 1;
     }
-     */
+
+    void EdgePR::linearizeOplus() {
+        SE3 v1 = (static_cast<VertexPR *> (_vertices[0]))->estimate();
+        SE3 v2 = (static_cast<VertexPR *> (_vertices[1]))->estimate();
+        SE3 E = _measurement.inverse() * v1 * v2.inverse();
+        Mat66 JlInv = invLeftJacobianSE3(E.log());
+
+        // T1 <- exp(d) T1: M^-1 exp(d) M E = exp(Adj(M^-1) d) E
+        // T2 <- exp(d) T2: E exp(-d) = exp(-Adj(E) d) E
+        _jacobianOplusXi = JlInv * _measurement.inverse().Adj();
+        _jacobianOplusXj = -JlInv * E.Adj();
+    }
+
+    void EdgeSim3::linearizeOplus() {
+        Sim3 v1 = (static_cast<VertexSim3 *> (_vertices[0]))->estimate();
+        Sim3 v2 = (static_cast<VertexSim3 *> (_vertices[1]))->estimate();
+        Sim3 E = _measurement.inverse() * v1 * v2.inverse();
+        Mat77 JlInv = invLeftJacobianSim3(E.log());
+
+        _jacobianOplusXi = JlInv * _measurement.inverse().Adj();
+        _jacobianOplusXj = -JlInv * E.Adj();
+    }
 
     /**
      * Erorr = pi(Px)-obs
@@ -51,28 +154,85 @@ namespace ldso {
         _error = Vec2(u, v) - _measurement;
     }
 
+    void EdgePRIDP::linearizeOplus() {
+        const VertexPointInvDepth *vIDP = dynamic_cast<const VertexPointInvDepth *>( _vertices[0]);
+        const VertexPR *vPR0 = dynamic_cast<const VertexPR *>(_vertices[1]);
+        const VertexPR *vPRi = dynamic_cast<const VertexPR *>(_vertices[2]);
+
+        _jacobianOplus[0].setZero();
+        _jacobianOplus[1].setZero();
+        _jacobianOplus[2].setZero();
+
+        // same invalid cases as computeError, the error is not updated there
+        double rho = vIDP->estimate();
+        if (rho < 1e-6)
+            return;
+
+        Vec3 P0(x, y, 1.0);
+        P0 = P0 * (1.0f / rho);
+        SE3 T0inv = vPR0->estimate().inverse();
+        Vec3 Pw = T0inv * P0;
+        Vec3 Pi = vPRi->estimate() * Pw;
+        if (Pi[2] < 0)
+            return;
+
+        Matrix<double, 2, 3> Jproj = projectionJacobian(Pi, cam->fxl(), cam->fyl());
+        Mat33 Ri0 = vPRi->R() * T0inv.so3().matrix();
+
+        // P0 = [x y 1] / rho
+        _jacobianOplus[0] = Jproj * Ri0 * (-P0 / rho);
+
+        // Pw = T0^-1 exp(-d) P0
+        Matrix<double, 3, 6> dP0;
+        dP0.block<3, 3>(0, 0) = -Mat33::Identity();
+        dP0.block<3, 3>(0, 3) = SO3::hat(P0);
+        _jacobianOplus[1] = Jproj * Ri0 * dP0;
+
+        // Pi = exp(d) Ti Pw
+        Matrix<double, 3, 6> dPi;
+        dPi.block<3, 3>(0, 0) = Mat33::Identity();
+        dPi.block<3, 3>(0, 3) = -SO3::hat(Pi);
+        _jacobianOplus[2] = Jproj * dPi;
+    }
+
     void EdgeProjectPoseOnly::computeError() {
         const VertexPR *vPR = static_cast<VertexPR *> (_vertices[0]);
         SE3 Tcw = vPR->estimate();
         Vec3 pc = Tcw * pw;
-        pc = pc * (1.0 / pc[2]);
         if (pc[2] < 0) {
             LOG(WARNING) << "invalid depth: " << pc[2] << endl;
             depthValid = false;
             return;
         }
+        pc = pc * (1.0 / pc[2]);
         double u = fx * pc[0] + cx;
         double v = fy * pc[1] + cy;
         _error = Vec2(u, v) - _measurement;
     }
 
+    void EdgeProjectPoseOnly::linearizeOplus() {
+        const VertexPR *vPR = static_cast<VertexPR *> (_vertices[0]);
+        Vec3 pc = vPR->estimate() * pw;
+
+        // same invalid case as computeError, the error is not updated there
+        if (pc[2] < 0) {
+            _jacobianOplusXi.setZero();
+            return;
+        }
+
+        // pc = exp(d) Tcw pw
+        Matrix<double, 3, 6> dpc;
+        dpc.block<3, 3>(0, 0) = Mat33::Identity();
+        dpc.block<3, 3>(0, 3) = -SO3::hat(pc);
+        _jacobianOplusXi = projectionJacobian(pc, fx, fy) * dpc;
+    }
+
     void EdgeProjectPoseOnlySim3::computeError() {
 
         const VertexSim3 *vSim3 = static_cast<VertexSim3 *> (vertex(0));
         Sim3 Scw = vSim3->estimate();
 
         Vec3 pc = Scw.scale() * Scw.rotationMatrix() * pw + Scw.translation();
-        pc = pc * (1.0 / pc[2]);
 
         if (pc[2] < 0) {
             LOG(WARNING) << "invalid depth: " << pc[2] << endl;
@@ -80,9 +240,39 @@ namespace ldso {
             depthValid = false;
             return;
         }
+        pc = pc * (1.0 / pc[2]);
 
         double u = fx * pc[0] + cx;
         double v = fy * pc[1] + cy;
         _error = Vec2(u, v) - _measurement;
     }
+
+    void EdgeProjectPoseOnlySim3::linearizeOplus() {
+        const VertexSim3 *vSim3 = static_cast<VertexSim3 *> (vertex(0));
+        Sim3 Scw = vSim3->estimate();
+        Vec3 pc = Scw.scale() * Scw.rotationMatrix() * pw + Scw.translation();
+
+        // same invalid case as computeError, the edge is moved to level 1 there
+        if (pc[2] < 0) {
+            _jacobianOplusXi.setZero();
+            return;
+        }
+
+        // pc = exp(d) Scw pw, the scale column vanishes after the projection
+        Matrix<double, 3, 7> dpc;
+        dpc.block<3, 3>(0, 0) = Mat33::Identity();
+        dpc.block<3, 3>(0, 3) = -SO3::hat(pc);
+        dpc.block<3, 1>(0, 6) = pc;
+        _jacobianOplusXi = projectionJacobian(pc, fx, fy) * dpc;
+    }
+
+    void EdgePointSim3::linearizeOplus() {
+        const VertexSim3 *vSim3 = static_cast<VertexSim3 *> (vertex(0));
+        Vec3 pc = vSim3->estimate() * pw;
+
+        // error = measurement - exp(d) Scw pw
+        _jacobianOplusXi.block<3, 3>(0, 0) = -Mat33::Identity();
+        _jacobianOplusXi.block<3, 3>(0, 3) = SO3::hat(pc);
+        _jacobianOplusXi.block<3, 1>(0, 6) = -pc;
+    }
 }
@@ -0,0 +1,112 @@
+#include "internal/ResidualBlock.h"
+#include "internal/Residuals.h"
+#include "internal/FrameFramePrecalc.h"
+
+namespace ldso {
+
+    namespace internal {
+
+        /**
+         * move slot from into slot to and drop the last slot, from must be the last one
+         */
+        template<typename V>
+        static inline void moveSlot(V &v, int to, int from) {
+            if (to != from)
+                v[to] = v[from];
+            v.pop_back();
+        }
+
+        ResidualBlock::~ResidualBlock() {
+            for (auto &r: residuals) {
+                r->block = nullptr;
+                r->blockIdx = -1;
+            }
+        }
+
+        void ResidualBlock::add(const shared_ptr<PointFrameResidual> &r) {
+            assert(r->block == nullptr);
+
+            r->block = this;
+            r->blockIdx = residuals.size();
+            residuals.push_back(r);
+
+            resF.push_back(VecNRf::Zero());
+            for (int k = 0; k < 2; k++) {
+                Jpdxi[k].push_back(Vec6f::Zero());
+                Jpdc[k].push_back(VecCf::Zero());
+                JIdx[k].push_back(VecNRf::Zero());
+                JabF[k].push_back(VecNRf::Zero());
+            }
+            Jpdd.push_back(Vec2f::Zero());
+            JIdx2.push_back(Mat22f::Zero());
+            JabJIdx.push_back(Mat22f::Zero());
+            Jab2.push_back(Mat22f::Zero());
+
+            resToZeroF.push_back(VecNRf::Zero());
+            JpJdF.push_back(Vec8f::Zero());
+            active.push_back(0);
+            linearized.push_back(0);
+
+            bd.push_back(0);
+            Hdd.push_back(0);
+            Hcd.push_back(VecCf::Zero());
+        }
+
+        void ResidualBlock::remove(PointFrameResidual *r) {
+            assert(r->block == this);
+            const int idx = r->blockIdx;
+            const int last = residuals.size() - 1;
+
+            // reset r first, the block may hold the last reference to it
+            r->block = nullptr;
+            r->blockIdx = -1;
+
+            moveSlot(residuals, idx, last);
+            if (idx != last)
+                residuals[idx]->blockIdx = idx;
+
+            moveSlot(resF, idx, last);
+            for (int k = 0; k < 2; k++) {
+                moveSlot(Jpdxi[k], idx, last);
+                moveSlot(Jpdc[k], idx, last);
+                moveSlot(JIdx[k], idx, last);
+                moveSlot(JabF[k], idx, last);
+            }
+            moveSlot(Jpdd, idx, last);
+            moveSlot(JIdx2, idx, last);
+            moveSlot(JabJIdx, idx, last);
+            moveSlot(Jab2, idx, last);
+
+            moveSlot(resToZeroF, idx, last);
+            moveSlot(JpJdF, idx, last);
+            moveSlot(active, idx, last);
+            moveSlot(linearized, idx, last);
+
+            moveSlot(bd, idx, last);
+            moveSlot(Hdd, idx, last);
+            moveSlot(Hcd, idx, last);
+        }
+
+        bool ResidualBlock::precalcChanged(float th) const {
+            if (!linValid)
+                return true;
+            const FrameFramePrecalc &precalc = host->targetPrecalc[target->idx];
+            if ((precalc.PRE_RTll - linRTll).norm() > th * linRTll.norm())
+                return true;
+            if ((precalc.PRE_tTll - lintTll).norm() > th * std::max(lintTll.norm(), 1e-3f))
+                return true;
+            if (fabsf(precalc.PRE_aff_mode[0] - linAffMode[0]) > th * fabsf(linAffMode[0]) ||
+                fabsf(precalc.PRE_aff_mode[1] - linAffMode[1]) > th * std::max(fabsf(linAffMode[1]), 1.0f))
+                return true;
+            return false;
+        }
+
+        void ResidualBlock::setLinearized() {
+            const FrameFramePrecalc &precalc = host->targetPrecalc[target->idx];
+            linRTll = precalc.PRE_RTll;
+            lintTll = precalc.PRE_tTll;
+            linAffMode = precalc.PRE_aff_mode;
+            linValid = true;
+        }
+    }
+}
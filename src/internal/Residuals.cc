@@ -5,11 +5,178 @@
 #include "internal/GlobalFuncs.h"
 #include "Settings.h"
 #include "internal/OptimizationBackend/EnergyFunctional.h"
+#include "internal/CPUFeatures.h"
 
 namespace ldso {
 
     namespace internal {
 
+#if LDSO_HAS_AVX2
+        LDSO_TARGET_AVX2 static inline float hsum256(__m256 v) {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            return _mm_cvtss_f32(s);
+        }
+
+        /**
+         * AVX2 version of the pattern loop in PointFrameResidual::linearize, one lane per pattern pixel
+         * (patternNum == 8). Fills resF, JIdx, JabF and the 2x2 inner products in slot i of the block.
+         * @return false if any pattern pixel falls out of the target image, like the scalar loop
+         */
+        LDSO_TARGET_AVX2 static bool linearizePatternAVX(
+                const PointHessian *p, const FrameFramePrecalc *precalc, const Vec3f *dIl,
+                Eigen::Vector2f *projectedTo, ResidualBlock *blk, int i, float &energyLeft, float &wJI2_sum) {
+
+            static_assert(patternNum == 8, "linearizePatternAVX assumes 8 pattern pixels");
+
+            // pattern offsets as floats, patternP is fixed at compile time
+            alignas(32) static const float patternDx[8] = {
+                    (float) patternP[0][0], (float) patternP[1][0], (float) patternP[2][0], (float) patternP[3][0],
+                    (float) patternP[4][0], (float) patternP[5][0], (float) patternP[6][0], (float) patternP[7][0]};
+            alignas(32) static const float patternDy[8] = {
+                    (float) patternP[0][1], (float) patternP[1][1], (float) patternP[2][1], (float) patternP[3][1],
+                    (float) patternP[4][1], (float) patternP[5][1], (float) patternP[6][1], (float) patternP[7][1]};
+
+            const Mat33f &KRKi = precalc->PRE_KRKiTll;
+            const Vec3f &Kt = precalc->PRE_KtTll;
+
+            // projection, same as projectPoint(u, v, idepth, KRKi, Kt, Ku, Kv)
+            const __m256 pu = _mm256_add_ps(_mm256_set1_ps(p->u), _mm256_load_ps(patternDx));
+            const __m256 pv = _mm256_add_ps(_mm256_set1_ps(p->v), _mm256_load_ps(patternDy));
+            const float id = p->idepth_scaled;
+            const __m256 px = _mm256_fmadd_ps(_mm256_set1_ps(KRKi(0, 0)), pu, _mm256_fmadd_ps(
+                    _mm256_set1_ps(KRKi(0, 1)), pv, _mm256_set1_ps(KRKi(0, 2) + Kt[0] * id)));
+            const __m256 py = _mm256_fmadd_ps(_mm256_set1_ps(KRKi(1, 0)), pu, _mm256_fmadd_ps(
+                    _mm256_set1_ps(KRKi(1, 1)), pv, _mm256_set1_ps(KRKi(1, 2) + Kt[1] * id)));
+            const __m256 pz = _mm256_fmadd_ps(_mm256_set1_ps(KRKi(2, 0)), pu, _mm256_fmadd_ps(
+                    _mm256_set1_ps(KRKi(2, 1)), pv, _mm256_set1_ps(KRKi(2, 2) + Kt[2] * id)));
+            const __m256 Ku = _mm256_div_ps(px, pz);
+            const __m256 Kv = _mm256_div_ps(py, pz);
+
+            const __m256 inside = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(Ku, _mm256_set1_ps(1.1f), _CMP_GT_OQ),
+                                  _mm256_cmp_ps(Kv, _mm256_set1_ps(1.1f), _CMP_GT_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(Ku, _mm256_set1_ps(wM3G), _CMP_LT_OQ),
+                                  _mm256_cmp_ps(Kv, _mm256_set1_ps(hM3G), _CMP_LT_OQ)));
+            if (_mm256_movemask_ps(inside) != 0xff)
+                return false;
+
+            alignas(32) float KuBuf[8], KvBuf[8];
+            _mm256_store_ps(KuBuf, Ku);
+            _mm256_store_ps(KvBuf, Kv);
+            for (int idx = 0; idx < 8; idx++) {
+                projectedTo[idx][0] = KuBuf[idx];
+                projectedTo[idx][1] = KvBuf[idx];
+            }
+
+            // bilinear interpolation, same as getInterpolatedElement33, gathering from the Vec3f image
+            const __m256i ix = _mm256_cvttps_epi32(Ku);
+            const __m256i iy = _mm256_cvttps_epi32(Kv);
+            const __m256 dx = _mm256_sub_ps(Ku, _mm256_cvtepi32_ps(ix));
+            const __m256 dy = _mm256_sub_ps(Kv, _mm256_cvtepi32_ps(iy));
+            const __m256 dxdy = _mm256_mul_ps(dx, dy);
+            const __m256 w11 = dxdy;
+            const __m256 w01 = _mm256_sub_ps(dy, dxdy);
+            const __m256 w10 = _mm256_sub_ps(dx, dxdy);
+            const __m256 w00 = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1), _mm256_add_ps(dx, dy)), dxdy);
+
+            const int width = wG[0];
+            const __m256i three = _mm256_set1_epi32(3);
+            const __m256i base = _mm256_mullo_epi32(
+                    _mm256_add_epi32(ix, _mm256_mullo_epi32(iy, _mm256_set1_epi32(width))), three);
+            const __m256i offRight = _mm256_set1_epi32(3);
+            const __m256i offDown = _mm256_set1_epi32(3 * width);
+            const __m256i offDiag = _mm256_set1_epi32(3 * width + 3);
+            const float *img = dIl->data();
+
+            __m256 hit[3];
+            for (int c = 0; c < 3; c++) {
+                const __m256i b = _mm256_add_epi32(base, _mm256_set1_epi32(c));
+                __m256 v = _mm256_mul_ps(w11, _mm256_i32gather_ps(img, _mm256_add_epi32(b, offDiag), 4));
+                v = _mm256_fmadd_ps(w01, _mm256_i32gather_ps(img, _mm256_add_epi32(b, offDown), 4), v);
+                v = _mm256_fmadd_ps(w10, _mm256_i32gather_ps(img, _mm256_add_epi32(b, offRight), 4), v);
+                v = _mm256_fmadd_ps(w00, _mm256_i32gather_ps(img, b, 4), v);
+                hit[c] = v;
+            }
+
+            // x - x is zero only for finite x
+            if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_sub_ps(hit[0], hit[0]), _mm256_setzero_ps(), _CMP_EQ_OQ)) !=
+                0xff)
+                return false;
+
+            const __m256 color = _mm256_loadu_ps(p->color);
+            const __m256 residual = _mm256_sub_ps(hit[0], _mm256_fmadd_ps(
+                    _mm256_set1_ps(precalc->PRE_aff_mode[0]), color, _mm256_set1_ps(precalc->PRE_aff_mode[1])));
+            const __m256 drdA = _mm256_sub_ps(color, _mm256_set1_ps(precalc->PRE_b0_mode));
+
+            // gradient based weight and huber weight
+            const __m256 thSum = _mm256_set1_ps(setting_outlierTHSumComponent);
+            const __m256 gradSq = _mm256_fmadd_ps(hit[1], hit[1], _mm256_mul_ps(hit[2], hit[2]));
+            __m256 w = _mm256_sqrt_ps(_mm256_div_ps(thSum, _mm256_add_ps(thSum, gradSq)));
+            w = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_add_ps(w, _mm256_loadu_ps(p->weights)));
+
+            const __m256 one = _mm256_set1_ps(1);
+            const __m256 huberTH = _mm256_set1_ps(setting_huberTH);
+            const __m256 absRes = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), residual);
+            __m256 hw = _mm256_blendv_ps(_mm256_div_ps(huberTH, absRes), one,
+                                         _mm256_cmp_ps(absRes, huberTH, _CMP_LT_OQ));
+
+            energyLeft += hsum256(_mm256_mul_ps(
+                    _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_mul_ps(hw, _mm256_mul_ps(residual, residual))),
+                    _mm256_sub_ps(_mm256_set1_ps(2), hw)));
+
+            hw = _mm256_blendv_ps(hw, _mm256_sqrt_ps(hw), _mm256_cmp_ps(hw, one, _CMP_LT_OQ));
+            hw = _mm256_mul_ps(hw, w);
+
+            const __m256 gx = _mm256_mul_ps(hit[1], hw);
+            const __m256 gy = _mm256_mul_ps(hit[2], hw);
+            const __m256 drdAhw = _mm256_mul_ps(drdA, hw);
+            const __m256 hw2 = _mm256_mul_ps(hw, hw);
+
+            _mm256_storeu_ps(blk->resF[i].data(), _mm256_mul_ps(residual, hw));
+            _mm256_storeu_ps(blk->JIdx[0][i].data(), gx);
+            _mm256_storeu_ps(blk->JIdx[1][i].data(), gy);
+            _mm256_storeu_ps(blk->JabF[0][i].data(), setting_affineOptModeA < 0 ? _mm256_setzero_ps() : drdAhw);
+            _mm256_storeu_ps(blk->JabF[1][i].data(), setting_affineOptModeB < 0 ? _mm256_setzero_ps() : hw);
+
+            const float JIdxJIdx_00 = hsum256(_mm256_mul_ps(gx, gx));
+            const float JIdxJIdx_11 = hsum256(_mm256_mul_ps(gy, gy));
+            const float JIdxJIdx_10 = hsum256(_mm256_mul_ps(gx, gy));
+            const float JabJab_01 = hsum256(_mm256_mul_ps(drdAhw, hw));
+
+            Mat22f &JIdx2 = blk->JIdx2[i];
+            Mat22f &JabJIdx = blk->JabJIdx[i];
+            Mat22f &Jab2 = blk->Jab2[i];
+            JIdx2(0, 0) = JIdxJIdx_00;
+            JIdx2(0, 1) = JIdxJIdx_10;
+            JIdx2(1, 0) = JIdxJIdx_10;
+            JIdx2(1, 1) = JIdxJIdx_11;
+            JabJIdx(0, 0) = hsum256(_mm256_mul_ps(drdAhw, gx));
+            JabJIdx(0, 1) = hsum256(_mm256_mul_ps(drdAhw, gy));
+            JabJIdx(1, 0) = hsum256(_mm256_mul_ps(hw, gx));
+            JabJIdx(1, 1) = hsum256(_mm256_mul_ps(hw, gy));
+            Jab2(0, 0) = hsum256(_mm256_mul_ps(drdAhw, drdAhw));
+            Jab2(0, 1) = JabJab_01;
+            Jab2(1, 0) = JabJab_01;
+            Jab2(1, 1) = hsum256(hw2);
+
+            wJI2_sum += hsum256(_mm256_mul_ps(hw2, _mm256_fmadd_ps(gx, gx, _mm256_mul_ps(gy, gy))));
+            return true;
+        }
+#endif
+
+        PointFrameResidual::PointFrameResidual(shared_ptr<PointHessian> point_, shared_ptr<FrameHessian> host_,
+                                               shared_ptr<FrameHessian> target_) {
+            point = point_;
+            host = host_;
+            target = target_;
+            pointHandle = point_->poolHandle;
+            hostFH = host_.get();
+            targetFH = target_.get();
+            resetOOB();
+        }
+
         double PointFrameResidual::linearize(shared_ptr<CalibHessian> &HCalib) {
 
             // compute jacobians
@@ -20,9 +187,11 @@ namespace ldso {
                 return state_energy;
             }
 
-            shared_ptr<FrameHessian> f = host.lock();
-            shared_ptr<FrameHessian> ftarget = target.lock();
-            shared_ptr<PointHessian> fPoint = point.lock();
+            FrameHessian *f = getHost();
+            FrameHessian *ftarget = getTarget();
+            PointHessian *fPoint = getPoint();
+            ResidualBlock *blk = block;
+            const int i = blockIdx;
             FrameFramePrecalc *precalc = &(f->targetPrecalc[ftarget->idx]);
 
             float energyLeft = 0;
@@ -53,8 +222,7 @@ namespace ldso {
                 Vec3f KliP;
 
                 // 重投影
-                shared_ptr<PointHessian> p = point.lock();
-                if (!projectPoint(p->u, p->v, p->idepth_zero_scaled, 0, 0, HCalib,
+                if (!projectPoint(fPoint->u, fPoint->v, fPoint->idepth_zero_scaled, 0, 0, HCalib,
                                   PRE_RTll_0, PRE_tTll_0, drescale, u, v, Ku, Kv, KliP, new_idepth)) {
                     state_NewState = ResState::OOB;
                     return state_energy;
@@ -106,99 +274,102 @@ namespace ldso {
 
 
             {
-                J->Jpdxi[0] = d_xi_x;
-                J->Jpdxi[1] = d_xi_y;
+                blk->Jpdxi[0][i] = d_xi_x;
+                blk->Jpdxi[1][i] = d_xi_y;
 
-                J->Jpdc[0] = d_C_x;
-                J->Jpdc[1] = d_C_y;
+                blk->Jpdc[0][i] = d_C_x;
+                blk->Jpdc[1][i] = d_C_y;
 
-                J->Jpdd[0] = d_d_x;
-                J->Jpdd[1] = d_d_y;
+                blk->Jpdd[i][0] = d_d_x;
+                blk->Jpdd[i][1] = d_d_y;
 
             }
 
-            float JIdxJIdx_00 = 0, JIdxJIdx_11 = 0, JIdxJIdx_10 = 0;
-            float JabJIdx_00 = 0, JabJIdx_01 = 0, JabJIdx_10 = 0, JabJIdx_11 = 0;
-            float JabJab_00 = 0, JabJab_01 = 0, JabJab_11 = 0;
-
             float wJI2_sum = 0;
 
-            for (int idx = 0; idx < patternNum; idx++) {
-                float Ku, Kv;
-                shared_ptr<PointHessian> p = point.lock();
-                if (!projectPoint(p->u + patternP[idx][0], p->v + patternP[idx][1], p->idepth_scaled,
-                                  PRE_KRKiTll, PRE_KtTll, Ku, Kv)) {
+#if LDSO_HAS_AVX2
+            if (useAVX2()) {
+                if (!linearizePatternAVX(fPoint, precalc, dIl, projectedTo, blk, i, energyLeft, wJI2_sum)) {
                     state_NewState = ResState::OOB;
                     return state_energy;
                 }
+            } else
+#endif
+            {
+                float JIdxJIdx_00 = 0, JIdxJIdx_11 = 0, JIdxJIdx_10 = 0;
+                float JabJIdx_00 = 0, JabJIdx_01 = 0, JabJIdx_10 = 0, JabJIdx_11 = 0;
+                float JabJab_00 = 0, JabJab_01 = 0, JabJab_11 = 0;
+                VecNRf &resF = blk->resF[i];
+                VecNRf &JIdx0 = blk->JIdx[0][i], &JIdx1 = blk->JIdx[1][i];
+                VecNRf &JabF0 = blk->JabF[0][i], &JabF1 = blk->JabF[1][i];
 
-                projectedTo[idx][0] = Ku;
-                projectedTo[idx][1] = Kv;
+                for (int idx = 0; idx < patternNum; idx++) {
+                    float Ku, Kv;
+                    if (!projectPoint(fPoint->u + patternP[idx][0], fPoint->v + patternP[idx][1], fPoint->idepth_scaled,
+                                      PRE_KRKiTll, PRE_KtTll, Ku, Kv)) {
+                        state_NewState = ResState::OOB;
+                        return state_energy;
+                    }
 
-                Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
-                float residual = hitColor[0] - (float) (affLL[0] * color[idx] + affLL[1]);
+                    projectedTo[idx][0] = Ku;
+                    projectedTo[idx][1] = Kv;
 
-                float drdA = (color[idx] - b0);
-                if (!std::isfinite((float) hitColor[0])) {
-                    state_NewState = ResState::OOB;
-                    return state_energy;
-                }
+                    Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+                    float residual = hitColor[0] - (float) (affLL[0] * color[idx] + affLL[1]);
+
+                    float drdA = (color[idx] - b0);
+                    if (!std::isfinite((float) hitColor[0])) {
+                        state_NewState = ResState::OOB;
+                        return state_energy;
+                    }
 
 
-                float w = sqrtf(setting_outlierTHSumComponent /
-                                (setting_outlierTHSumComponent + hitColor.tail<2>().squaredNorm()));
-                w = 0.5f * (w + weights[idx]);
+                    float w = sqrtf(setting_outlierTHSumComponent /
+                                    (setting_outlierTHSumComponent + hitColor.tail<2>().squaredNorm()));
+                    w = 0.5f * (w + weights[idx]);
 
-                float hw = fabsf(residual) < setting_huberTH ? 1 : setting_huberTH / fabsf(residual);
-                energyLeft += w * w * hw * residual * residual * (2 - hw);
+                    float hw = fabsf(residual) < setting_huberTH ? 1 : setting_huberTH / fabsf(residual);
+                    energyLeft += w * w * hw * residual * residual * (2 - hw);
 
-                {
-                    if (hw < 1) hw = sqrtf(hw);
-                    hw = hw * w;
+                    {
+                        if (hw < 1) hw = sqrtf(hw);
+                        hw = hw * w;
 
-                    hitColor[1] *= hw;
-                    hitColor[2] *= hw;
+                        hitColor[1] *= hw;
+                        hitColor[2] *= hw;
 
-                    J->resF[idx] = residual * hw;
+                        resF[idx] = residual * hw;
 
-                    J->JIdx[0][idx] = hitColor[1];
-                    J->JIdx[1][idx] = hitColor[2];
-                    J->JabF[0][idx] = drdA * hw;
-                    J->JabF[1][idx] = hw;
+                        JIdx0[idx] = hitColor[1];
+                        JIdx1[idx] = hitColor[2];
+                        JabF0[idx] = drdA * hw;
+                        JabF1[idx] = hw;
 
-                    JIdxJIdx_00 += hitColor[1] * hitColor[1];
-                    JIdxJIdx_11 += hitColor[2] * hitColor[2];
-                    JIdxJIdx_10 += hitColor[1] * hitColor[2];
+                        JIdxJIdx_00 += hitColor[1] * hitColor[1];
+                        JIdxJIdx_11 += hitColor[2] * hitColor[2];
+                        JIdxJIdx_10 += hitColor[1] * hitColor[2];
 
-                    JabJIdx_00 += drdA * hw * hitColor[1];
-                    JabJIdx_01 += drdA * hw * hitColor[2];
-                    JabJIdx_10 += hw * hitColor[1];
-                    JabJIdx_11 += hw * hitColor[2];
+                        JabJIdx_00 += drdA * hw * hitColor[1];
+                        JabJIdx_01 += drdA * hw * hitColor[2];
+                        JabJIdx_10 += hw * hitColor[1];
+                        JabJIdx_11 += hw * hitColor[2];
 
-                    JabJab_00 += drdA * drdA * hw * hw;
-                    JabJab_01 += drdA * hw * hw;
-                    JabJab_11 += hw * hw;
+                        JabJab_00 += drdA * drdA * hw * hw;
+                        JabJab_01 += drdA * hw * hw;
+                        JabJab_11 += hw * hw;
 
-                    wJI2_sum += hw * hw * (hitColor[1] * hitColor[1] + hitColor[2] * hitColor[2]);
+                        wJI2_sum += hw * hw * (hitColor[1] * hitColor[1] + hitColor[2] * hitColor[2]);
 
-                    if (setting_affineOptModeA < 0) J->JabF[0][idx] = 0;
-                    if (setting_affineOptModeB < 0) J->JabF[1][idx] = 0;
+                        if (setting_affineOptModeA < 0) JabF0[idx] = 0;
+                        if (setting_affineOptModeB < 0) JabF1[idx] = 0;
 
+                    }
                 }
-            }
 
-            J->JIdx2(0, 0) = JIdxJIdx_00;
-            J->JIdx2(0, 1) = JIdxJIdx_10;
-            J->JIdx2(1, 0) = JIdxJIdx_10;
-            J->JIdx2(1, 1) = JIdxJIdx_11;
-            J->JabJIdx(0, 0) = JabJIdx_00;
-            J->JabJIdx(0, 1) = JabJIdx_01;
-            J->JabJIdx(1, 0) = JabJIdx_10;
-            J->JabJIdx(1, 1) = JabJIdx_11;
-            J->Jab2(0, 0) = JabJab_00;
-            J->Jab2(0, 1) = JabJab_01;
-            J->Jab2(1, 0) = JabJab_01;
-            J->Jab2(1, 1) = JabJab_11;
+                blk->JIdx2[i] << JIdxJIdx_00, JIdxJIdx_10, JIdxJIdx_10, JIdxJIdx_11;
+                blk->JabJIdx[i] << JabJIdx_00, JabJIdx_01, JabJIdx_10, JabJIdx_11;
+                blk->Jab2[i] << JabJab_00, JabJab_01, JabJab_01, JabJab_11;
+            }
 
             state_NewEnergyWithOutlier = energyLeft;
 
@@ -216,29 +387,36 @@ namespace ldso {
         void PointFrameResidual::fixLinearizationF(shared_ptr<EnergyFunctional> ef) {
 
             Vec8f dp = ef->adHTdeltaF[hostIDX + ef->nFrames * targetIDX];
+            const float pointDeltaF = getPoint()->deltaF;
+            ResidualBlock *blk = block;
+            const int i = blockIdx;
 
             // compute Jp*delta
-            __m128 Jp_delta_x = _mm_set1_ps(J->Jpdxi[0].dot(dp.head<6>())
-                                            + J->Jpdc[0].dot(ef->cDeltaF)
-                                            + J->Jpdd[0] * point.lock()->deltaF);
-            __m128 Jp_delta_y = _mm_set1_ps(J->Jpdxi[1].dot(dp.head<6>())
-                                            + J->Jpdc[1].dot(ef->cDeltaF)
-                                            + J->Jpdd[1] * point.lock()->deltaF);
+            __m128 Jp_delta_x = _mm_set1_ps(blk->Jpdxi[0][i].dot(dp.head<6>())
+                                            + blk->Jpdc[0][i].dot(ef->cDeltaF)
+                                            + blk->Jpdd[i][0] * pointDeltaF);
+            __m128 Jp_delta_y = _mm_set1_ps(blk->Jpdxi[1][i].dot(dp.head<6>())
+                                            + blk->Jpdc[1][i].dot(ef->cDeltaF)
+                                            + blk->Jpdd[i][1] * pointDeltaF);
 
             __m128 delta_a = _mm_set1_ps((float) (dp[6]));
             __m128 delta_b = _mm_set1_ps((float) (dp[7]));
 
-            for (int i = 0; i < patternNum; i += 4) {
+            const float *resF = blk->resF[i].data();
+            const float *JIdx0 = blk->JIdx[0][i].data(), *JIdx1 = blk->JIdx[1][i].data();
+            const float *JabF0 = blk->JabF[0][i].data(), *JabF1 = blk->JabF[1][i].data();
+            float *resToZeroF = blk->resToZeroF[i].data();
+            for (int k = 0; k < patternNum; k += 4) {
                 // PATTERN: rtz = resF - [JI*Jp Ja]*delta.
-                __m128 rtz = _mm_load_ps(((float *) &J->resF) + i);
-                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (J->JIdx)) + i), Jp_delta_x));
-                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (J->JIdx + 1)) + i), Jp_delta_y));
-                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (J->JabF)) + i), delta_a));
-                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *) (J->JabF + 1)) + i), delta_b));
-                _mm_store_ps(((float *) &res_toZeroF) + i, rtz);
+                __m128 rtz = _mm_load_ps(resF + k);
+                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(JIdx0 + k), Jp_delta_x));
+                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(JIdx1 + k), Jp_delta_y));
+                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(JabF0 + k), delta_a));
+                rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(JabF1 + k), delta_b));
+                _mm_store_ps(resToZeroF + k, rtz);
             }
 
-            isLinearized = true;
+            blk->linearized[i] = 1;
         }
 
         /*
@@ -0,0 +1,195 @@
+/**
+ * Checks the AVX2 updates of Accumulator9 and Accumulator14 against the scalar and SSE updates and a double
+ * precision reference. The updates are mixed and run over enough terms to go through the 1k and 1m shift ups.
+ */
+
+#include "internal/OptimizationBackend/MatrixAccumulators.h"
+
+#include <cstdio>
+#include <random>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+#if LDSO_HAS_AVX2
+
+LDSO_TARGET_AVX2 static void updateAVX(Accumulator9 &acc, const float *J, const float *w) {
+    acc.updateAVX_eighted(_mm256_loadu_ps(J), _mm256_loadu_ps(J + 8), _mm256_loadu_ps(J + 16),
+                          _mm256_loadu_ps(J + 24), _mm256_loadu_ps(J + 32), _mm256_loadu_ps(J + 40),
+                          _mm256_loadu_ps(J + 48), _mm256_loadu_ps(J + 56), _mm256_loadu_ps(J + 64),
+                          _mm256_loadu_ps(w));
+}
+
+LDSO_TARGET_AVX2 static void updateAVX(Accumulator14 &acc, const float *J) {
+    acc.updateAVX(_mm256_loadu_ps(J), _mm256_loadu_ps(J + 8), _mm256_loadu_ps(J + 16), _mm256_loadu_ps(J + 24),
+                  _mm256_loadu_ps(J + 32), _mm256_loadu_ps(J + 40), _mm256_loadu_ps(J + 48),
+                  _mm256_loadu_ps(J + 56), _mm256_loadu_ps(J + 64), _mm256_loadu_ps(J + 72),
+                  _mm256_loadu_ps(J + 80), _mm256_loadu_ps(J + 88), _mm256_loadu_ps(J + 96),
+                  _mm256_loadu_ps(J + 104));
+}
+
+#endif
+
+static void updateSSE(Accumulator9 &acc, const float *J, const float *w) {
+    for (int k = 0; k < 8; k += 4)
+        acc.updateSSE_eighted(_mm_loadu_ps(J + k), _mm_loadu_ps(J + 8 + k), _mm_loadu_ps(J + 16 + k),
+                              _mm_loadu_ps(J + 24 + k), _mm_loadu_ps(J + 32 + k), _mm_loadu_ps(J + 40 + k),
+                              _mm_loadu_ps(J + 48 + k), _mm_loadu_ps(J + 56 + k), _mm_loadu_ps(J + 64 + k),
+                              _mm_loadu_ps(w + k));
+}
+
+static void updateSSE(Accumulator14 &acc, const float *J) {
+    for (int k = 0; k < 8; k += 4)
+        acc.updateSSE(_mm_loadu_ps(J + k), _mm_loadu_ps(J + 8 + k), _mm_loadu_ps(J + 16 + k),
+                      _mm_loadu_ps(J + 24 + k), _mm_loadu_ps(J + 32 + k), _mm_loadu_ps(J + 40 + k),
+                      _mm_loadu_ps(J + 48 + k), _mm_loadu_ps(J + 56 + k), _mm_loadu_ps(J + 64 + k),
+                      _mm_loadu_ps(J + 72 + k), _mm_loadu_ps(J + 80 + k), _mm_loadu_ps(J + 88 + k),
+                      _mm_loadu_ps(J + 96 + k), _mm_loadu_ps(J + 104 + k));
+}
+
+static void updateSingle(Accumulator9 &acc, const float *J, const float *w) {
+    for (int k = 0; k < 8; k++)
+        acc.updateSingleWeighted(J[k], J[8 + k], J[16 + k], J[24 + k], J[32 + k], J[40 + k], J[48 + k],
+                                 J[56 + k], J[64 + k], w[k]);
+}
+
+static void updateSingle(Accumulator14 &acc, const float *J) {
+    for (int k = 0; k < 8; k++)
+        acc.updateSingle(J[k], J[8 + k], J[16 + k], J[24 + k], J[32 + k], J[40 + k], J[48 + k], J[56 + k],
+                         J[64 + k], J[72 + k], J[80 + k], J[88 + k], J[96 + k], J[104 + k]);
+}
+
+// relative deviation of H from the reference, in units of the largest reference entry
+template<int N>
+static double deviation(const Eigen::Matrix<float, N, N> &H, const Eigen::Matrix<double, N, N> &ref) {
+    return (H.template cast<double>() - ref).cwiseAbs().maxCoeff() / ref.cwiseAbs().maxCoeff();
+}
+
+#if LDSO_HAS_AVX2
+
+const int N = 200000;     // blocks of 8 terms
+const double TH = 1e-4;
+
+static bool checkAccumulator9() {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+
+    Accumulator9 accAVX, accMixed, accSingle;
+    accAVX.initialize();
+    accMixed.initialize();
+    accSingle.initialize();
+    Eigen::Matrix<double, 9, 9> ref = Eigen::Matrix<double, 9, 9>::Zero();
+
+    float J[9 * 8], w[8];
+    for (int n = 0; n < N; n++) {
+        for (int i = 0; i < 9 * 8; i++)
+            J[i] = uniform(rng) * (1 + i / 8);     // different scales per row
+        for (int k = 0; k < 8; k++)
+            w[k] = 0.5f + 0.5f * uniform(rng);
+
+        for (int k = 0; k < 8; k++) {
+            Eigen::Matrix<double, 9, 1> j;
+            for (int r = 0; r < 9; r++)
+                j[r] = J[8 * r + k];
+            ref += w[k] * j * j.transpose();
+        }
+
+        updateAVX(accAVX, J, w);
+        updateSingle(accSingle, J, w);
+        switch (n % 3) {
+            case 0:
+                updateAVX(accMixed, J, w);
+                break;
+            case 1:
+                updateSSE(accMixed, J, w);
+                break;
+            default:
+                updateSingle(accMixed, J, w);
+        }
+    }
+    accAVX.finish();
+    accMixed.finish();
+    accSingle.finish();
+
+    double devAVX = deviation(accAVX.H, ref), devMixed = deviation(accMixed.H, ref);
+    double devSingle = deviation(accSingle.H, ref);
+    printf("Accumulator9 terms: avx %zu, mixed %zu, single %zu\n", accAVX.num, accMixed.num, accSingle.num);
+    printf("Accumulator9 deviation from double reference: avx %g, mixed %g, single %g\n", devAVX, devMixed,
+           devSingle);
+
+    return accAVX.num == size_t(8 * N) && accMixed.num == size_t(8 * N) && accSingle.num == size_t(8 * N) &&
+           devAVX < TH && devMixed < TH && devSingle < TH &&
+           deviation(accAVX.H, Eigen::Matrix<double, 9, 9>(accSingle.H.cast<double>())) < TH;
+}
+
+static bool checkAccumulator14() {
+    std::mt19937 rng(43);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+
+    Accumulator14 accAVX, accMixed, accSingle;
+    accAVX.initialize();
+    accMixed.initialize();
+    accSingle.initialize();
+    Eigen::Matrix<double, 14, 14> ref = Eigen::Matrix<double, 14, 14>::Zero();
+
+    float J[14 * 8];
+    for (int n = 0; n < N; n++) {
+        for (int i = 0; i < 14 * 8; i++)
+            J[i] = uniform(rng) * (1 + i / 16);    // different scales per pair of rows
+
+        for (int k = 0; k < 8; k++) {
+            Eigen::Matrix<double, 14, 1> j;
+            for (int r = 0; r < 14; r++)
+                j[r] = J[8 * r + k];
+            ref += j * j.transpose();
+        }
+
+        updateAVX(accAVX, J);
+        updateSingle(accSingle, J);
+        switch (n % 3) {
+            case 0:
+                updateAVX(accMixed, J);
+                break;
+            case 1:
+                updateSSE(accMixed, J);
+                break;
+            default:
+                updateSingle(accMixed, J);
+        }
+    }
+    // finish() of Accumulator14 sets num to the number of update calls, count the terms before
+    size_t numAVX = accAVX.num, numMixed = accMixed.num, numSingle = accSingle.num;
+    accAVX.finish();
+    accMixed.finish();
+    accSingle.finish();
+
+    double devAVX = deviation(accAVX.H, ref), devMixed = deviation(accMixed.H, ref);
+    double devSingle = deviation(accSingle.H, ref);
+    printf("Accumulator14 terms: avx %zu, mixed %zu, single %zu\n", numAVX, numMixed, numSingle);
+    printf("Accumulator14 deviation from double reference: avx %g, mixed %g, single %g\n", devAVX, devMixed,
+           devSingle);
+
+    return numAVX == size_t(8 * N) && numMixed == size_t(8 * N) && numSingle == size_t(8 * N) &&
+           devAVX < TH && devMixed < TH && devSingle < TH &&
+           deviation(accAVX.H, Eigen::Matrix<double, 14, 14>(accSingle.H.cast<double>())) < TH;
+}
+
+#endif
+
+int main() {
+
+    if (!useAVX2()) {
+        printf("cpu has no AVX2/FMA, nothing to check\n");
+        return 0;
+    }
+
+#if LDSO_HAS_AVX2
+    bool ok9 = checkAccumulator9();
+    bool ok14 = checkAccumulator14();
+    bool ok = ok9 && ok14;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+#else
+    return 0;
+#endif
+}
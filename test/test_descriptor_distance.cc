@@ -0,0 +1,78 @@
+/**
+ * Checks FeatureMatcher::DescriptorDistances, the AVX2 path and the scalar path, against a bit by bit hamming
+ * distance. The descriptors are random, plus the extremes (equal, complementary), and the counts go through all
+ * remainders modulo 4 and 8. Each batch is copied into a buffer of exactly 32 * n bytes, so a kernel reading past the
+ * last descriptor shows up under a memory checker.
+ */
+
+#include "frontend/FeatureMatcher.h"
+#include "internal/CPUFeatures.h"
+
+#include <cstdio>
+#include <random>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+// number of differing bits, one at a time
+static int referenceDistance(const unsigned char *a, const unsigned char *b) {
+    int dist = 0;
+    for (int i = 0; i < 32; i++)
+        for (int bit = 0; bit < 8; bit++)
+            dist += ((a[i] ^ b[i]) >> bit) & 1;
+    return dist;
+}
+
+int main() {
+
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    const bool haveAVX2 = useAVX2();
+    int numChecked = 0, mismatchAVX = 0, mismatchScalar = 0, mismatchSingle = 0;
+    for (int n = 0; n <= 67; n++) {
+        unsigned char desc[32];
+        for (int i = 0; i < 32; i++)
+            desc[i] = byte(rng);
+
+        vector<unsigned char> descs(32 * n);
+        for (int k = 0; k < n; k++) {
+            unsigned char *d = descs.data() + 32 * k;
+            for (int i = 0; i < 32; i++) {
+                if (k == 0)
+                    d[i] = desc[i];                         // distance 0
+                else if (k == 1)
+                    d[i] = (unsigned char) ~desc[i];        // distance 256
+                else if (k == 2)
+                    d[i] = desc[i] ^ (1 << (i % 8));        // one bit per byte
+                else
+                    d[i] = byte(rng);
+            }
+        }
+
+        vector<int> distAVX(n, -1), distScalar(n, -1);
+        setting_useAVX2 = true;
+        FeatureMatcher::DescriptorDistances(desc, descs.data(), n, distAVX.data());
+        setting_useAVX2 = false;
+        FeatureMatcher::DescriptorDistances(desc, descs.data(), n, distScalar.data());
+        setting_useAVX2 = true;
+
+        for (int k = 0; k < n; k++) {
+            int ref = referenceDistance(desc, descs.data() + 32 * k);
+            if (distAVX[k] != ref)
+                mismatchAVX++;
+            if (distScalar[k] != ref)
+                mismatchScalar++;
+            if (FeatureMatcher::DescriptorDistance(desc, descs.data() + 32 * k) != ref)
+                mismatchSingle++;
+            numChecked++;
+        }
+    }
+
+    printf("%d distances checked, avx2 path %s\n", numChecked, haveAVX2 ? "used" : "not available");
+    printf("mismatches: avx2 %d, scalar %d, DescriptorDistance %d\n", mismatchAVX, mismatchScalar, mismatchSingle);
+
+    bool ok = numChecked > 0 && mismatchAVX == 0 && mismatchScalar == 0 && mismatchSingle == 0;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
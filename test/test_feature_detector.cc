@@ -0,0 +1,283 @@
+/**
+ * Checks the corner detection of FeatureDetector on a real image, doc/figs/nullspace.jpg unless another one is given.
+ * The grid non-maximum suppression has to keep the same corners as the pairwise comparison of all corners it
+ * replaced, on the corners of the image and on dense synthetic corners with tied scores. The AVX2 orientation and
+ * descriptor have to agree with the scalar ones on all the features of the image: the angles up to rounding, the
+ * descriptors exactly when the angles fall into the same orientation bin, and always with the scalar descriptor
+ * of the AVX2 angle. The shi-tomasi scores of ShiTomasiCell, with and without AVX2, have to agree with
+ * ShiTomasiScore of each pixel, for cells at every alignment, including the ones at the border. They are checked on
+ * the image and on its central half, because the border of the image itself is flat.
+ */
+
+#include "Feature.h"
+#include "frontend/FeatureDetector.h"
+#include "frontend/ImageRW.h"
+#include "internal/CalibHessian.h"
+#include "internal/GlobalCalib.h"
+#include "internal/CPUFeatures.h"
+
+#include <cstdio>
+#include <random>
+#include <cstring>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+/**
+ * load a grayscale image into a frame, cropped to a multiple of 16 pixels so the pyramid has enough levels
+ * @param center only the central half of the image, so the border of the frame cuts through its content
+ * @return null if the image can't be read
+ */
+static shared_ptr<Frame> loadFrame(const string &path, const shared_ptr<CalibHessian> &Hcalib, bool center = false) {
+    MinimalImageB *img = IOWrap::readImageBW_8U(path);
+    if (img == nullptr)
+        return nullptr;
+    const int w = (center ? img->w / 2 : img->w) & ~15, h = (center ? img->h / 2 : img->h) & ~15;
+    const int left = center ? img->w / 4 : 0, top = center ? img->h / 4 : 0;
+    Mat33f K;
+    K << 500, 0, w / 2, 0, 500, h / 2, 0, 0, 1;
+    setGlobalCalib(w, h, K);
+
+    vector<float> color(w * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            color[y * w + x] = img->data[(top + y) * img->w + left + x];
+    delete img;
+
+    shared_ptr<Frame> frame(new Frame(0));
+    frame->CreateFH(frame);
+    frame->frameHessian->makeImages(color.data(), Hcalib);
+    return frame;
+}
+
+// trace of the structure tensor of ShiTomasiScore, the scale of the rounding error of its smaller eigenvalue
+static float structureTrace(const shared_ptr<Frame> &frame, int u, int v, int halfbox = 4) {
+    if (u - halfbox < 1 || u + halfbox >= wG[0] - 1 || v - halfbox < 1 || v + halfbox >= hG[0] - 1)
+        return 0;
+    float trace = 0;
+    for (int y = v - halfbox; y < v + halfbox; y++) {
+        for (int x = u - halfbox; x < u + halfbox; x++) {
+            const Vec3f &d = frame->frameHessian->dIp[0][y * wG[0] + x];
+            trace += d[1] * d[1] + d[2] * d[2];
+        }
+    }
+    return trace / (2 * 4 * halfbox * halfbox);
+}
+
+// the non-maximum suppression DetectCorners used before the grid, every pair of corners is compared
+static void pairwiseSuppression(vector<shared_ptr<Feature>> &corners) {
+    for (int i = 0; i < corners.size(); i++) {
+        for (int j = i + 1; j < corners.size(); j++) {
+            auto &feat1 = corners[i], feat2 = corners[j];
+            if ((feat1->uv - feat2->uv).norm() < 5) {
+                if (feat1->score > feat2->score)
+                    feat2->isCorner = false;
+                else
+                    feat1->isCorner = false;
+            }
+        }
+    }
+}
+
+/**
+ * run the grid and the pairwise suppression on copies of the corners
+ * @return number of corners where they differ
+ */
+static int compareSuppression(FeatureDetector &detector, const shared_ptr<Frame> &frame,
+                              const vector<pair<Vec2f, float>> &corners, int &kept) {
+    vector<shared_ptr<Feature>> grid, pairwise;
+    for (auto &c : corners) {
+        for (auto *set : {&grid, &pairwise}) {
+            shared_ptr<Feature> feat = Feature::Create(c.first[0], c.first[1], frame);
+            feat->score = c.second;
+            feat->isCorner = true;
+            set->push_back(feat);
+        }
+    }
+    detector.SuppressNonMaxima(grid);
+    pairwiseSuppression(pairwise);
+
+    int differ = 0;
+    for (size_t i = 0; i < corners.size(); i++) {
+        differ += grid[i]->isCorner != pairwise[i]->isCorner;
+        kept += pairwise[i]->isCorner;
+    }
+    return differ;
+}
+
+/**
+ * compare the shi-tomasi scores of ShiTomasiCell, with and without AVX2, with ShiTomasiScore of each pixel
+ * Cells of a few sizes, the grid shifted by every offset up to the cell size, so the cells next to the border are at
+ * every distance from it.
+ * @param maxError largest difference relative to the trace of the structure tensor, scalar and avx2
+ */
+static void compareShiTomasi(FeatureDetector &detector, shared_ptr<Frame> &frame, float maxError[2],
+                             float &maxScore, int &numScores, int &numBorderCells) {
+    const int sizes[] = {8, 11, 16};
+    vector<float> scores;
+    for (int size : sizes) {
+        scores.resize(size * size);
+        for (int offset = 0; offset < size; offset++) {
+            for (int y0 = offset; y0 + size <= hG[0]; y0 += size) {
+                for (int x0 = offset; x0 + size <= wG[0]; x0 += size) {
+                    numBorderCells += x0 < 5 || y0 < 5 || x0 + size + 4 >= wG[0] - 1 || y0 + size + 4 >= hG[0] - 1;
+                    for (int avx = 0; avx < 2; avx++) {
+                        setting_useAVX2 = avx == 1;
+                        detector.ShiTomasiCell(frame, x0, y0, size, scores.data());
+                        for (int y = 0; y < size; y++) {
+                            for (int x = 0; x < size; x++) {
+                                float ref = detector.ShiTomasiScore(frame, x0 + x, y0 + y);
+                                float error = fabs(scores[y * size + x] - ref);
+                                if (error > 0)      // infinite where the score has to be 0, next to the border
+                                    error /= structureTrace(frame, x0 + x, y0 + y);
+                                maxScore = max(maxScore, ref);
+                                maxError[avx] = max(maxError[avx], error);
+                            }
+                        }
+                    }
+                    numScores += size * size;
+                }
+            }
+        }
+    }
+    setting_useAVX2 = true;
+}
+
+int main(int argc, char **argv) {
+
+    const string path = argc > 1 ? argv[1] : "doc/figs/nullspace.jpg";
+    shared_ptr<Camera> cam(new Camera(500, 500, 0, 0));
+    shared_ptr<CalibHessian> Hcalib(new CalibHessian(cam));
+    shared_ptr<Frame> frame = loadFrame(path, Hcalib);
+    if (frame == nullptr) {
+        printf("could not read %s\n", path.c_str());
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("image %s, %d x %d\n", path.c_str(), wG[0], hG[0]);
+
+    FeatureDetector detector;
+    int numCorners = detector.DetectCorners(setting_desiredImmatureDensity, frame, false);
+
+    // the corners of the image before the suppression, as DetectCorners selects them
+    float maxScore = 0;
+    for (auto &feat : frame->features)
+        maxScore = max(maxScore, feat->score);
+    vector<pair<Vec2f, float>> imageCorners;
+    int detectedDiffer = 0;
+    {
+        vector<shared_ptr<Feature>> pairwise;
+        for (auto &feat : frame->features) {
+            if (feat->score > 0.01f * maxScore) {
+                imageCorners.push_back(make_pair(feat->uv, feat->score));
+                pairwise.push_back(Feature::Create(feat->uv[0], feat->uv[1], frame));
+                pairwise.back()->score = feat->score;
+                pairwise.back()->isCorner = true;
+            }
+        }
+        pairwiseSuppression(pairwise);
+        size_t k = 0;
+        for (auto &feat : frame->features)
+            if (feat->score > 0.01f * maxScore)
+                detectedDiffer += feat->isCorner != pairwise[k++]->isCorner;
+    }
+    int keptImage = 0;
+    int differImage = compareSuppression(detector, frame, imageCorners, keptImage);
+
+    // dense corners with few distinct scores, so many neighbours tie. Integer positions like DetectCorners gives,
+    // and arbitrary ones, also outside the image where the grid cells are clamped
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> score(0, 3);
+    int differSynthetic = 0, keptSynthetic = 0, numSynthetic = 0;
+    for (int trial = 0; trial < 20; trial++) {
+        const bool integer = trial % 2 == 0;
+        std::uniform_real_distribution<float> u(-3, wG[0] + 3), v(-3, hG[0] + 3);
+        vector<pair<Vec2f, float>> corners;
+        for (int i = 0; i < 3000; i++) {
+            Vec2f uv(u(rng), v(rng));
+            if (integer)
+                uv = Vec2f(int(uv[0]), int(uv[1]));
+            corners.push_back(make_pair(uv, float(score(rng))));
+        }
+        differSynthetic += compareSuppression(detector, frame, corners, keptSynthetic);
+        numSynthetic += corners.size();
+    }
+
+    // the scores are exact sums of multiples of 1/4 up to the eigenvalue, which loses half of the digits where the
+    // two eigenvalues are close: the bound is about twice the square root of the float epsilon, relative to the trace
+    const float THScore = 5e-4;
+    float maxScoreError[2] = {0, 0}, maxReference = 0;
+    int numScores = 0, numBorderCells = 0;
+    compareShiTomasi(detector, frame, maxScoreError, maxReference, numScores, numBorderCells);
+
+    // orientation and descriptor of all features, not only the corners, with the AVX2 and the scalar path
+    const bool haveAVX2 = useAVX2();
+    int numDescriptors = 0, angleBinDiffer = 0, descriptorDiffer = 0, descriptorOfAngleDiffer = 0;
+    float maxAngleError = 0;
+    if (haveAVX2) {
+        for (auto &feat : frame->features)
+            feat->isCorner = true;
+        setting_useAVX2 = false;
+        detector.ComputeDescriptors(frame);
+        vector<float> scalarAngles;
+        vector<unsigned char> scalarDescriptors;
+        for (auto &feat : frame->features) {
+            scalarAngles.push_back(feat->angle);
+            scalarDescriptors.insert(scalarDescriptors.end(), feat->descriptor, feat->descriptor + 32);
+        }
+        setting_useAVX2 = true;
+        detector.ComputeDescriptors(frame);
+
+        const float binWidth = float(2 * M_PI / detector.ORIENTATION_BINS);
+        for (size_t i = 0; i < frame->features.size(); i++) {
+            auto &feat = frame->features[i];
+            float error = fabs(feat->angle - scalarAngles[i]);
+            error = min(error, float(2 * M_PI) - error);
+            maxAngleError = max(maxAngleError, error);
+            const bool sameDescriptor = memcmp(feat->descriptor, &scalarDescriptors[32 * i], 32) == 0;
+
+            // the bins of two angles closer than half a bin differ only if a boundary lies between them
+            float binScalar = scalarAngles[i] / binWidth + 0.5f, binAVX = feat->angle / binWidth + 0.5f;
+            if (floorf(binScalar) != floorf(binAVX))
+                angleBinDiffer++;
+            else
+                descriptorDiffer += !sameDescriptor;
+
+            // the scalar descriptor of the AVX2 angle
+            unsigned char avxDescriptor[32];
+            memcpy(avxDescriptor, feat->descriptor, 32);
+            detector.ComputeDescriptor(frame, feat);
+            descriptorOfAngleDiffer += memcmp(avxDescriptor, feat->descriptor, 32) != 0;
+            numDescriptors++;
+        }
+    }
+    frame->ReleaseAll();
+
+    // the border of the full image is flat, the one of its center isn't
+    shared_ptr<Frame> centerFrame = loadFrame(path, Hcalib, true);
+    compareShiTomasi(detector, centerFrame, maxScoreError, maxReference, numScores, numBorderCells);
+    centerFrame->ReleaseAll();
+
+    printf("suppression: image %d corners, %d kept, DetectCorners differs in %d, SuppressNonMaxima in %d\n",
+           int(imageCorners.size()), keptImage, detectedDiffer, differImage);
+    printf("suppression: %d synthetic corners, %d kept, %d differ\n", numSynthetic, keptSynthetic, differSynthetic);
+
+    printf("shi-tomasi: %d scores of the image and its center, %d border cells, largest score %g, largest error relative to "
+           "the trace %g scalar, %g avx2%s\n", numScores, numBorderCells, maxReference, maxScoreError[0], maxScoreError[1],
+           haveAVX2 ? "" : " (not available, scalar)");
+    if (haveAVX2) {
+        printf("orientation: %d features, largest angle difference %g rad, %d in another bin\n", numDescriptors,
+               maxAngleError, angleBinDiffer);
+        printf("descriptor: %d differ in the same bin, %d differ from the scalar one of the avx2 angle\n",
+               descriptorDiffer, descriptorOfAngleDiffer);
+    } else {
+        printf("cpu has no AVX2/FMA, orientation and descriptor not checked\n");
+    }
+
+    bool ok = numCorners > 0 && keptImage == numCorners && detectedDiffer == 0 && differImage == 0 &&
+              differSynthetic == 0 && numScores > 0 && numBorderCells > 0 && maxScoreError[0] < THScore &&
+              maxScoreError[1] < THScore && (!haveAVX2 || (numDescriptors > 0 && maxAngleError < 1e-4 &&
+                                                     descriptorDiffer == 0 && descriptorOfAngleDiffer == 0));
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
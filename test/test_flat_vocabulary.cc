@@ -0,0 +1,203 @@
+/**
+ * Checks FlatVocabulary against DBoW3 on small vocabularies trained on clustered random descriptors: Transform has
+ * to give the bow vectors and feature vectors of DBoW3::Vocabulary::transform, for the converted and for the mapped
+ * flat vocabulary, with and without AVX2 and threads. The second vocabulary has branches that end above the last
+ * level, where DBoW3 leaves the node id unset. Also checks that Load fails cleanly, without leaving a .flat
+ * file behind, on a missing vocabulary and on truncated flat and DBoW3 files.
+ */
+
+#include "FlatVocabulary.h"
+#include "internal/CPUFeatures.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <climits>
+#include <unistd.h>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+static std::mt19937 rng(9);
+
+// descriptors around a few centers, a descriptor per row
+static cv::Mat clusteredDescriptors(const vector<cv::Mat> &centers, int n, int flips) {
+    cv::Mat descs(n, 32, CV_8U);
+    std::uniform_int_distribution<int> center(0, centers.size() - 1), bit(0, 255);
+    for (int i = 0; i < n; i++) {
+        memcpy(descs.ptr<unsigned char>(i), centers[center(rng)].ptr<unsigned char>(0), 32);
+        for (int f = 0; f < flips; f++) {
+            int b = bit(rng);
+            descs.ptr<unsigned char>(i)[b / 8] ^= 1 << (b % 8);
+        }
+    }
+    return descs;
+}
+
+static bool exists(const string &path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// copy the first bytes of a file
+static void truncateCopy(const string &from, const string &to, size_t bytes) {
+    ifstream fin(from, ios::binary);
+    vector<char> data(bytes);
+    fin.read(data.data(), bytes);
+    ofstream(to, ios::binary).write(data.data(), fin.gcount());
+}
+
+static size_t fileSize(const string &path) {
+    ifstream fin(path, ios::binary | ios::ate);
+    return fin.tellg();
+}
+
+static bool sameBowVector(const DBoW3::BowVector &a, const DBoW3::BowVector &ref) {
+    if (a.size() != ref.size())
+        return false;
+    for (auto ia = a.begin(), ir = ref.begin(); ir != ref.end(); ++ia, ++ir)
+        if (ia->first != ir->first || fabs(ia->second - ir->second) > 1e-12 * std::max(1.0, fabs(ir->second)))
+            return false;
+    return true;
+}
+
+/**
+ * DBoW3 vocabulary that also gives a reference feature vector where DBoW3 leaves node ids unset: for words above the
+ * level of the node ids FlatVocabulary uses the node of the word
+ */
+class ReferenceVocabulary : public DBoW3::Vocabulary {
+public:
+    using DBoW3::Vocabulary::Vocabulary;
+
+    void transformReference(const vector<cv::Mat> &features, DBoW3::BowVector &bowVec, DBoW3::FeatureVector &featVec,
+                            int levelsup) const {
+        transform(features, bowVec);
+        featVec.clear();
+        for (size_t i = 0; i < features.size(); i++) {
+            DBoW3::WordId wordId;
+            DBoW3::WordValue weight;
+            DBoW3::NodeId nid = UINT_MAX;
+            transform(features[i], wordId, weight, &nid, levelsup);
+            if (weight <= 0)
+                continue;
+            if (nid == UINT_MAX) {
+                nid = m_words[wordId]->id;
+                numWordsAboveLevel++;
+            }
+            featVec.addFeature(nid, i);
+        }
+    }
+
+    mutable int numWordsAboveLevel = 0;
+};
+
+struct Config {
+    int k, L;
+    DBoW3::WeightingType weighting;
+    DBoW3::ScoringType scoring;
+    bool compressed;
+};
+
+int main() {
+
+    char dirTemplate[] = "/tmp/test_flat_vocabulary_XXXXXX";
+    const string dir = mkdtemp(dirTemplate);
+
+    vector<cv::Mat> centers;
+    for (int c = 0; c < 80; c++) {
+        cv::Mat center(1, 32, CV_8U);
+        for (int i = 0; i < 32; i++)
+            center.ptr<unsigned char>(0)[i] = rng();
+        centers.push_back(center);
+    }
+
+    IndexThreadReduce<Vec10> threadReduce;
+    const Config configs[] = {{8, 3, DBoW3::TF_IDF, DBoW3::L1_NORM, true},
+                              {5, 4, DBoW3::TF, DBoW3::L2_NORM, false}};
+    int numTransforms = 0, numMismatches = 0, numLoaded = 0, numWordsAboveLevel = 0;
+    bool loadFailuresOk = true;
+    string dbow3Path;
+    for (const Config &config : configs) {
+        vector<cv::Mat> training;
+        for (int image = 0; image < 40; image++)
+            training.push_back(clusteredDescriptors(centers, 100, 20));
+        ReferenceVocabulary voc(config.k, config.L, config.weighting, config.scoring);
+        voc.create(training);
+
+        dbow3Path = dir + "/voc" + to_string(config.k) + ".dbow3";
+        voc.save(dbow3Path, config.compressed);
+
+        // the first load converts and saves the .flat file, the second one maps it
+        FlatVocabulary converted, mapped;
+        numLoaded += converted.Load(dbow3Path) && exists(dbow3Path + ".flat") && mapped.Load(dbow3Path);
+        if (converted.size() != voc.size() || mapped.size() != voc.size()) {
+            numMismatches++;
+            continue;
+        }
+
+        cv::Mat queries = clusteredDescriptors(centers, 300, 30);
+        queries.push_back(clusteredDescriptors(centers, 100, 128));    // far from every center
+        vector<unsigned char> descs(32 * queries.rows);
+        vector<cv::Mat> queryRows;
+        for (int i = 0; i < queries.rows; i++) {
+            memcpy(descs.data() + 32 * i, queries.ptr<unsigned char>(i), 32);
+            queryRows.push_back(queries.row(i));
+        }
+
+        for (int levelsup = 0; levelsup < config.L; levelsup++) {
+            DBoW3::BowVector bowRef;
+            DBoW3::FeatureVector featRef;
+            voc.transformReference(queryRows, bowRef, featRef, levelsup);
+
+            for (int variant = 0; variant < 8; variant++) {
+                const FlatVocabulary &flat = variant & 1 ? mapped : converted;
+                setting_useAVX2 = variant & 2;
+                DBoW3::BowVector bow;
+                DBoW3::FeatureVector feat;
+                flat.Transform(descs.data(), queries.rows, bow, feat, levelsup, variant & 4 ? &threadReduce : nullptr);
+                numMismatches += !sameBowVector(bow, bowRef) || feat != featRef;
+                numTransforms++;
+            }
+            setting_useAVX2 = true;
+        }
+        numWordsAboveLevel += voc.numWordsAboveLevel;
+    }
+
+    // failed loads return false and don't write a flat vocabulary
+    FlatVocabulary failed;
+    const string missing = dir + "/missing.dbow3";
+    loadFailuresOk = loadFailuresOk && !failed.Load(missing) && !exists(missing + ".flat");
+
+    const string flatPath = dbow3Path + ".flat";
+    const string truncatedFlat = dir + "/truncated.flat", truncatedHeader = dir + "/header.flat";
+    truncateCopy(flatPath, truncatedFlat, fileSize(flatPath) / 2);
+    truncateCopy(flatPath, truncatedHeader, 20);
+    loadFailuresOk = loadFailuresOk && !failed.Load(truncatedFlat) && !exists(truncatedFlat + ".flat");
+    loadFailuresOk = loadFailuresOk && !failed.Load(truncatedHeader) && !exists(truncatedHeader + ".flat");
+
+    for (const Config &config : configs) {
+        const string path = dir + "/voc" + to_string(config.k) + ".dbow3";
+        const string truncated = dir + "/truncated" + to_string(config.k) + ".dbow3";
+        truncateCopy(path, truncated, fileSize(path) / 2);
+        loadFailuresOk = loadFailuresOk && !failed.Load(truncated) && !exists(truncated + ".flat");
+    }
+    loadFailuresOk = loadFailuresOk && failed.empty();
+
+    for (const Config &config : configs) {
+        const string path = dir + "/voc" + to_string(config.k) + ".dbow3";
+        remove(path.c_str());
+        remove((path + ".flat").c_str());
+        remove((dir + "/truncated" + to_string(config.k) + ".dbow3").c_str());
+    }
+    remove(truncatedFlat.c_str());
+    remove(truncatedHeader.c_str());
+    rmdir(dir.c_str());
+
+    printf("%d of 2 vocabularies converted and mapped, %d transforms, %d differ from DBoW3\n", numLoaded,
+           numTransforms, numMismatches);
+    printf("%d descriptors with words above the level of the node ids\n", numWordsAboveLevel);
+    printf("missing and truncated files rejected: %s\n", loadFailuresOk ? "yes" : "no");
+
+    bool ok = numLoaded == 2 && numTransforms > 0 && numMismatches == 0 && loadFailuresOk;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
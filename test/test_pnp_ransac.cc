@@ -0,0 +1,162 @@
+/**
+ * Checks PnPRansac on synthetic data. The minimal solver gets consistent samples (it has to find the true pose),
+ * inconsistent ones (random bearings, where the quartic often has complex roots) and degenerate ones (collinear
+ * points, parallel bearings); every pose it returns has to map the three points onto their bearings. Solve gets
+ * correspondences of a known pose with pixel noise and outliers, and has to recover the pose and the inlier set.
+ */
+
+#include "frontend/PnPRansac.h"
+
+#include <cstdio>
+#include <random>
+#include <algorithm>
+
+using namespace ldso;
+
+static std::mt19937 rng(3);
+static std::uniform_real_distribution<double> uniform(-1, 1);
+
+const float fx = 500, fy = 500, cx = 320, cy = 240;
+
+static SE3 randomPose(double rot, double trans) {
+    Vec6 xi;
+    xi << trans * uniform(rng), trans * uniform(rng), trans * uniform(rng), rot * uniform(rng), rot * uniform(rng),
+            rot * uniform(rng);
+    return SE3::exp(xi);
+}
+
+// largest distance of the normalized points from their bearings
+static double bearingError(const SE3 &Tcr, const Vec3 P[3], const Vec3 f[3]) {
+    double err = 0;
+    for (int k = 0; k < 3; k++)
+        err = std::max(err, ((Tcr * P[k]).normalized() - f[k]).norm());
+    return err;
+}
+
+static double rotationError(const SE3 &T, const SE3 &ref) {
+    return (T.so3().inverse() * ref.so3()).log().norm();
+}
+
+int main() {
+
+    // minimal solver
+    const int N = 20000;
+    const double THBearing = 2e-4;
+    int numConsistent = 0, truePoseFound = 0, numInconsistent = 0, withoutSolution = 0, numSolutions = 0;
+    double maxBearingError = 0;
+    for (int n = 0; n < N; n++) {
+        bool consistent = n % 2 == 0;
+        SE3 T = randomPose(0.5, 1.0);
+        Vec3 P[3], f[3];
+        for (int k = 0; k < 3; k++) {
+            P[k] = Vec3(uniform(rng), uniform(rng), 4 + uniform(rng));
+            f[k] = consistent ? Vec3((T * P[k]).normalized()) :
+                   Vec3(0.5 * uniform(rng), 0.5 * uniform(rng), 1).normalized();
+        }
+
+        SE3 solutions[4];
+        int nsol = PnPRansac::P3P(P, f, solutions);
+        numSolutions += nsol;
+        bool found = false;
+        for (int s = 0; s < nsol; s++) {
+            maxBearingError = std::max(maxBearingError, bearingError(solutions[s], P, f));
+            found = found || (rotationError(solutions[s], T) < 1e-6 &&
+                              (solutions[s].translation() - T.translation()).norm() < 1e-6);
+        }
+        if (consistent) {
+            numConsistent++;
+            truePoseFound += found;
+        } else {
+            numInconsistent++;
+            withoutSolution += nsol == 0;
+        }
+    }
+
+    // degenerate minimal samples
+    int degenerateSolutions = 0;
+    for (int n = 0; n < 100; n++) {
+        SE3 T = randomPose(0.5, 1.0);
+        Vec3 A(uniform(rng), uniform(rng), 4), B(uniform(rng), uniform(rng), 5);
+        Vec3 collinear[3] = {A, B, A + 0.7 * (B - A)};
+        Vec3 fCollinear[3];
+        for (int k = 0; k < 3; k++)
+            fCollinear[k] = (T * collinear[k]).normalized();
+        SE3 solutions[4];
+        degenerateSolutions += PnPRansac::P3P(collinear, fCollinear, solutions);
+
+        Vec3 P[3] = {A, B, Vec3(uniform(rng), uniform(rng), 6)};
+        Vec3 fParallel[3] = {(T * A).normalized(), (T * A).normalized(), (T * P[2]).normalized()};
+        degenerateSolutions += PnPRansac::P3P(P, fParallel, solutions);
+    }
+
+    printf("P3P: true pose found in %d of %d consistent samples, %d of %d inconsistent samples without solution, "
+           "%d degenerate solutions\n", truePoseFound, numConsistent, withoutSolution, numInconsistent,
+           degenerateSolutions);
+    printf("P3P: %d solutions, largest distance from the bearings %g\n", numSolutions, maxBearingError);
+
+    // full RANSAC: known pose, one pixel noise, 30% outliers at least twice the threshold away from the projection
+    const int numPoints = 300;
+    const float reprojTH = 8;
+    std::normal_distribution<double> noise(0, 1);
+    double maxRotError = 0, maxTransError = 0;
+    int wrongInlierSets = 0, failed = 0;
+    for (int trial = 0; trial < 20; trial++) {
+        SE3 Tcr = randomPose(0.3, 0.5);
+        VecVec3f points;
+        VecVec2f pixels;
+        vector<int> trueInliers;
+        while ((int) points.size() < numPoints) {
+            Vec3 p(4 * uniform(rng), 3 * uniform(rng), 5.5 + 2.5 * uniform(rng));
+            Vec3 pc = Tcr * p;
+            if (pc[2] < 0.5)
+                continue;
+            Vec2 uv(fx * pc[0] / pc[2] + cx, fy * pc[1] / pc[2] + cy);
+            if (uniform(rng) < -0.4) {
+                Vec2 outlier;
+                do outlier = Vec2(320 + 320 * uniform(rng), 240 + 240 * uniform(rng));
+                while ((outlier - uv).norm() < 2 * reprojTH);
+                uv = outlier;
+            } else {
+                uv += Vec2(noise(rng), noise(rng));
+                trueInliers.push_back(points.size());
+            }
+            points.push_back(p.cast<float>());
+            pixels.push_back(uv.cast<float>());
+        }
+
+        PnPRansac pnp(fx, fy, cx, cy, reprojTH, 200);
+        SE3 T;
+        vector<int> inliers;
+        if (!pnp.Solve(points, pixels, T, inliers)) {
+            failed++;
+            continue;
+        }
+        std::sort(inliers.begin(), inliers.end());
+        wrongInlierSets += inliers != trueInliers;
+        maxRotError = std::max(maxRotError, rotationError(T, Tcr));
+        maxTransError = std::max(maxTransError, (T.translation() - Tcr.translation()).norm());
+    }
+
+    // correspondences on a line don't determine the pose
+    VecVec3f linePoints;
+    VecVec2f linePixels;
+    for (int i = 0; i < 50; i++) {
+        Vec3 p(-1 + 0.04 * i, 0.5 - 0.02 * i, 5 + 0.03 * i);
+        linePoints.push_back(p.cast<float>());
+        linePixels.push_back(Vec2f(fx * p[0] / p[2] + cx, fy * p[1] / p[2] + cy));
+    }
+    PnPRansac pnp(fx, fy, cx, cy, reprojTH, 200);
+    SE3 T;
+    vector<int> inliers;
+    bool collinearRejected = !pnp.Solve(linePoints, linePixels, T, inliers);
+
+    printf("Solve: %d of 20 failed, %d wrong inlier sets, rotation error %g rad, translation error %g\n", failed,
+           wrongInlierSets, maxRotError, maxTransError);
+    printf("Solve: collinear points rejected: %s\n", collinearRejected ? "yes" : "no");
+
+    bool ok = truePoseFound >= numConsistent - numConsistent / 1000 && withoutSolution > 0 &&
+              maxBearingError < THBearing && degenerateSolutions == 0 && failed == 0 && wrongInlierSets == 0 &&
+              maxRotError < 2e-3 && maxTransError < 2e-2 && collinearRejected;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+/**
+ * Checks the analytic jacobians of the edges in PR.h against central differences of computeError, with the vertex
+ * updates done by oplus. Relative pose residuals go up to |e| ~ 1, the range where a truncated inverse left
+ * jacobian is visibly off. Also checks that the projection edges give zero jacobians for points behind the camera.
+ */
+
+#include "internal/PR.h"
+#include "internal/CalibHessian.h"
+#include "Camera.h"
+
+#include <g2o/core/jacobian_workspace.h>
+
+#include <cstdio>
+#include <random>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+static std::mt19937 rng(7);
+
+template<int D>
+static Matrix<double, D, 1> randomVec(double scale) {
+    std::uniform_real_distribution<double> uniform(-scale, scale);
+    Matrix<double, D, 1> v;
+    for (int i = 0; i < D; i++)
+        v[i] = uniform(rng);
+    return v;
+}
+
+// gives access to the jacobians of the multi edge
+class EdgePRIDPTest : public EdgePRIDP {
+public:
+    EdgePRIDPTest(double x, double y, shared_ptr<CalibHessian> &calib) : EdgePRIDP(x, y, calib) {}
+
+    MatrixXd jacobian(int i) const { return _jacobianOplus[i]; }
+};
+
+static g2o::JacobianWorkspace workspace;
+
+// the jacobians are mapped into the workspace, like in the optimizer
+static void linearize(g2o::OptimizableGraph::Edge &e) {
+    workspace.updateSize(&e);
+    workspace.allocate();
+    e.linearizeOplus(workspace);
+}
+
+// central differences of the error w.r.t. vertex i
+static MatrixXd numericJacobian(g2o::OptimizableGraph::Edge &e, int i) {
+    auto *v = static_cast<g2o::OptimizableGraph::Vertex *>(e.vertex(i));
+    const double h = 1e-6;
+    MatrixXd J(e.dimension(), v->dimension());
+    for (int k = 0; k < v->dimension(); k++) {
+        VectorXd delta = VectorXd::Zero(v->dimension());
+        delta[k] = h;
+        v->push();
+        v->oplus(delta.data());
+        e.computeError();
+        VectorXd ePlus = Map<const VectorXd>(e.errorData(), e.dimension());
+        v->pop();
+
+        delta[k] = -h;
+        v->push();
+        v->oplus(delta.data());
+        e.computeError();
+        VectorXd eMinus = Map<const VectorXd>(e.errorData(), e.dimension());
+        v->pop();
+
+        J.col(k) = (ePlus - eMinus) / (2 * h);
+    }
+    return J;
+}
+
+static double deviation(const MatrixXd &J, const MatrixXd &ref) {
+    return (J - ref).norm() / std::max(1e-9, ref.norm());
+}
+
+int main() {
+
+    const int N = 500;
+    const double TH = 1e-6;
+
+    shared_ptr<Camera> cam(new Camera(500, 510, 320, 240));
+    shared_ptr<CalibHessian> calib(new CalibHessian(cam));
+
+    double devSim3 = 0, devPR = 0, devPointSim3 = 0, devProjSim3 = 0, devProj = 0, devPRIDP = 0;
+    for (int n = 0; n < N; n++) {
+        // relative pose edges, the measurement is off by up to |e| ~ 1
+        VertexSim3 s1, s2;
+        s1.setEstimate(Sim3::exp(randomVec<7>(1.0)));
+        s2.setEstimate(Sim3::exp(randomVec<7>(1.0)));
+        EdgeSim3 eSim3;
+        eSim3.setVertex(0, &s1);
+        eSim3.setVertex(1, &s2);
+        eSim3.setMeasurement(s1.estimate() * s2.estimate().inverse() * Sim3::exp(randomVec<7>(0.5)));
+        linearize(eSim3);
+        devSim3 = std::max(devSim3, deviation(eSim3.jacobianOplusXi(), numericJacobian(eSim3, 0)));
+        devSim3 = std::max(devSim3, deviation(eSim3.jacobianOplusXj(), numericJacobian(eSim3, 1)));
+
+        VertexPR p1, p2;
+        p1.setEstimate(SE3::exp(randomVec<6>(1.0)));
+        p2.setEstimate(SE3::exp(randomVec<6>(1.0)));
+        EdgePR ePR;
+        ePR.setVertex(0, &p1);
+        ePR.setVertex(1, &p2);
+        ePR.setMeasurement(p1.estimate() * p2.estimate().inverse() * SE3::exp(randomVec<6>(0.5)));
+        linearize(ePR);
+        devPR = std::max(devPR, deviation(ePR.jacobianOplusXi(), numericJacobian(ePR, 0)));
+        devPR = std::max(devPR, deviation(ePR.jacobianOplusXj(), numericJacobian(ePR, 1)));
+
+        // point and projection edges
+        Vector3d pw = randomVec<3>(1.0) + Vector3d(0, 0, 4);
+        VertexSim3 s;
+        s.setEstimate(Sim3::exp(randomVec<7>(0.2)));
+        EdgePointSim3 ePointSim3(pw);
+        ePointSim3.setVertex(0, &s);
+        ePointSim3.setMeasurement(Vector3d(1, 2, 3));
+        linearize(ePointSim3);
+        devPointSim3 = std::max(devPointSim3, deviation(ePointSim3.jacobianOplusXi(), numericJacobian(ePointSim3, 0)));
+
+        EdgeProjectPoseOnlySim3 eProjSim3(cam, pw);
+        eProjSim3.setVertex(0, &s);
+        eProjSim3.setMeasurement(Vector2d(300, 200));
+        linearize(eProjSim3);
+        devProjSim3 = std::max(devProjSim3, deviation(eProjSim3.jacobianOplusXi(), numericJacobian(eProjSim3, 0)));
+
+        VertexPR p;
+        p.setEstimate(SE3::exp(randomVec<6>(0.2)));
+        EdgeProjectPoseOnly eProj(cam, pw);
+        eProj.setVertex(0, &p);
+        eProj.setMeasurement(Vector2d(300, 200));
+        linearize(eProj);
+        devProj = std::max(devProj, deviation(eProj.jacobianOplusXi(), numericJacobian(eProj, 0)));
+
+        VertexPointInvDepth vIDP;
+        vIDP.setEstimate(0.25 + randomVec<1>(0.05)[0]);
+        VertexPR p0, pi;
+        p0.setEstimate(SE3::exp(randomVec<6>(0.2)));
+        pi.setEstimate(SE3::exp(randomVec<6>(0.2)));
+        EdgePRIDPTest ePRIDP(randomVec<1>(0.1)[0], randomVec<1>(0.1)[0], calib);
+        ePRIDP.setVertex(0, &vIDP);
+        ePRIDP.setVertex(1, &p0);
+        ePRIDP.setVertex(2, &pi);
+        ePRIDP.setMeasurement(Vec2(300, 200));
+        linearize(ePRIDP);
+        for (int i = 0; i < 3; i++)
+            devPRIDP = std::max(devPRIDP, deviation(ePRIDP.jacobian(i), numericJacobian(ePRIDP, i)));
+    }
+
+    // a point behind the camera: computeError leaves the error alone, the jacobians are zero
+    Vector3d behind(0.1, 0.2, -3);
+    VertexPR p;
+    p.setEstimate(SE3());
+    EdgeProjectPoseOnly eProj(cam, behind);
+    eProj.setVertex(0, &p);
+    linearize(eProj);
+    VertexSim3 s;
+    s.setEstimate(Sim3());
+    EdgeProjectPoseOnlySim3 eProjSim3(cam, behind);
+    eProjSim3.setVertex(0, &s);
+    linearize(eProjSim3);
+    bool behindOk = eProj.jacobianOplusXi().isZero() && eProjSim3.jacobianOplusXi().isZero();
+
+    printf("max relative deviation from numeric jacobians:\n"
+           "EdgeSim3 %g, EdgePR %g, EdgePointSim3 %g, EdgeProjectPoseOnlySim3 %g, EdgeProjectPoseOnly %g, "
+           "EdgePRIDP %g\n", devSim3, devPR, devPointSim3, devProjSim3, devProj, devPRIDP);
+    printf("zero jacobians behind the camera: %s\n", behindOk ? "yes" : "no");
+
+    bool ok = devSim3 < TH && devPR < TH && devPointSim3 < TH && devProjSim3 < TH && devProj < TH &&
+              devPRIDP < TH && behindOk;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
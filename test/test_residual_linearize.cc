@@ -0,0 +1,170 @@
+/**
+ * Checks the AVX2 pattern loop of PointFrameResidual::linearize (linearizePatternAVX) against the scalar loop.
+ * Both paths linearize the same residuals on a synthetic host/target pair, switched with setting_useAVX2. Points
+ * are spread over the whole image, so some patterns leave the target image (OOB) and some residuals are outliers.
+ */
+
+#include "Frame.h"
+#include "internal/FrameHessian.h"
+#include "internal/FrameFramePrecalc.h"
+#include "internal/PointHessian.h"
+#include "internal/CalibHessian.h"
+#include "internal/GlobalCalib.h"
+#include "internal/GlobalFuncs.h"
+#include "internal/CPUFeatures.h"
+
+#include <cstdio>
+#include <random>
+
+using namespace ldso;
+using namespace ldso::internal;
+
+const int w = 640, h = 480;
+
+// smooth texture with gradients in both directions, shifted between host and target
+static vector<float> makeImage(float shift) {
+    vector<float> img(w * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            img[x + y * w] = 128 + 60 * sinf(0.11f * x + shift) * cosf(0.07f * y) +
+                             30 * sinf(0.05f * (x + y) + 2 * shift);
+    return img;
+}
+
+// what linearize writes into slot i of the block and the residual
+struct Linearization {
+    double energy;
+    ResState state;
+    VecNRf resF, JIdx[2], JabF[2];
+    Mat22f JIdx2, JabJIdx, Jab2;
+    Eigen::Vector2f projectedTo[patternNum];
+};
+
+static Linearization linearize(PointFrameResidual &r, shared_ptr<CalibHessian> &Hcalib, bool avx) {
+    setting_useAVX2 = avx;
+    Linearization l;
+    l.energy = r.linearize(Hcalib);
+    l.state = r.state_NewState;
+    const ResidualBlock *blk = r.block;
+    const int i = r.blockIdx;
+    l.resF = blk->resF[i];
+    for (int k = 0; k < 2; k++) {
+        l.JIdx[k] = blk->JIdx[k][i];
+        l.JabF[k] = blk->JabF[k][i];
+    }
+    l.JIdx2 = blk->JIdx2[i];
+    l.JabJIdx = blk->JabJIdx[i];
+    l.Jab2 = blk->Jab2[i];
+    for (int k = 0; k < patternNum; k++)
+        l.projectedTo[k] = r.projectedTo[k];
+    return l;
+}
+
+// largest deviation of an entry, relative to the entry or to 1 for small entries
+template<typename A, typename B>
+static double deviation(const A &a, const B &ref) {
+    return ((a - ref).array().abs() / ref.array().abs().max(1.0f)).maxCoeff();
+}
+
+// deviation of the inner products P(r, c) = a[r].dot(b[c]), relative to |a[r]| |b[c]| (they cancel out)
+static double deviation(const Mat22f &P, const Mat22f &ref, const VecNRf *a, const VecNRf *b) {
+    double dev = 0;
+    for (int r = 0; r < 2; r++)
+        for (int c = 0; c < 2; c++)
+            dev = std::max(dev, (double) (fabs(P(r, c) - ref(r, c)) / std::max(1.0f, a[r].norm() * b[c].norm())));
+    return dev;
+}
+
+int main() {
+
+    if (!useAVX2()) {
+        printf("cpu has no AVX2/FMA, nothing to check\n");
+        return 0;
+    }
+
+    // the two paths round the projection differently (~1e-4 px), the image gradient and the huber weight amplify
+    // that in the residuals and the products of the weights
+    const int N = 20000;
+    const double TH = 5e-3, THProjection = 1e-6;
+
+    Mat33f K;
+    K << 500, 0, 320, 0, 500, 240, 0, 0, 1;
+    setGlobalCalib(w, h, K);
+    shared_ptr<Camera> cam(new Camera(500, 500, 320, 240));
+    shared_ptr<CalibHessian> Hcalib(new CalibHessian(cam));
+
+    vector<float> hostImage = makeImage(0), targetImage = makeImage(0.05f);
+    shared_ptr<Frame> hostFrame(new Frame(0)), targetFrame(new Frame(1));
+    hostFrame->CreateFH(hostFrame);
+    targetFrame->CreateFH(targetFrame);
+    shared_ptr<FrameHessian> host = hostFrame->frameHessian, target = targetFrame->frameHessian;
+    host->makeImages(hostImage.data(), Hcalib);
+    target->makeImages(targetImage.data(), Hcalib);
+    host->ab_exposure = target->ab_exposure = 1;
+    host->setEvalPT_scaled(SE3(), AffLight(0, 0));
+    Vec6 xi;
+    xi << 0.01, 0.005, -0.005, 0.002, -0.004, 0.001;
+    target->setEvalPT_scaled(SE3::exp(xi), AffLight(0.01, 1));
+    host->idx = 0;
+    target->idx = 1;
+    host->targetPrecalc.resize(2);
+    host->targetPrecalc[1].Set(host, target, Hcalib);
+
+    ResidualBlock blk(host.get(), target.get());
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    double devEnergy = 0, devRes = 0, devJ = 0, devInner = 0, devProj = 0;
+    int numIn = 0, numOutlier = 0, numOOB = 0, stateMismatch = 0;
+    for (int n = 0; n < N; n++) {
+        shared_ptr<PointHessian> ph = PointHessian::Create();
+        ph->u = 3 + (w - 7) * uniform(rng);
+        ph->v = 3 + (h - 7) * uniform(rng);
+        float idepth = 0.2f + 1.8f * uniform(rng);
+        ph->idepth = ph->idepth_zero = idepth;
+        ph->idepth_scaled = ph->idepth_zero_scaled = SCALE_IDEPTH * idepth;
+        for (int k = 0; k < patternNum; k++) {
+            ph->color[k] = getInterpolatedElement31(host->dI, ph->u + patternP[k][0], ph->v + patternP[k][1], w);
+            ph->weights[k] = 0.5f + 0.5f * uniform(rng);
+        }
+
+        shared_ptr<PointFrameResidual> r = PointFrameResidual::Create(ph, host, target);
+        blk.add(r);
+
+        Linearization avx = linearize(*r, Hcalib, true);
+        Linearization ref = linearize(*r, Hcalib, false);
+
+        if (avx.state != ref.state) {
+            stateMismatch++;
+        } else if (ref.state == ResState::OOB) {
+            numOOB++;
+        } else {
+            if (ref.state == ResState::IN)
+                numIn++;
+            else
+                numOutlier++;
+            devEnergy = std::max(devEnergy, fabs(avx.energy - ref.energy) / std::max(1.0, ref.energy));
+            devRes = std::max(devRes, deviation(avx.resF, ref.resF));
+            for (int k = 0; k < 2; k++)
+                devJ = std::max(devJ, std::max(deviation(avx.JIdx[k], ref.JIdx[k]),
+                                               deviation(avx.JabF[k], ref.JabF[k])));
+            devInner = std::max(devInner, deviation(avx.JIdx2, ref.JIdx2, ref.JIdx, ref.JIdx));
+            devInner = std::max(devInner, deviation(avx.JabJIdx, ref.JabJIdx, ref.JabF, ref.JIdx));
+            devInner = std::max(devInner, deviation(avx.Jab2, ref.Jab2, ref.JabF, ref.JabF));
+            for (int k = 0; k < patternNum; k++)
+                devProj = std::max(devProj, deviation(avx.projectedTo[k], ref.projectedTo[k]));
+        }
+        blk.remove(r.get());
+    }
+    setting_useAVX2 = true;
+
+    printf("%d residuals: %d in, %d outliers, %d oob, %d with different states\n", N, numIn, numOutlier, numOOB,
+           stateMismatch);
+    printf("max relative deviation of the avx path: energy %g, residuals %g, jacobians %g, inner products %g, "
+           "projections %g\n", devEnergy, devRes, devJ, devInner, devProj);
+
+    bool ok = stateMismatch == 0 && numIn > 0 && numOutlier > 0 && numOOB > 0 && devEnergy < TH && devRes < TH &&
+              devJ < TH && devInner < TH && devProj < THProjection;
+    printf(ok ? "passed\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}